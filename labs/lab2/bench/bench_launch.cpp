@@ -0,0 +1,95 @@
+#include "background_launcher.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+// Латентность BackgroundLauncher::launch для разных способов запуска
+// в зависимости от размера кучи родителя.
+// Запуск: LAB_2_BENCH_LAUNCH [итераций] [размер кучи, МБ ...]
+
+namespace
+{
+    struct Stats
+    {
+        double mean_us;
+        double p50_us;
+        double p99_us;
+    };
+
+    Stats measure(LaunchBackend backend, int iterations)
+    {
+        LaunchOptions options;
+        options.backend = backend;
+        options.redirect(1, "/dev/null");
+
+        vector<double> samples;
+        samples.reserve(iterations);
+        for (int i = 0; i < iterations; ++i)
+        {
+            auto start = chrono::steady_clock::now();
+            ProcessHandle handle = BackgroundLauncher::launch({"true"}, options);
+            auto end = chrono::steady_clock::now();
+            BackgroundLauncher::wait(handle);
+            samples.push_back(chrono::duration<double, micro>(end - start).count());
+        }
+
+        sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double s : samples)
+            sum += s;
+        return {sum / samples.size(), samples[samples.size() / 2], samples[samples.size() * 99 / 100]};
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 50;
+    vector<size_t> heap_sizes_mb;
+    for (int i = 2; i < argc; ++i)
+        heap_sizes_mb.push_back(strtoul(argv[i], nullptr, 10));
+    if (heap_sizes_mb.empty())
+        heap_sizes_mb = {0, 256, 1024};
+
+    const LaunchBackend backends[] = {LaunchBackend::Fork, LaunchBackend::PosixSpawn, LaunchBackend::VFork};
+
+    cout << setw(10) << "heap, MB" << setw(14) << "backend"
+         << setw(12) << "mean, us" << setw(12) << "p50, us" << setw(12) << "p99, us" << endl;
+
+    for (size_t mb : heap_sizes_mb)
+    {
+        // Память должна быть реально занята, иначе таблицы страниц пустые
+        size_t bytes = mb * 1024 * 1024;
+        char *heap = static_cast<char *>(malloc(bytes ? bytes : 1));
+        if (!heap)
+        {
+            cerr << "Failed to allocate " << mb << " MB" << endl;
+            return 1;
+        }
+        memset(heap, 1, bytes);
+
+        for (LaunchBackend backend : backends)
+        {
+            try
+            {
+                Stats stats = measure(backend, iterations);
+                cout << setw(10) << mb << setw(14) << BackgroundLauncher::backendName(backend)
+                     << fixed << setprecision(1)
+                     << setw(12) << stats.mean_us << setw(12) << stats.p50_us << setw(12) << stats.p99_us << endl;
+            }
+            catch (const exception &e)
+            {
+                cerr << "Error: " << e.what() << endl;
+                return 1;
+            }
+        }
+
+        free(heap);
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "background_launcher.h"
+#include "zygote.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+// Латентность от запроса на запуск до первой инструкции потомка (начало main
+// или точки входа зиготы) для exec-запуска и для зиготы.
+// Запуск: LAB_2_BENCH_ZYGOTE [итераций]
+
+namespace
+{
+    int64_t nowNs()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Потомок сразу сообщает время старта через унаследованный канал
+    int reportStart(const vector<string> &args)
+    {
+        int64_t started = nowNs();
+        int fd = atoi(args[2].c_str());
+        return write(fd, &started, sizeof(started)) == sizeof(started) ? 0 : 1;
+    }
+
+    void measure(LaunchBackend backend, const vector<string> &args, int read_fd, int iterations)
+    {
+        LaunchOptions options;
+        options.backend = backend;
+
+        vector<double> samples;
+        for (int i = 0; i < iterations; ++i)
+        {
+            int64_t requested = nowNs();
+            ProcessHandle handle = BackgroundLauncher::launch(args, options);
+            int64_t started = 0;
+            if (read(read_fd, &started, sizeof(started)) != sizeof(started))
+                throw runtime_error("child did not report");
+            BackgroundLauncher::wait(handle);
+            samples.push_back((started - requested) / 1000.0);
+        }
+
+        sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double s : samples)
+            sum += s;
+        cout << setw(14) << BackgroundLauncher::backendName(backend) << fixed << setprecision(1)
+             << setw(12) << sum / samples.size()
+             << setw(12) << samples[samples.size() / 2]
+             << setw(12) << samples[samples.size() * 99 / 100] << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2 && string(argv[1]) == "--child")
+        return reportStart({argv[0], argv[1], argv[2]});
+
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+    // Канал без O_CLOEXEC: его наследуют и exec-потомки, и шаблон зиготы
+    int fds[2];
+    if (pipe(fds) == -1)
+        return 1;
+
+    if (!Zygote::start(reportStart))
+    {
+        cerr << "Failed to start zygote" << endl;
+        return 1;
+    }
+
+    vector<string> args = {"/proc/self/exe", "--child", to_string(fds[1])};
+
+    cout << setw(14) << "backend" << setw(12) << "mean, us" << setw(12) << "p50, us" << setw(12) << "p99, us" << endl;
+    try
+    {
+        for (LaunchBackend backend : {LaunchBackend::Fork, LaunchBackend::PosixSpawn, LaunchBackend::VFork, LaunchBackend::Zygote})
+            measure(backend, args, fds[0], iterations);
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    Zygote::stop();
+    return 0;
+}
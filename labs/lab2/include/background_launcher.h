@@ -9,17 +9,117 @@
 using ProcessHandle = HANDLE;
 #else
 #include <sys/types.h>
+#include <sys/resource.h>
 using ProcessHandle = pid_t;
 #endif
 
 using namespace std;
 
+/// @brief Способ порождения процесса (на Windows всегда CreateProcess)
+enum class LaunchBackend
+{
+    Default,    // Берётся из BackgroundLauncher::defaultBackend()
+    Fork,       // fork() + execvp(): копирует таблицы страниц родителя
+    PosixSpawn, // posix_spawnp(): время запуска не зависит от размера родителя
+    VFork,      // clone(CLONE_VM | CLONE_VFORK) + execvp()
+    Zygote,     // fork прогретого шаблона, см. Zygote; без него - как Default
+};
+
+/// @brief Действие над дескриптором потомка, выполняемое перед exec
+struct FileAction
+{
+    enum class Type
+    {
+        Open, // fd = open(path, flags, mode)
+        Dup2, // fd = dup2(source_fd)
+        Close // close(fd)
+    };
+
+    Type type;
+    int fd;
+    string path;
+    int flags = 0;
+    int mode = 0644;
+    int source_fd = -1;
+
+    static FileAction open(int fd, const string &path, int flags, int mode = 0644);
+    static FileAction dup2(int source_fd, int fd);
+    static FileAction close(int fd);
+};
+
+/// @brief Ограничение ресурса потомка (setrlimit), только POSIX
+struct ResourceLimit
+{
+    int resource; // RLIMIT_*
+    unsigned long long soft;
+    unsigned long long hard;
+};
+
+/// @brief Параметры запуска
+struct LaunchOptions
+{
+    LaunchBackend backend = LaunchBackend::Default;
+    vector<FileAction> file_actions; // Выполняются по порядку
+    bool capture_stdout = false;     // Только для launch(..., CapturedPipes &)
+    bool capture_stderr = false;
+
+    // Размещение потомка. Задаётся до exec, поэтому posix_spawn в этом случае
+    // заменяется на vfork (posix_spawn не умеет affinity и rlimit)
+    vector<int> cpu_affinity;   // Номера CPU, пусто - без привязки
+    bool set_nice = false;
+    int nice = 0;               // На Windows - соответствующий класс приоритета
+    int sched_policy = -1;      // SCHED_OTHER/BATCH/IDLE/FIFO/RR, -1 - не менять
+    int sched_priority = 0;
+    vector<ResourceLimit> rlimits;
+    string cgroup;              // Каталог cgroup v2, пусто - cgroup родителя
+
+    bool hasPlacement() const;
+
+    // Перенаправить fd 0/1/2 в файл (для 0 - на чтение)
+    LaunchOptions &redirect(int fd, const string &path, bool append = false);
+};
+
+/// @brief Читающие концы каналов, подключённых к потомку (-1 - не перехвачен)
+struct CapturedPipes
+{
+    int stdout_fd = -1;
+    int stderr_fd = -1;
+};
+
+/// @brief Потреблённые потомком ресурсы (wait4 / GetProcessTimes)
+struct ResourceUsage
+{
+    long max_rss_kb = 0;
+    double user_time_s = 0;
+    double system_time_s = 0;
+    long voluntary_switches = 0;   // Нет на Windows
+    long involuntary_switches = 0; // Нет на Windows
+    long minor_faults = 0;
+    long major_faults = 0;
+
+#ifndef _WIN32
+    static ResourceUsage fromRusage(const struct rusage &usage);
+#endif
+};
+
 /// @brief Кастомный Process Handle
 class BackgroundLauncher
 {
 public:
+    // Процесс не удалось запустить (в том числе не нашёлся исполняемый файл или не
+    // применились file_actions) - runtime_error, одинаково для всех способов запуска
     static ProcessHandle launch(const vector<string> &args);
-    static bool wait(ProcessHandle handle, int *exit_code = nullptr);
+    static ProcessHandle launch(const vector<string> &args, const LaunchOptions &options);
+#ifndef _WIN32
+    // Перехват stdout/stderr в неблокирующие каналы, см. OutputCapture
+    static ProcessHandle launch(const vector<string> &args, const LaunchOptions &options, CapturedPipes &pipes);
+#endif
+    static bool wait(ProcessHandle handle, int *exit_code = nullptr, ResourceUsage *usage = nullptr);
+
+    // Способ запуска по умолчанию, можно менять во время работы
+    static LaunchBackend defaultBackend();
+    static void setDefaultBackend(LaunchBackend backend);
+    static const char *backendName(LaunchBackend backend);
 };
 
-#endif
\ No newline at end of file
+#endif
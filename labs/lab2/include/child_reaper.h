@@ -0,0 +1,64 @@
+#ifndef CHILD_REAPER_H
+#define CHILD_REAPER_H
+
+#include "background_launcher.h"
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <sys/resource.h>
+
+using namespace std;
+
+/// @brief Результат завершения потомка
+struct ChildExit
+{
+    ProcessHandle pid = 0;
+    bool exited = false; // Завершился сам, exit_code валиден
+    int exit_code = 0;
+    int signal = 0;      // Номер сигнала, если был убит
+    struct rusage usage = {};
+};
+
+/// @brief Асинхронный сборщик потомков: pidfd каждого потомка в одном epoll.
+/// Один поток обслуживает любое число процессов без опроса.
+class ChildReaper
+{
+public:
+    using Callback = function<void(const ChildExit &)>;
+
+    ChildReaper();
+    ~ChildReaper();
+    ChildReaper(const ChildReaper &) = delete;
+    ChildReaper &operator=(const ChildReaper &) = delete;
+
+    // Без callback результат попадает в очередь для waitAny/waitAll.
+    // false, если pid уже отслеживается или pidfd не открылся
+    bool add(ProcessHandle pid, Callback callback = nullptr);
+
+    // Обработать готовые события, timeout_ms < 0 - ждать бесконечно.
+    // Возвращает число собранных потомков
+    size_t poll(int timeout_ms = 0);
+
+    bool waitAny(ChildExit &result, int timeout_ms = -1);
+    bool waitAll(vector<ChildExit> &results, int timeout_ms = -1);
+
+    size_t pending() const; // Ещё не завершившиеся потомки
+    int fd() const { return epoll_fd_; } // Для встраивания в чужой цикл событий
+
+private:
+    struct Entry
+    {
+        int pidfd;
+        Callback callback;
+    };
+
+    bool reap(ProcessHandle pid, ChildExit &result);
+
+    int epoll_fd_;
+    mutable mutex mutex_;
+    unordered_map<ProcessHandle, Entry> children_;
+    deque<ChildExit> completed_;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef JOB_EXECUTOR_H
+#define JOB_EXECUTOR_H
+
+#include "background_launcher.h"
+#include "child_reaper.h"
+#include <chrono>
+#include <ostream>
+
+using namespace std;
+
+/// @brief Описание задания для JobExecutor
+struct JobSpec
+{
+    vector<string> args;
+    LaunchOptions options;
+    vector<size_t> depends_on;               // Задания, которые должны успешно завершиться раньше
+    chrono::milliseconds timeout{0};         // 0 - без ограничения
+    int max_retries = 0;                     // Повторы после неудачной попытки
+    chrono::milliseconds retry_delay{100};   // Удваивается с каждой попыткой
+};
+
+enum class JobState
+{
+    Pending,   // Ждёт зависимости
+    Ready,     // В очереди на запуск
+    Running,
+    Succeeded,
+    Failed,
+    Skipped    // Не запускалось: упала одна из зависимостей
+};
+
+/// @brief Итог по одному заданию
+struct JobResult
+{
+    JobState state = JobState::Pending;
+    int attempts = 0;
+    int exit_code = -1;
+    int signal = 0;
+    bool timed_out = false;
+    double queue_wait_s = 0; // От попадания в очередь до первого запуска
+    double wall_s = 0;       // Последняя попытка
+    double cpu_s = 0;        // user + sys по всем попыткам
+};
+
+/// @brief Итог по всему прогону
+struct ExecutorReport
+{
+    size_t succeeded = 0;
+    size_t failed = 0;
+    size_t skipped = 0;
+    size_t retries = 0;
+    double elapsed_s = 0;
+    double throughput = 0; // Завершённых заданий в секунду
+    double mean_queue_wait_s = 0;
+    double max_queue_wait_s = 0;
+    double mean_wall_s = 0;
+    double total_cpu_s = 0;
+
+    void print(ostream &out) const;
+};
+
+/// @brief Очередь заданий с ограничением числа одновременно работающих процессов.
+/// Зависимости образуют DAG, задания запускаются в топологическом порядке
+/// по мере освобождения слотов
+class JobExecutor
+{
+public:
+    explicit JobExecutor(size_t max_parallel);
+
+    size_t add(JobSpec job); // Возвращает id задания
+    void addDependency(size_t job, size_t depends_on);
+
+    ExecutorReport run(); // Бросает runtime_error, если в зависимостях есть цикл
+
+    size_t size() const { return jobs_.size(); }
+    const JobResult &result(size_t job) const { return results_.at(job); }
+
+private:
+    using Clock = chrono::steady_clock;
+
+    struct Running
+    {
+        size_t job;
+        Clock::time_point started;
+        Clock::time_point deadline;
+        bool killed;
+    };
+
+    struct Retry
+    {
+        Clock::time_point when;
+        size_t job;
+        bool operator>(const Retry &other) const { return when > other.when; }
+    };
+
+    void checkAcyclic() const;
+    void skipDependents(size_t job);
+
+    size_t max_parallel_;
+    vector<JobSpec> jobs_;
+    vector<JobResult> results_;
+    vector<vector<size_t>> dependents_;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef OUTPUT_CAPTURE_H
+#define OUTPUT_CAPTURE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/// @brief Заранее выделенный кольцевой буфер: хранит последние capacity() байт вывода.
+/// При переполнении readFrom затирает самые старые данные, канал потомка не стоит.
+/// fillFrom/append/writeTo работают с ним как с очередью без затирания
+class ByteRing
+{
+public:
+    explicit ByteRing(size_t capacity);
+
+    size_t capacity() const { return data_.size(); }
+    size_t size() const { return size_; }
+    size_t space() const { return data_.size() - size_; }
+    size_t dropped() const { return dropped_; } // Затёрто при переполнении
+    string str() const;                          // Содержимое от старых к новым
+    void clear();
+
+    // Прочитать из fd прямо в буфер (readv по свободным кускам)
+    long readFrom(int fd);
+    // Прочитать из fd не больше space() байт
+    long fillFrom(int fd);
+    // Дописать в конец, если хватает места
+    bool append(const char *data, size_t len);
+    // Записать в fd самые старые данные и убрать записанное
+    long writeTo(int fd);
+
+private:
+    vector<char> data_;
+    size_t head_ = 0; // Куда пишем следующий байт
+    size_t size_ = 0;
+    size_t dropped_ = 0;
+};
+
+/// @brief Сливает вывод многих потомков в одном epoll-цикле.
+/// В дескриптор - через splice() без копирования в пространство пользователя,
+/// в память - в ByteRing
+class OutputCapture
+{
+public:
+    OutputCapture();
+    ~OutputCapture();
+    OutputCapture(const OutputCapture &) = delete;
+    OutputCapture &operator=(const OutputCapture &) = delete;
+
+    // Владение pipe_fd переходит к OutputCapture, закрывается по EOF
+    bool add(int pipe_fd, int dest_fd);
+    bool add(int pipe_fd, ByteRing *ring);
+
+    // Обработать готовые каналы, timeout_ms < 0 - ждать бесконечно.
+    // Возвращает число перенесённых байт
+    size_t poll(int timeout_ms = 0);
+    // Сливать, пока все каналы не закроются (или не выйдет время)
+    bool drainAll(int timeout_ms = -1);
+
+    size_t active() const { return streams_.size(); }
+    size_t bytesTransferred() const { return transferred_; }
+    int fd() const { return epoll_fd_; }
+
+private:
+    struct Stream
+    {
+        int dest_fd;
+        ByteRing *ring;
+        bool use_splice;
+        unique_ptr<ByteRing> backlog; // Не принятое приёмником, уходит раньше новых данных
+        bool waiting = false;         // backlog не пуст, ждём EPOLLOUT приёмника
+        bool paused = false;          // backlog полон, канал снят с epoll
+        bool eof = false;             // Канал закрыт, осталось дописать backlog
+    };
+
+    enum class DrainResult
+    {
+        Open,   // Данных пока нет
+        Closed, // EOF: потомок закрыл свой конец
+        Error
+    };
+
+    bool addStream(int pipe_fd, Stream stream);
+    DrainResult drain(int pipe_fd, Stream &stream, size_t &moved);
+    void settle(int pipe_fd, DrainResult result);
+    void flush(int dest_fd, size_t &moved);
+    bool waitDest(int pipe_fd, Stream &stream);
+    void stopWaiting(int pipe_fd, Stream &stream);
+    void pause(int pipe_fd, Stream &stream);
+    bool resume(int pipe_fd, Stream &stream);
+    void remove(int pipe_fd);
+
+    int epoll_fd_;
+    unordered_map<int, Stream> streams_;
+    unordered_map<int, vector<int>> waiters_; // Приёмник -> каналы, ждущие его
+    size_t transferred_ = 0;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include "background_launcher.h"
+
+using namespace std;
+
+/// @brief Точка входа потомка зиготы: аргументы запроса -> код выхода
+using ZygoteEntry = int (*)(const vector<string> &args);
+
+/// @brief Заранее прогретый процесс-шаблон, порождающий потомков по запросу через Unix-сокет.
+/// Потомок - fork уже инициализированного процесса без exec, динамической линковки
+/// и статической инициализации. start делает вызывающий процесс субрипером, и потомок
+/// через двойной fork становится его прямым потомком: его можно ждать через
+/// BackgroundLauncher::wait/ChildReaper. Субриперу достаются и другие осиротевшие потомки
+class Zygote
+{
+public:
+    // Вызывать до запуска потоков: шаблон - копия текущего процесса
+    static bool start(ZygoteEntry entry);
+    static void stop();
+    static bool running();
+
+    static ProcessHandle spawn(const vector<string> &args);
+};
+
+#endif
@@ -1,13 +1,146 @@
 #include "background_launcher.h"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <stdexcept>
+#include <fcntl.h>
 
+using namespace std;
+
+namespace
+{
 #ifdef _WIN32
-#include <shellapi.h>
+    atomic<LaunchBackend> default_backend{LaunchBackend::Fork};
+#else
+    atomic<LaunchBackend> default_backend{LaunchBackend::PosixSpawn};
+#endif
+}
 
-using namespace std;
+FileAction FileAction::open(int fd, const string &path, int flags, int mode)
+{
+    return FileAction{Type::Open, fd, path, flags, mode, -1};
+}
+
+FileAction FileAction::dup2(int source_fd, int fd)
+{
+    return FileAction{Type::Dup2, fd, string(), 0, 0644, source_fd};
+}
+
+FileAction FileAction::close(int fd)
+{
+    return FileAction{Type::Close, fd, string(), 0, 0644, -1};
+}
+
+LaunchOptions &LaunchOptions::redirect(int fd, const string &path, bool append)
+{
+    int flags = fd == 0 ? O_RDONLY : (O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC));
+    file_actions.push_back(FileAction::open(fd, path, flags));
+    return *this;
+}
+
+bool LaunchOptions::hasPlacement() const
+{
+    return !cpu_affinity.empty() || set_nice || sched_policy != -1 || !rlimits.empty() || !cgroup.empty();
+}
+
+LaunchBackend BackgroundLauncher::defaultBackend()
+{
+    return default_backend.load();
+}
+
+void BackgroundLauncher::setDefaultBackend(LaunchBackend backend)
+{
+    if (backend != LaunchBackend::Default)
+        default_backend.store(backend);
+}
+
+const char *BackgroundLauncher::backendName(LaunchBackend backend)
+{
+    switch (backend)
+    {
+    case LaunchBackend::Fork:
+        return "fork";
+    case LaunchBackend::PosixSpawn:
+        return "posix_spawn";
+    case LaunchBackend::VFork:
+        return "vfork";
+    case LaunchBackend::Zygote:
+        return "zygote";
+    default:
+        return backendName(defaultBackend());
+    }
+}
 
 ProcessHandle BackgroundLauncher::launch(const vector<string> &args)
+{
+    return launch(args, LaunchOptions());
+}
+
+#ifdef _WIN32
+#include <shellapi.h>
+#include <psapi.h>
+
+namespace
+{
+    DWORD priorityClass(int nice)
+    {
+        if (nice <= -15)
+            return HIGH_PRIORITY_CLASS;
+        if (nice < 0)
+            return ABOVE_NORMAL_PRIORITY_CLASS;
+        if (nice == 0)
+            return NORMAL_PRIORITY_CLASS;
+        if (nice < 15)
+            return BELOW_NORMAL_PRIORITY_CLASS;
+        return IDLE_PRIORITY_CLASS;
+    }
+
+    double fileTimeSeconds(const FILETIME &time)
+    {
+        ULARGE_INTEGER value;
+        value.LowPart = time.dwLowDateTime;
+        value.HighPart = time.dwHighDateTime;
+        return value.QuadPart / 1e7; // Интервалы по 100 нс
+    }
+
+    // Дескриптор потомка (0/1/2) -> стандартный хэндл в STARTUPINFO
+    HANDLE *stdHandleSlot(STARTUPINFOA &si, int fd)
+    {
+        switch (fd)
+        {
+        case 0:
+            return &si.hStdInput;
+        case 1:
+            return &si.hStdOutput;
+        case 2:
+            return &si.hStdError;
+        default:
+            return nullptr;
+        }
+    }
+
+    HANDLE openInheritable(const FileAction &action)
+    {
+        SECURITY_ATTRIBUTES sa = {sizeof(sa), nullptr, TRUE};
+        int acc = action.flags & (O_RDONLY | O_WRONLY | O_RDWR);
+        DWORD access = acc == O_RDONLY ? GENERIC_READ : (acc == O_WRONLY ? GENERIC_WRITE : GENERIC_READ | GENERIC_WRITE);
+        if (action.flags & O_APPEND)
+            access = FILE_APPEND_DATA | SYNCHRONIZE;
+
+        DWORD disposition = OPEN_EXISTING;
+        if ((action.flags & O_CREAT) && (action.flags & O_TRUNC))
+            disposition = CREATE_ALWAYS;
+        else if (action.flags & O_CREAT)
+            disposition = OPEN_ALWAYS;
+        else if (action.flags & O_TRUNC)
+            disposition = TRUNCATE_EXISTING;
+
+        return CreateFileA(action.path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           &sa, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+}
+
+ProcessHandle BackgroundLauncher::launch(const vector<string> &args, const LaunchOptions &options)
 {
     string command_line;
     for (const auto &arg : args)
@@ -19,32 +152,112 @@ ProcessHandle BackgroundLauncher::launch(const vector<string> &args)
 
     PROCESS_INFORMATION pi;
     STARTUPINFOA si = {sizeof(si)};
+    vector<HANDLE> opened;
+
+    if (!options.file_actions.empty())
+    {
+        // На Windows поддерживаются только перенаправления стандартных потоков
+        si.dwFlags |= STARTF_USESTDHANDLES;
+        si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+        si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+        si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+        for (const auto &action : options.file_actions)
+        {
+            HANDLE *slot = stdHandleSlot(si, action.fd);
+            if (!slot)
+                continue;
+
+            if (action.type == FileAction::Type::Open)
+            {
+                HANDLE file = openInheritable(action);
+                if (file == INVALID_HANDLE_VALUE)
+                {
+                    for (HANDLE h : opened)
+                        CloseHandle(h);
+                    throw runtime_error("CreateFile failed: " + action.path);
+                }
+                opened.push_back(file);
+                *slot = file;
+            }
+            else if (action.type == FileAction::Type::Dup2)
+            {
+                HANDLE *source = stdHandleSlot(si, action.source_fd);
+                if (source)
+                    *slot = *source;
+            }
+            else
+            {
+                *slot = nullptr;
+            }
+        }
+    }
+
+    // Привязку и приоритет выставляем до первой инструкции потомка
+    DWORD flags = 0;
+    if (!options.cpu_affinity.empty())
+        flags |= CREATE_SUSPENDED;
+    if (options.set_nice)
+        flags |= priorityClass(options.nice);
 
-    if (!CreateProcessA(
-            nullptr,
-            command_line.data(),
-            nullptr,
-            nullptr,
-            FALSE,
-            0,
-            nullptr,
-            nullptr,
-            &si,
-            &pi))
+    BOOL created = CreateProcessA(
+        nullptr,
+        command_line.data(),
+        nullptr,
+        nullptr,
+        opened.empty() ? FALSE : TRUE,
+        flags,
+        nullptr,
+        nullptr,
+        &si,
+        &pi);
+
+    for (HANDLE h : opened)
+        CloseHandle(h);
+
+    if (!created)
     {
         throw runtime_error("CreateProcess failed");
     }
 
+    if (flags & CREATE_SUSPENDED)
+    {
+        DWORD_PTR mask = 0;
+        for (int cpu : options.cpu_affinity)
+            if (cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8))
+                mask |= DWORD_PTR(1) << cpu;
+        if (mask)
+            SetProcessAffinityMask(pi.hProcess, mask);
+        ResumeThread(pi.hThread);
+    }
+
     CloseHandle(pi.hThread);
     return pi.hProcess;
 }
 
-bool BackgroundLauncher::wait(ProcessHandle handle, int *exit_code)
+bool BackgroundLauncher::wait(ProcessHandle handle, int *exit_code, ResourceUsage *usage)
 {
     DWORD result = WaitForSingleObject(handle, INFINITE);
     if (result != WAIT_OBJECT_0)
         return false;
 
+    if (usage)
+    {
+        *usage = ResourceUsage();
+        FILETIME creation, exit, kernel, user;
+        if (GetProcessTimes(handle, &creation, &exit, &kernel, &user))
+        {
+            usage->user_time_s = fileTimeSeconds(user);
+            usage->system_time_s = fileTimeSeconds(kernel);
+        }
+        PROCESS_MEMORY_COUNTERS memory = {sizeof(memory)};
+        if (K32GetProcessMemoryInfo(handle, &memory, sizeof(memory)))
+        {
+            usage->max_rss_kb = static_cast<long>(memory.PeakWorkingSetSize / 1024);
+            usage->minor_faults = static_cast<long>(memory.PageFaultCount);
+        }
+    }
+
     if (exit_code)
     {
         DWORD code;
@@ -58,11 +271,311 @@ bool BackgroundLauncher::wait(ProcessHandle handle, int *exit_code)
 }
 
 #else
+#include "zygote.h"
 #include <unistd.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
+#include <cerrno>
+#include <sched.h>
 
-ProcessHandle BackgroundLauncher::launch(const vector<string> &args)
+extern char **environ;
+
+namespace
+{
+    const int PIPE_CAPTURE_SIZE = 1024 * 1024;
+
+    // Размещение потомка, подготовленное в родителе: в потомке только системные вызовы
+    struct Placement
+    {
+        const LaunchOptions *options;
+#ifdef __linux__
+        cpu_set_t cpus;
+#endif
+        int cgroup_fd = -1; // cgroup.procs целевой cgroup
+    };
+
+    void preparePlacement(Placement &placement, const LaunchOptions &options)
+    {
+        placement.options = &options;
+#ifdef __linux__
+        CPU_ZERO(&placement.cpus);
+        for (int cpu : options.cpu_affinity)
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &placement.cpus);
+#endif
+        if (!options.cgroup.empty())
+        {
+            string procs = options.cgroup + "/cgroup.procs";
+            placement.cgroup_fd = ::open(procs.c_str(), O_WRONLY | O_CLOEXEC);
+            if (placement.cgroup_fd == -1)
+                throw runtime_error("cannot open " + procs + ": " + strerror(errno));
+        }
+    }
+
+    // Выполняется в потомке до exec; возвращает errno
+    int applyPlacement(const Placement &placement)
+    {
+        const LaunchOptions &options = *placement.options;
+
+        if (placement.cgroup_fd != -1)
+        {
+            // Свой pid в cgroup.procs, без snprintf
+            char buffer[16];
+            char *end = buffer + sizeof(buffer);
+            char *p = end;
+            for (pid_t pid = getpid(); pid > 0; pid /= 10)
+                *--p = static_cast<char>('0' + pid % 10);
+            if (::write(placement.cgroup_fd, p, end - p) == -1)
+                return errno;
+        }
+#ifdef __linux__
+        if (!options.cpu_affinity.empty() && sched_setaffinity(0, sizeof(placement.cpus), &placement.cpus) == -1)
+            return errno;
+#endif
+        if (options.sched_policy != -1)
+        {
+            struct sched_param param = {};
+            param.sched_priority = options.sched_priority;
+            if (sched_setscheduler(0, options.sched_policy, &param) == -1)
+                return errno;
+        }
+        if (options.set_nice && setpriority(PRIO_PROCESS, 0, options.nice) == -1)
+            return errno;
+        for (const auto &limit : options.rlimits)
+        {
+            struct rlimit value;
+            value.rlim_cur = static_cast<rlim_t>(limit.soft);
+            value.rlim_max = static_cast<rlim_t>(limit.hard);
+            if (setrlimit(limit.resource, &value) == -1)
+                return errno;
+        }
+        return 0;
+    }
+
+    // Выполняется в потомке между fork/clone и exec:
+    // только async-signal-safe вызовы, без выделения памяти
+    int applyFileActions(const vector<FileAction> &actions)
+    {
+        for (const auto &action : actions)
+        {
+            switch (action.type)
+            {
+            case FileAction::Type::Open:
+            {
+                int fd = ::open(action.path.c_str(), action.flags, action.mode);
+                if (fd == -1)
+                    return errno;
+                if (fd != action.fd)
+                {
+                    if (::dup2(fd, action.fd) == -1)
+                        return errno;
+                    ::close(fd);
+                }
+                break;
+            }
+            case FileAction::Type::Dup2:
+                if (::dup2(action.source_fd, action.fd) == -1)
+                    return errno;
+                break;
+            case FileAction::Type::Close:
+                ::close(action.fd);
+                break;
+            }
+        }
+        return 0;
+    }
+
+    // Канал, через который потомок сообщает errno неудачного exec. Пишущий конец
+    // уносим выше всех дескрипторов из file_actions, чтобы они его не затёрли
+    bool openErrorPipe(int fds[2], const vector<FileAction> &actions)
+    {
+        if (pipe2(fds, O_CLOEXEC) == -1)
+            return false;
+        int max_fd = 2;
+        for (const auto &action : actions)
+            max_fd = max(max_fd, max(action.fd, action.source_fd));
+        if (fds[1] <= max_fd)
+        {
+            int moved = fcntl(fds[1], F_DUPFD_CLOEXEC, max_fd + 1);
+            ::close(fds[1]);
+            fds[1] = moved;
+            if (moved == -1)
+            {
+                ::close(fds[0]);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ProcessHandle launchFork(char **argv, const LaunchOptions &options, const Placement &placement)
+    {
+        int error_pipe[2];
+        if (!openErrorPipe(error_pipe, options.file_actions))
+            throw runtime_error("pipe2 failed");
+
+        pid_t pid = fork(); // Делаем дочерний процесс
+        if (pid == -1)
+        {
+            ::close(error_pipe[0]);
+            ::close(error_pipe[1]);
+            throw runtime_error("fork failed");
+        }
+
+        if (pid == 0)
+        {
+            // Сам дочерний процесс
+            int err = applyPlacement(placement);
+            if (err == 0)
+                err = applyFileActions(options.file_actions);
+            if (err == 0)
+            {
+                execvp(argv[0], argv);
+                err = errno;
+            }
+            ssize_t written = ::write(error_pipe[1], &err, sizeof(err));
+            (void)written;
+            _exit(127);
+        }
+
+        // При успешном exec канал закрывается без данных
+        ::close(error_pipe[1]);
+        int err = 0;
+        ssize_t got;
+        while ((got = ::read(error_pipe[0], &err, sizeof(err))) == -1 && errno == EINTR)
+        {
+        }
+        ::close(error_pipe[0]);
+        if (got == sizeof(err))
+        {
+            waitpid(pid, nullptr, 0);
+            throw runtime_error(string("child setup failed: ") + strerror(err));
+        }
+
+        return pid;
+    }
+
+    ProcessHandle launchPosixSpawn(char **argv, const LaunchOptions &options)
+    {
+        posix_spawn_file_actions_t actions;
+        int err = posix_spawn_file_actions_init(&actions);
+        if (err != 0)
+            throw runtime_error(string("posix_spawn_file_actions_init failed: ") + strerror(err));
+        for (const auto &action : options.file_actions)
+        {
+            switch (action.type)
+            {
+            case FileAction::Type::Open:
+                err = posix_spawn_file_actions_addopen(&actions, action.fd, action.path.c_str(), action.flags, action.mode);
+                break;
+            case FileAction::Type::Dup2:
+                err = posix_spawn_file_actions_adddup2(&actions, action.source_fd, action.fd);
+                break;
+            case FileAction::Type::Close:
+                err = posix_spawn_file_actions_addclose(&actions, action.fd);
+                break;
+            }
+            if (err != 0)
+            {
+                posix_spawn_file_actions_destroy(&actions);
+                throw runtime_error(string("posix_spawn file action failed: ") + strerror(err));
+            }
+        }
+
+        pid_t pid;
+        err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        if (err != 0)
+            throw runtime_error(string("posix_spawn failed: ") + strerror(err));
+
+        return pid;
+    }
+
+#ifdef __linux__
+    const size_t VFORK_STACK_SIZE = 64 * 1024;
+
+    struct VForkContext
+    {
+        char **argv;
+        const LaunchOptions *options;
+        const Placement *placement;
+        sigset_t parent_mask;
+        int error; // Память общая (CLONE_VM): потомок пишет сюда errno
+    };
+
+    int vforkChild(void *arg)
+    {
+        auto *ctx = static_cast<VForkContext *>(arg);
+
+        // Обработчики родителя в потомке не нужны: сбрасываем до exec
+        for (int sig = 1; sig < NSIG; ++sig)
+        {
+            struct sigaction action;
+            if (sigaction(sig, nullptr, &action) == 0 && action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN)
+            {
+                action.sa_handler = SIG_DFL;
+                action.sa_flags = 0;
+                sigaction(sig, &action, nullptr);
+            }
+        }
+        sigprocmask(SIG_SETMASK, &ctx->parent_mask, nullptr);
+
+        int err = applyPlacement(*ctx->placement);
+        if (err == 0)
+            err = applyFileActions(ctx->options->file_actions);
+        if (err == 0)
+        {
+            execvp(ctx->argv[0], ctx->argv);
+            err = errno;
+        }
+        ctx->error = err;
+        _exit(127);
+    }
+
+    ProcessHandle launchVFork(char **argv, const LaunchOptions &options, const Placement &placement)
+    {
+        void *stack = mmap(nullptr, VFORK_STACK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (stack == MAP_FAILED)
+            throw runtime_error("mmap failed");
+
+        VForkContext ctx{argv, &options, &placement, {}, 0};
+
+        // Пока потомок делит с нами память, сигналы родителя не должны в нём срабатывать
+        sigset_t all;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &ctx.parent_mask);
+
+        // Родитель стоит до exec/_exit потомка (CLONE_VFORK)
+        pid_t pid = clone(vforkChild, static_cast<char *>(stack) + VFORK_STACK_SIZE,
+                          CLONE_VM | CLONE_VFORK | SIGCHLD, &ctx);
+        int clone_errno = errno;
+
+        pthread_sigmask(SIG_SETMASK, &ctx.parent_mask, nullptr);
+        munmap(stack, VFORK_STACK_SIZE);
+
+        if (pid == -1)
+            throw runtime_error(string("clone failed: ") + strerror(clone_errno));
+
+        if (ctx.error != 0)
+        {
+            waitpid(pid, nullptr, 0);
+            throw runtime_error(string("child setup failed: ") + strerror(ctx.error));
+        }
+
+        return pid;
+    }
+#endif
+}
+
+ProcessHandle BackgroundLauncher::launch(const vector<string> &args, const LaunchOptions &options)
 {
+    if (args.empty())
+        throw runtime_error("empty command");
+
     vector<char *> argv;
     for (const auto &arg : args)
     {
@@ -70,26 +583,128 @@ ProcessHandle BackgroundLauncher::launch(const vector<string> &args)
     }
     argv.push_back(nullptr);
 
-    pid_t pid = fork(); // Делаем дочерний процесс
-    if (pid == -1)
-        throw runtime_error("fork failed");
+    LaunchBackend backend = options.backend == LaunchBackend::Default ? defaultBackend() : options.backend;
+    if (backend == LaunchBackend::Zygote)
+    {
+        if (Zygote::running())
+        {
+            // Потомок зиготы не делает exec: перенаправления ему не передаются
+            if (!options.file_actions.empty())
+                throw runtime_error("file actions are not supported by zygote backend");
+            return Zygote::spawn(args);
+        }
+        backend = LaunchBackend::PosixSpawn;
+    }
+
+    if (!options.hasPlacement() && backend == LaunchBackend::PosixSpawn)
+        return launchPosixSpawn(argv.data(), options);
+
+    Placement placement;
+    preparePlacement(placement, options);
+    ProcessHandle pid;
+    try
+    {
+#ifdef __linux__
+        if (backend != LaunchBackend::Fork)
+            pid = launchVFork(argv.data(), options, placement);
+        else
+#endif
+            pid = launchFork(argv.data(), options, placement);
+    }
+    catch (...)
+    {
+        if (placement.cgroup_fd != -1)
+            ::close(placement.cgroup_fd);
+        throw;
+    }
+
+    if (placement.cgroup_fd != -1)
+        ::close(placement.cgroup_fd);
+    return pid;
+}
+
+ProcessHandle BackgroundLauncher::launch(const vector<string> &args, const LaunchOptions &options, CapturedPipes &pipes)
+{
+    LaunchOptions child_options = options;
+    int child_ends[2] = {-1, -1};
+    int *parent_ends[2] = {&pipes.stdout_fd, &pipes.stderr_fd};
+    bool capture[2] = {options.capture_stdout, options.capture_stderr};
+
+    auto close_all = [&]()
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            if (child_ends[i] != -1)
+                ::close(child_ends[i]);
+            if (*parent_ends[i] != -1)
+                ::close(*parent_ends[i]);
+            child_ends[i] = *parent_ends[i] = -1;
+        }
+    };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        *parent_ends[i] = -1;
+        if (!capture[i])
+            continue;
+
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1)
+        {
+            close_all();
+            throw runtime_error("pipe2 failed");
+        }
+        *parent_ends[i] = fds[0];
+        child_ends[i] = fds[1];
+#ifdef F_SETPIPE_SZ
+        // Больший буфер - реже просыпаемся и реже упираемся в полный канал
+        fcntl(fds[0], F_SETPIPE_SZ, PIPE_CAPTURE_SIZE);
+#endif
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        // dup2 снимает O_CLOEXEC с целевого дескриптора, исходный закроется при exec
+        child_options.file_actions.push_back(FileAction::dup2(fds[1], i + 1));
+    }
 
-    if (pid == 0)
+    ProcessHandle pid;
+    try
+    {
+        pid = launch(args, child_options);
+    }
+    catch (...)
     {
-        // Сам дочерний процесс
-        execvp(argv[0], argv.data());
-        exit(EXIT_FAILURE);
+        close_all();
+        throw;
     }
 
+    for (int fd : child_ends)
+        if (fd != -1)
+            ::close(fd);
     return pid;
 }
 
-bool BackgroundLauncher::wait(ProcessHandle handle, int *exit_code)
+ResourceUsage ResourceUsage::fromRusage(const struct rusage &usage)
+{
+    ResourceUsage result;
+    result.max_rss_kb = usage.ru_maxrss; // В Linux - килобайты
+    result.user_time_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    result.system_time_s = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result.voluntary_switches = usage.ru_nvcsw;
+    result.involuntary_switches = usage.ru_nivcsw;
+    result.minor_faults = usage.ru_minflt;
+    result.major_faults = usage.ru_majflt;
+    return result;
+}
+
+bool BackgroundLauncher::wait(ProcessHandle handle, int *exit_code, ResourceUsage *usage)
 {
     int status;
-    if (waitpid(handle, &status, 0) == -1)
+    struct rusage rusage;
+    if (wait4(handle, &status, 0, &rusage) == -1)
         return false;
 
+    if (usage)
+        *usage = ResourceUsage::fromRusage(rusage);
+
     if (exit_code)
     {
         if (WIFEXITED(status)) // Завершился ли нормально или произошла авария
@@ -99,4 +714,4 @@ bool BackgroundLauncher::wait(ProcessHandle handle, int *exit_code)
     }
     return true;
 }
-#endif
\ No newline at end of file
+#endif
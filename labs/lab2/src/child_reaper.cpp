@@ -0,0 +1,172 @@
+#include "child_reaper.h"
+#include <chrono>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+using namespace std;
+
+namespace
+{
+    const int MAX_EVENTS = 64;
+
+    int remainingMs(chrono::steady_clock::time_point deadline)
+    {
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        return left > 0 ? static_cast<int>(left) : 0;
+    }
+}
+
+ChildReaper::ChildReaper()
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1)
+        throw runtime_error("epoll_create1 failed");
+}
+
+ChildReaper::~ChildReaper()
+{
+    for (auto &child : children_)
+        close(child.second.pidfd);
+    close(epoll_fd_);
+}
+
+bool ChildReaper::add(ProcessHandle pid, Callback callback)
+{
+    lock_guard<mutex> lock(mutex_);
+    // Повторная регистрация потеряла бы pidfd и колбэк первой
+    if (children_.count(pid) != 0)
+        return false;
+
+    int pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd == -1)
+        return false;
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = static_cast<uint64_t>(pid);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pidfd, &event) == -1)
+    {
+        close(pidfd);
+        return false;
+    }
+    children_[pid] = Entry{pidfd, move(callback)};
+    return true;
+}
+
+bool ChildReaper::reap(ProcessHandle pid, ChildExit &result)
+{
+    int status;
+    pid_t ret = wait4(pid, &status, WNOHANG, &result.usage);
+    if (ret == 0)
+        return false; // pidfd готов, но потомок ещё не стал зомби
+
+    result.pid = pid;
+    if (ret == pid)
+    {
+        result.exited = WIFEXITED(status);
+        result.exit_code = result.exited ? WEXITSTATUS(status) : 0;
+        result.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    }
+    // ret == -1: потомка уже собрал кто-то другой, статус неизвестен
+    return true;
+}
+
+size_t ChildReaper::poll(int timeout_ms)
+{
+    epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout_ms);
+    if (count <= 0)
+        return 0;
+
+    vector<pair<ChildExit, Callback>> finished;
+    size_t reaped = 0;
+    {
+        lock_guard<mutex> lock(mutex_);
+        for (int i = 0; i < count; ++i)
+        {
+            auto pid = static_cast<ProcessHandle>(events[i].data.u64);
+            auto it = children_.find(pid);
+            if (it == children_.end())
+                continue;
+
+            ChildExit result;
+            if (!reap(pid, result))
+                continue;
+
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.pidfd, nullptr);
+            close(it->second.pidfd);
+            reaped++;
+            if (it->second.callback)
+                finished.emplace_back(result, move(it->second.callback));
+            else
+                completed_.push_back(result);
+            children_.erase(it);
+        }
+    }
+
+    // Колбэки вызываются без блокировки: из них можно добавлять новых потомков
+    for (auto &item : finished)
+        item.second(item.first);
+
+    // И доставленные колбэкам, и оставленные в очереди для waitAny/waitAll
+    return reaped;
+}
+
+bool ChildReaper::waitAny(ChildExit &result, int timeout_ms)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (!completed_.empty())
+            {
+                result = completed_.front();
+                completed_.pop_front();
+                return true;
+            }
+            if (children_.empty())
+                return false;
+        }
+
+        int wait_ms = timeout_ms < 0 ? -1 : remainingMs(deadline);
+        poll(wait_ms);
+        if (timeout_ms >= 0 && chrono::steady_clock::now() >= deadline)
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (completed_.empty())
+                return false;
+        }
+    }
+}
+
+bool ChildReaper::waitAll(vector<ChildExit> &results, int timeout_ms)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    while (pending() > 0)
+    {
+        int wait_ms = timeout_ms < 0 ? -1 : remainingMs(deadline);
+        poll(wait_ms);
+        if (timeout_ms >= 0 && chrono::steady_clock::now() >= deadline)
+            break;
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    results.insert(results.end(), completed_.begin(), completed_.end());
+    completed_.clear();
+    return children_.empty();
+}
+
+size_t ChildReaper::pending() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return children_.size();
+}
@@ -0,0 +1,298 @@
+#include "job_executor.h"
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <signal.h>
+
+using namespace std;
+
+namespace
+{
+    double seconds(chrono::steady_clock::duration d)
+    {
+        return chrono::duration<double>(d).count();
+    }
+
+    double cpuSeconds(const struct rusage &usage)
+    {
+        ResourceUsage result = ResourceUsage::fromRusage(usage);
+        return result.user_time_s + result.system_time_s;
+    }
+}
+
+void ExecutorReport::print(ostream &out) const
+{
+    out << fixed << setprecision(3)
+        << "Jobs: " << succeeded << " succeeded, " << failed << " failed, "
+        << skipped << " skipped, " << retries << " retries" << endl
+        << "Elapsed: " << elapsed_s << " s, throughput: " << throughput << " jobs/s" << endl
+        << "Queue wait: mean " << mean_queue_wait_s << " s, max " << max_queue_wait_s << " s" << endl
+        << "Wall per job: mean " << mean_wall_s << " s, CPU total: " << total_cpu_s << " s" << endl;
+}
+
+JobExecutor::JobExecutor(size_t max_parallel)
+    : max_parallel_(max(max_parallel, size_t(1)))
+{
+}
+
+size_t JobExecutor::add(JobSpec job)
+{
+    size_t id = jobs_.size();
+    jobs_.push_back(move(job));
+    results_.emplace_back();
+    dependents_.emplace_back();
+    return id;
+}
+
+void JobExecutor::addDependency(size_t job, size_t depends_on)
+{
+    jobs_.at(job).depends_on.push_back(depends_on);
+}
+
+void JobExecutor::checkAcyclic() const
+{
+    // Алгоритм Кана: если обошли не все вершины - есть цикл
+    vector<size_t> indegree(jobs_.size());
+    for (size_t i = 0; i < jobs_.size(); ++i)
+        indegree[i] = jobs_[i].depends_on.size();
+
+    deque<size_t> queue;
+    for (size_t i = 0; i < jobs_.size(); ++i)
+        if (indegree[i] == 0)
+            queue.push_back(i);
+
+    size_t visited = 0;
+    while (!queue.empty())
+    {
+        size_t job = queue.front();
+        queue.pop_front();
+        ++visited;
+        for (size_t next : dependents_[job])
+            if (--indegree[next] == 0)
+                queue.push_back(next);
+    }
+
+    if (visited != jobs_.size())
+        throw runtime_error("job dependencies contain a cycle");
+}
+
+void JobExecutor::skipDependents(size_t job)
+{
+    for (size_t next : dependents_[job])
+    {
+        if (results_[next].state == JobState::Pending)
+        {
+            results_[next].state = JobState::Skipped;
+            skipDependents(next);
+        }
+    }
+}
+
+ExecutorReport JobExecutor::run()
+{
+    for (auto &deps : dependents_)
+        deps.clear();
+    for (size_t i = 0; i < jobs_.size(); ++i)
+    {
+        for (size_t dep : jobs_[i].depends_on)
+        {
+            if (dep >= jobs_.size())
+                throw out_of_range("unknown job dependency");
+            dependents_[dep].push_back(i);
+        }
+    }
+    checkAcyclic();
+
+    ChildReaper reaper;
+    vector<size_t> waiting(jobs_.size());
+    vector<Clock::time_point> ready_since(jobs_.size());
+    deque<size_t> ready;
+    priority_queue<Retry, vector<Retry>, greater<Retry>> retries;
+    unordered_map<ProcessHandle, Running> running;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < jobs_.size(); ++i)
+    {
+        results_[i] = JobResult();
+        waiting[i] = jobs_[i].depends_on.size();
+        if (waiting[i] == 0)
+        {
+            results_[i].state = JobState::Ready;
+            ready_since[i] = start;
+            ready.push_back(i);
+        }
+    }
+
+    ExecutorReport report;
+
+    // Неудачная попытка: повтор с экспоненциальной задержкой или окончательный провал
+    auto fail = [&](size_t job)
+    {
+        JobResult &result = results_[job];
+        if (result.attempts <= jobs_[job].max_retries)
+        {
+            auto delay = jobs_[job].retry_delay * (1 << min(result.attempts - 1, 16));
+            result.state = JobState::Ready;
+            retries.push({Clock::now() + delay, job});
+            ++report.retries;
+        }
+        else
+        {
+            result.state = JobState::Failed;
+            skipDependents(job);
+        }
+    };
+
+    while (!ready.empty() || !retries.empty() || !running.empty())
+    {
+        auto now = Clock::now();
+        while (!retries.empty() && retries.top().when <= now)
+        {
+            ready.push_back(retries.top().job);
+            retries.pop();
+        }
+
+        while (running.size() < max_parallel_ && !ready.empty())
+        {
+            size_t job = ready.front();
+            ready.pop_front();
+            JobResult &result = results_[job];
+            if (result.attempts == 0)
+                result.queue_wait_s = seconds(now - ready_since[job]);
+            ++result.attempts;
+            result.timed_out = false;
+
+            ProcessHandle pid;
+            try
+            {
+                pid = BackgroundLauncher::launch(jobs_[job].args, jobs_[job].options);
+            }
+            catch (const exception &)
+            {
+                fail(job);
+                continue;
+            }
+
+            auto deadline = jobs_[job].timeout.count() > 0 ? now + jobs_[job].timeout : Clock::time_point::max();
+            result.state = JobState::Running;
+            running[pid] = Running{job, now, deadline, false};
+            if (!reaper.add(pid))
+            {
+                // Без reaper'а не дождаться ни одного задания: останавливаем все
+                // запущенные (включая этот) и собираем их, чтобы не оставить зомби
+                for (auto &item : running)
+                    kill(item.first, SIGKILL);
+                for (auto &item : running)
+                {
+                    BackgroundLauncher::wait(item.first);
+                    results_[item.second.job].state = JobState::Failed;
+                }
+                throw runtime_error("pidfd_open failed");
+            }
+        }
+
+        // Ждём до ближайшего события: завершения потомка, таймаута или повтора
+        auto next_event = Clock::time_point::max();
+        for (const auto &item : running)
+            if (!item.second.killed)
+                next_event = min(next_event, item.second.deadline);
+        if (!retries.empty())
+            next_event = min(next_event, retries.top().when);
+
+        int timeout_ms = -1;
+        if (next_event != Clock::time_point::max())
+        {
+            auto left = chrono::duration_cast<chrono::milliseconds>(next_event - Clock::now()).count() + 1;
+            timeout_ms = static_cast<int>(max<long long>(left, 0));
+        }
+
+        ChildExit exit;
+        if (!running.empty() && reaper.waitAny(exit, timeout_ms))
+        {
+            auto it = running.find(exit.pid);
+            if (it == running.end())
+                continue;
+
+            size_t job = it->second.job;
+            JobResult &result = results_[job];
+            result.wall_s = seconds(Clock::now() - it->second.started);
+            result.cpu_s += cpuSeconds(exit.usage);
+            result.exit_code = exit.exit_code;
+            result.signal = exit.signal;
+            result.timed_out = it->second.killed;
+            running.erase(it);
+
+            if (exit.exited && exit.exit_code == 0 && !result.timed_out)
+            {
+                result.state = JobState::Succeeded;
+                auto done = Clock::now();
+                for (size_t next : dependents_[job])
+                {
+                    if (--waiting[next] == 0 && results_[next].state == JobState::Pending)
+                    {
+                        results_[next].state = JobState::Ready;
+                        ready_since[next] = done;
+                        ready.push_back(next);
+                    }
+                }
+            }
+            else
+            {
+                fail(job);
+            }
+        }
+        else if (running.empty() && ready.empty() && !retries.empty())
+        {
+            // Работающих нет, ждём ближайший повтор
+            this_thread::sleep_until(retries.top().when);
+        }
+
+        // Просроченные задания убиваем, результат придёт через reaper
+        now = Clock::now();
+        for (auto &item : running)
+        {
+            if (!item.second.killed && item.second.deadline <= now)
+            {
+                kill(item.first, SIGKILL);
+                item.second.killed = true;
+            }
+        }
+    }
+
+    report.elapsed_s = seconds(Clock::now() - start);
+    size_t launched = 0;
+    for (const auto &result : results_)
+    {
+        switch (result.state)
+        {
+        case JobState::Succeeded:
+            ++report.succeeded;
+            break;
+        case JobState::Failed:
+            ++report.failed;
+            break;
+        default:
+            ++report.skipped;
+            break;
+        }
+        if (result.attempts == 0)
+            continue;
+        ++launched;
+        report.mean_queue_wait_s += result.queue_wait_s;
+        report.max_queue_wait_s = max(report.max_queue_wait_s, result.queue_wait_s);
+        report.mean_wall_s += result.wall_s;
+        report.total_cpu_s += result.cpu_s;
+    }
+    if (launched > 0)
+    {
+        report.mean_queue_wait_s /= launched;
+        report.mean_wall_s /= launched;
+    }
+    if (report.elapsed_s > 0)
+        report.throughput = (report.succeeded + report.failed) / report.elapsed_s;
+    return report;
+}
@@ -0,0 +1,413 @@
+#include "output_capture.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+namespace
+{
+    const int MAX_EVENTS = 64;
+    const size_t SPLICE_CHUNK = 1024 * 1024;
+    const size_t COPY_CHUNK = 64 * 1024;
+    const size_t BACKLOG_SIZE = 1024 * 1024; // Как канал потомка
+
+    // Записать сколько примет приёмник; -1 - ошибка
+    ssize_t writeSome(int fd, const char *data, size_t len)
+    {
+        size_t written = 0;
+        while (written < len)
+        {
+            ssize_t n = write(fd, data + written, len - written);
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN)
+                    break;
+                return -1;
+            }
+            written += n;
+        }
+        return static_cast<ssize_t>(written);
+    }
+}
+
+ByteRing::ByteRing(size_t capacity)
+    : data_(max(capacity, size_t(1)))
+{
+}
+
+string ByteRing::str() const
+{
+    string result;
+    result.reserve(size_);
+    size_t start = (head_ + data_.size() - size_) % data_.size();
+    size_t first = min(size_, data_.size() - start);
+    result.append(data_.data() + start, first);
+    result.append(data_.data(), size_ - first);
+    return result;
+}
+
+void ByteRing::clear()
+{
+    head_ = size_ = dropped_ = 0;
+}
+
+long ByteRing::readFrom(int fd)
+{
+    // Пишем с head_ по кругу на всю ёмкость: старые данные затираются
+    iovec iov[2];
+    size_t cap = data_.size();
+    iov[0].iov_base = data_.data() + head_;
+    iov[0].iov_len = cap - head_;
+    iov[1].iov_base = data_.data();
+    iov[1].iov_len = head_;
+
+    ssize_t n = readv(fd, iov, head_ == 0 ? 1 : 2);
+    if (n <= 0)
+        return n;
+
+    size_t total = size_ + n;
+    if (total > cap)
+    {
+        dropped_ += total - cap;
+        total = cap;
+    }
+    size_ = total;
+    head_ = (head_ + n) % cap;
+    return n;
+}
+
+long ByteRing::fillFrom(int fd)
+{
+    size_t cap = data_.size();
+    size_t free = space();
+    size_t first = min(free, cap - head_);
+    iovec iov[2];
+    iov[0].iov_base = data_.data() + head_;
+    iov[0].iov_len = first;
+    iov[1].iov_base = data_.data();
+    iov[1].iov_len = free - first;
+
+    ssize_t n = readv(fd, iov, free > first ? 2 : 1);
+    if (n <= 0)
+        return n;
+    size_ += n;
+    head_ = (head_ + n) % cap;
+    return n;
+}
+
+bool ByteRing::append(const char *data, size_t len)
+{
+    if (len > space())
+        return false;
+    size_t cap = data_.size();
+    size_t first = min(len, cap - head_);
+    copy(data, data + first, data_.begin() + head_);
+    copy(data + first, data + len, data_.begin());
+    size_ += len;
+    head_ = (head_ + len) % cap;
+    return true;
+}
+
+long ByteRing::writeTo(int fd)
+{
+    size_t cap = data_.size();
+    size_t start = (head_ + cap - size_) % cap;
+    size_t first = min(size_, cap - start);
+    iovec iov[2];
+    iov[0].iov_base = data_.data() + start;
+    iov[0].iov_len = first;
+    iov[1].iov_base = data_.data();
+    iov[1].iov_len = size_ - first;
+
+    ssize_t n = writev(fd, iov, size_ > first ? 2 : 1);
+    if (n > 0)
+        size_ -= n;
+    return n;
+}
+
+OutputCapture::OutputCapture()
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1)
+        throw runtime_error("epoll_create1 failed");
+}
+
+OutputCapture::~OutputCapture()
+{
+    for (auto &stream : streams_)
+        close(stream.first);
+    close(epoll_fd_);
+}
+
+bool OutputCapture::add(int pipe_fd, int dest_fd)
+{
+    return addStream(pipe_fd, Stream{dest_fd, nullptr, true, nullptr});
+}
+
+bool OutputCapture::add(int pipe_fd, ByteRing *ring)
+{
+    return addStream(pipe_fd, Stream{-1, ring, false, nullptr});
+}
+
+bool OutputCapture::addStream(int pipe_fd, Stream stream)
+{
+    fcntl(pipe_fd, F_SETFL, fcntl(pipe_fd, F_GETFL) | O_NONBLOCK);
+
+    stream.paused = true;
+    if (!resume(pipe_fd, stream))
+        return false;
+    streams_[pipe_fd] = move(stream);
+    return true;
+}
+
+void OutputCapture::remove(int pipe_fd)
+{
+    auto it = streams_.find(pipe_fd);
+    if (it != streams_.end() && it->second.waiting)
+        stopWaiting(pipe_fd, it->second);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pipe_fd, nullptr);
+    close(pipe_fd);
+    streams_.erase(pipe_fd);
+}
+
+void OutputCapture::pause(int pipe_fd, Stream &stream)
+{
+    if (stream.paused)
+        return;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pipe_fd, nullptr);
+    stream.paused = true;
+}
+
+bool OutputCapture::resume(int pipe_fd, Stream &stream)
+{
+    if (!stream.paused)
+        return true;
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = pipe_fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pipe_fd, &event) == -1)
+        return false;
+    stream.paused = false;
+    return true;
+}
+
+bool OutputCapture::waitDest(int pipe_fd, Stream &stream)
+{
+    if (!stream.backlog)
+        stream.backlog.reset(new ByteRing(BACKLOG_SIZE));
+    if (stream.waiting)
+        return true;
+
+    // Один приёмник может быть у многих каналов: в epoll он один, с общим списком ждущих
+    vector<int> &pipes = waiters_[stream.dest_fd];
+    if (pipes.empty())
+    {
+        epoll_event event = {};
+        event.events = EPOLLOUT;
+        event.data.fd = stream.dest_fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stream.dest_fd, &event) == -1)
+        {
+            waiters_.erase(stream.dest_fd);
+            return false;
+        }
+    }
+    pipes.push_back(pipe_fd);
+    stream.waiting = true;
+    return true;
+}
+
+void OutputCapture::stopWaiting(int pipe_fd, Stream &stream)
+{
+    stream.waiting = false;
+    auto it = waiters_.find(stream.dest_fd);
+    if (it == waiters_.end())
+        return;
+    vector<int> &pipes = it->second;
+    pipes.erase(std::remove(pipes.begin(), pipes.end(), pipe_fd), pipes.end());
+    if (!pipes.empty())
+        return;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, stream.dest_fd, nullptr);
+    waiters_.erase(it);
+}
+
+OutputCapture::DrainResult OutputCapture::drain(int pipe_fd, Stream &stream, size_t &moved)
+{
+    // Выбираем канал до EAGAIN, чтобы потомок не стоял на полном канале
+    while (true)
+    {
+        ssize_t n;
+        if (stream.ring)
+        {
+            n = stream.ring->readFrom(pipe_fd);
+        }
+        else if (stream.waiting)
+        {
+            // Приёмник занят: копим в backlog, а когда он полон - перестаём читать этот канал.
+            // Остальные каналы обслуживаются дальше
+            if (stream.backlog->space() == 0)
+            {
+                pause(pipe_fd, stream);
+                return DrainResult::Open;
+            }
+            n = stream.backlog->fillFrom(pipe_fd);
+            if (n > 0)
+                continue;
+        }
+        else if (stream.use_splice)
+        {
+            n = splice(pipe_fd, nullptr, stream.dest_fd, nullptr, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n == -1 && errno == EINVAL)
+            {
+                // Приёмник не поддерживает splice (например, открыт с O_APPEND) - копируем
+                stream.use_splice = false;
+                continue;
+            }
+            if (n == -1 && errno == EAGAIN)
+            {
+                // EAGAIN бывает и от полного приёмника: тогда ждём его EPOLLOUT
+                int available = 0;
+                if (ioctl(pipe_fd, FIONREAD, &available) == 0 && available > 0)
+                {
+                    if (!waitDest(pipe_fd, stream))
+                        return DrainResult::Error;
+                    continue;
+                }
+            }
+            if (n > 0)
+                moved += n;
+        }
+        else
+        {
+            char buffer[COPY_CHUNK];
+            n = read(pipe_fd, buffer, sizeof(buffer));
+            if (n > 0)
+            {
+                ssize_t written = writeSome(stream.dest_fd, buffer, n);
+                if (written == -1)
+                    return DrainResult::Error;
+                moved += written;
+                // backlog пуст вне ожидания, а кусок меньше его ёмкости - остаток поместится
+                if (written < n && (!waitDest(pipe_fd, stream) || !stream.backlog->append(buffer + written, n - written)))
+                    return DrainResult::Error;
+            }
+        }
+
+        if (n > 0)
+            continue;
+        if (n == 0)
+            return DrainResult::Closed;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN)
+            return DrainResult::Open;
+        return DrainResult::Error;
+    }
+}
+
+size_t OutputCapture::poll(int timeout_ms)
+{
+    epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout_ms);
+
+    size_t moved = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        int fd = events[i].data.fd;
+        auto it = streams_.find(fd);
+        if (it != streams_.end())
+            settle(fd, drain(fd, it->second, moved));
+        else if (waiters_.count(fd) != 0)
+            flush(fd, moved);
+    }
+
+    transferred_ += moved;
+    return moved;
+}
+
+void OutputCapture::settle(int pipe_fd, DrainResult result)
+{
+    if (result == DrainResult::Open)
+        return;
+    auto it = streams_.find(pipe_fd);
+    if (result == DrainResult::Closed && it != streams_.end() && it->second.waiting)
+    {
+        // Канал закрыт, но приёмник ещё не принял backlog: fd держим до конца записи
+        it->second.eof = true;
+        pause(pipe_fd, it->second);
+        return;
+    }
+    remove(pipe_fd);
+}
+
+void OutputCapture::flush(int dest_fd, size_t &moved)
+{
+    // Список меняется по ходу: закончившие запись выходят из него
+    vector<int> pipes = waiters_[dest_fd];
+    for (int pipe_fd : pipes)
+    {
+        auto it = streams_.find(pipe_fd);
+        if (it == streams_.end())
+            continue;
+        Stream &stream = it->second;
+
+        bool failed = false;
+        while (stream.backlog->size() > 0)
+        {
+            long n = stream.backlog->writeTo(dest_fd);
+            if (n > 0)
+            {
+                moved += n;
+                continue;
+            }
+            if (n == -1 && errno == EINTR)
+                continue;
+            failed = n == -1 && errno != EAGAIN;
+            break;
+        }
+
+        if (failed)
+        {
+            remove(pipe_fd);
+            continue;
+        }
+        if (stream.backlog->size() == 0)
+        {
+            // Всё дописано - дальше снова напрямую
+            stopWaiting(pipe_fd, stream);
+            if (stream.eof)
+            {
+                remove(pipe_fd);
+                continue;
+            }
+        }
+        if (!stream.eof && !resume(pipe_fd, stream))
+            remove(pipe_fd);
+    }
+}
+
+bool OutputCapture::drainAll(int timeout_ms)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    while (!streams_.empty())
+    {
+        int wait_ms = -1;
+        if (timeout_ms >= 0)
+        {
+            auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            if (left <= 0)
+                return false;
+            wait_ms = static_cast<int>(left);
+        }
+        poll(wait_ms);
+    }
+    return true;
+}
@@ -0,0 +1,193 @@
+#include "zygote.h"
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+namespace
+{
+    const size_t MAX_REQUEST = 64 * 1024;
+
+    mutex zygote_mutex;
+    int zygote_socket = -1;
+    pid_t zygote_pid = 0;
+
+    // Запрос: аргументы через '\0'
+    vector<string> parseRequest(const char *data, size_t len)
+    {
+        vector<string> args;
+        size_t start = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (data[i] == '\0')
+            {
+                args.emplace_back(data + start, i - start);
+                start = i + 1;
+            }
+        }
+        return args;
+    }
+
+    // Двойной fork: промежуточный процесс порождает потомка и сразу выходит, потомок
+    // переходит к ближайшему субриперу - процессу, запустившему шаблон. Настоящий fork()
+    // glibc, а не голый clone: в потомке обновлён TID и зарегистрирован robust_list,
+    // поэтому ядро помечает захваченные им robust-мьютексы EOWNERDEAD при его смерти
+    int32_t forkForCaller(int sock, ZygoteEntry entry, const vector<string> &args)
+    {
+        int fds[2];
+        if (pipe(fds) == -1)
+            return -errno;
+
+        pid_t middle = fork();
+        if (middle == -1)
+        {
+            int error = errno;
+            close(fds[0]);
+            close(fds[1]);
+            return -error;
+        }
+        if (middle == 0)
+        {
+            close(fds[0]);
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(fds[1]);
+                close(sock);
+                _exit(entry(args));
+            }
+            int32_t result = pid > 0 ? pid : -errno;
+            _exit(write(fds[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+        }
+
+        close(fds[1]);
+        int32_t result = -ECHILD;
+        ssize_t len;
+        do
+        {
+            len = read(fds[0], &result, sizeof(result));
+        } while (len == -1 && errno == EINTR);
+        close(fds[0]);
+        // После сбора промежуточного потомок уже переподчинён: вызывающий может его ждать
+        while (waitpid(middle, nullptr, 0) == -1 && errno == EINTR)
+            ;
+        return len == sizeof(result) ? result : -ECHILD;
+    }
+
+    [[noreturn]] void templateLoop(int sock, ZygoteEntry entry)
+    {
+        // Шаблон не должен пережить родителя
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() == 1)
+            _exit(0);
+
+        static char request[MAX_REQUEST];
+        while (true)
+        {
+            ssize_t len = recv(sock, request, sizeof(request), 0);
+            if (len == 0)
+                _exit(0); // Родитель закрыл сокет
+            if (len < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                _exit(1);
+            }
+
+            vector<string> args = parseRequest(request, len);
+            int32_t reply = forkForCaller(sock, entry, args);
+            send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+        }
+    }
+}
+
+bool Zygote::start(ZygoteEntry entry)
+{
+    lock_guard<mutex> lock(zygote_mutex);
+    if (zygote_socket != -1)
+        return true;
+
+    // Осиротевшие потомки шаблона переходят к нам, а не к init
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1)
+        return false;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1)
+        return false;
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        templateLoop(fds[1], entry);
+    }
+
+    close(fds[1]);
+    zygote_socket = fds[0];
+    zygote_pid = pid;
+    return true;
+}
+
+void Zygote::stop()
+{
+    lock_guard<mutex> lock(zygote_mutex);
+    if (zygote_socket == -1)
+        return;
+
+    close(zygote_socket);
+    waitpid(zygote_pid, nullptr, 0);
+    zygote_socket = -1;
+    zygote_pid = 0;
+}
+
+bool Zygote::running()
+{
+    lock_guard<mutex> lock(zygote_mutex);
+    return zygote_socket != -1;
+}
+
+ProcessHandle Zygote::spawn(const vector<string> &args)
+{
+    string request;
+    for (const auto &arg : args)
+    {
+        request += arg;
+        request += '\0';
+    }
+    if (request.size() > MAX_REQUEST)
+        throw runtime_error("zygote request too large");
+
+    lock_guard<mutex> lock(zygote_mutex);
+    if (zygote_socket == -1)
+        throw runtime_error("zygote is not running");
+
+    if (send(zygote_socket, request.data(), request.size(), MSG_NOSIGNAL) == -1)
+        throw runtime_error(string("zygote send failed: ") + strerror(errno));
+
+    int32_t reply;
+    ssize_t len;
+    do
+    {
+        len = recv(zygote_socket, &reply, sizeof(reply), 0);
+    } while (len == -1 && errno == EINTR);
+
+    if (len != sizeof(reply))
+        throw runtime_error("zygote is not responding");
+    if (reply < 0)
+        throw runtime_error(string("zygote fork failed: ") + strerror(-reply));
+    return reply;
+}
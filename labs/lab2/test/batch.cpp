@@ -0,0 +1,46 @@
+#include "job_executor.h"
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+// Читает по одной команде на строку из stdin и выполняет их,
+// не более <parallel> одновременно
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cout << "Usage: " << argv[0] << " <parallel> [timeout_ms] [retries] < commands.txt" << endl;
+        return 1;
+    }
+
+    JobExecutor executor(stoul(argv[1]));
+    string line;
+    while (getline(cin, line))
+    {
+        JobSpec job;
+        istringstream words(line);
+        string word;
+        while (words >> word)
+            job.args.push_back(word);
+        if (job.args.empty())
+            continue;
+        if (argc > 2)
+            job.timeout = chrono::milliseconds(stol(argv[2]));
+        if (argc > 3)
+            job.max_retries = stoi(argv[3]);
+        executor.add(move(job));
+    }
+
+    try
+    {
+        ExecutorReport report = executor.run();
+        report.print(cout);
+        return report.failed == 0 ? 0 : 1;
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
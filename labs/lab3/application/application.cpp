@@ -1,15 +1,95 @@
 #include "application.hpp"
 #include <iostream>
 #include <chrono>
+#include <cmath>
+#include <sstream>
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 using namespace std::chrono_literals;
 
 namespace cplib
 {
 
-    Application::Application(const std::string &shared_mem_name, const std::string &log_file)
-        : shared_data_(shared_mem_name), logger_(log_file), running_(false), is_master_(false),
-          is_slave_(false), new_slave_status(true)
+    namespace
+    {
+        // Процессы группы пишут в общее кольцо, в файл его переносит один из них
+        LoggerOptions sharedLogging()
+        {
+            LoggerOptions options;
+            options.mode = LogMode::Shared;
+            return options;
+        }
+
+        // Столько воркер живёт без мастера: на время смены мастера пул не распускается
+        const std::chrono::milliseconds WORKER_ORPHAN_TIMEOUT = std::chrono::milliseconds(3000);
+        const int PRIMES_TASKS_PER_WORKER = 4;
+
+        // Решето по отрезку [from, to)
+        long long countPrimes(long long from, long long to)
+        {
+            from = std::max(from, 2LL);
+            if (to <= from)
+            {
+                return 0;
+            }
+            long long root = static_cast<long long>(std::sqrt(static_cast<double>(to))) + 1;
+            std::vector<char> small(root + 1, 1);
+            std::vector<char> segment(to - from, 1);
+            for (long long p = 2; p <= root; ++p)
+            {
+                if (!small[p])
+                {
+                    continue;
+                }
+                for (long long q = p * p; q <= root; q += p)
+                {
+                    small[q] = 0;
+                }
+                for (long long q = std::max(p * p, (from + p - 1) / p * p); q < to; q += p)
+                {
+                    segment[q - from] = 0;
+                }
+            }
+            long long count = 0;
+            for (char prime : segment)
+            {
+                count += prime;
+            }
+            return count;
+        }
+
+        int64_t runTask(SharedDataManager &shared_data, const WorkerTask &task)
+        {
+            switch (static_cast<TaskKind>(task.kind))
+            {
+            case TaskKind::AddCounter:
+            {
+                int64_t value = shared_data.getCounter() + task.args[0];
+                shared_data.setCounter(value);
+                return value;
+            }
+            case TaskKind::DoubleHalve:
+            {
+                shared_data.setCounter(shared_data.getCounter() * 2);
+                std::this_thread::sleep_for(std::chrono::milliseconds(task.args[0]));
+                int64_t value = shared_data.getCounter() / 2;
+                shared_data.setCounter(value);
+                return value;
+            }
+            case TaskKind::CountPrimes:
+                return countPrimes(task.args[0], task.args[1]);
+            }
+            return 0;
+        }
+    }
+
+    Application::Application(const std::string &shared_mem_name, const std::string &log_file, const ApplicationConfig &config)
+        : config_(config), shared_data_(shared_mem_name, config.persist_file), logger_(log_file, sharedLogging()), pool_(shared_mem_name),
+          running_(false), is_master_(false), is_slave_(false), new_slave_status(true)
     {
 
         if (!shared_data_.isValid())
@@ -18,7 +98,24 @@ namespace cplib
             return;
         }
 
+        if (shared_data_.resumed())
+        {
+            logger_.log("Resumed shared state from " + config_.persist_file);
+        }
+
         shared_data_.registerConnection();
+        shared_data_.setLeaseDuration(lease_time);
+
+#if !defined(_WIN32)
+        // Без reaper_ копии собираются waitpid на каждом шаге управления
+        try
+        {
+            reaper_.reset(new ChildReaper());
+        }
+        catch (const std::exception &)
+        {
+        }
+#endif
 
         updateMasterStatus();
     }
@@ -26,6 +123,18 @@ namespace cplib
     Application::~Application()
     {
         running_ = false;
+        // Последний участник группы уходит - воркеры больше не нужны. Иначе их
+        // подхватит следующий мастер. Слоты упавших не должны сойти за живых
+        if (shared_data_.isValid() && pool_.isValid())
+        {
+            shared_data_.heartbeat();
+            shared_data_.reapMembers();
+            if (shared_data_.memberCount() <= 1)
+            {
+                pool_.shutdown();
+            }
+        }
+#if defined(_WIN32)
         if (counter_thread_.joinable())
         {
             counter_thread_.join();
@@ -38,10 +147,23 @@ namespace cplib
         {
             child_manager_thread_.join();
         }
-        if (input_thread_.joinable())
+        for (WorkerRestart &restart : restarts_)
         {
-            input_thread_.join();
+            if (restart.process != NULL)
+            {
+                CloseHandle(restart.process);
+            }
+        }
+#else
+        if (state_watcher_.joinable())
+        {
+            state_watcher_.join();
+        }
+        if (checkpoint_thread_.joinable())
+        {
+            checkpoint_thread_.join();
         }
+#endif
     }
 
     void Application::updateMasterStatus()
@@ -86,6 +208,9 @@ namespace cplib
 
         running_ = true;
 
+        std::cout << "Commands: 'show' (s), 'set <value>' (m <value>), 'primes <limit>' (p <limit>), 'exit' (e, q)" << std::endl;
+
+#if defined(_WIN32)
         // Запускаем таймер счетчика (все процессы)
         counter_thread_ = std::thread(&Application::counterTimerThread, this);
 
@@ -95,215 +220,743 @@ namespace cplib
         // Только мастер запускает управление дочерними процессами
         if (is_master_)
         {
-            child_manager_thread_ = std::thread(&Application::childManagerThread, this);
+            startChildManager();
         }
 
         // Запускаем обработку пользовательского ввода
         userInputThread();
+#else
+        if (!loop_.isValid())
+        {
+            std::cerr << "Failed to create event loop!" << std::endl;
+            running_ = false;
+            return;
+        }
+
+        // Все периоды - таймеры одного колеса: сроки плановые, сдвиг от длины шага не копится
+        loop_.addPeriodic(sleep_time, [this]
+                          { counterTick(); });
+        scheduleMasterCheck();
+        if (is_master_)
+        {
+            startChildManager();
+        }
+        if (!loop_.watch(STDIN_FILENO, [this]
+                         { readInput(); }))
+        {
+            // Обычный файл epoll не принимает, но чтение из него и не блокирует
+            loop_.post([this]
+                       { while (readInput())
+                         {
+                         } });
+        }
+        if (reaper_)
+        {
+            loop_.watch(reaper_->fd(), [this]
+                        { reaper_->poll(0); });
+        }
+        state_watcher_ = std::thread(&Application::stateWatcherThread, this);
+
+        std::cout << "> " << std::flush;
+        loop_.run();
+#endif
 
         running_ = false;
     }
 
-    void Application::counterTimerThread()
+    void Application::counterTick()
     {
-        while (running_)
-        {
-            std::this_thread::sleep_for(sleep_time);
-            shared_data_.incrementCounter();
+        shared_data_.incrementCounter();
+        shared_data_.heartbeat();
 
-            static auto timestamp = std::chrono::system_clock::now();
-            auto curr_timestamp = std::chrono::system_clock::now();
-            if (is_master_ && curr_timestamp - timestamp >= write_time)
-            {
-                logger_.logCounter(shared_data_.getCounter());
-                timestamp = curr_timestamp;
-            }
+        static auto timestamp = std::chrono::system_clock::now();
+        auto curr_timestamp = std::chrono::system_clock::now();
+        // Шаги идут точно по плану, поэтому допуск в полшага на дрожание пробуждения
+        if (is_master_ && curr_timestamp - timestamp + sleep_time / 2 >= write_time)
+        {
+            logger_.logCounter(shared_data_.getCounter());
+            timestamp = curr_timestamp;
         }
     }
 
-    void Application::masterCheckThread()
+    void Application::masterCheck()
     {
-        while (running_)
+        // Если мы не мастер, проверяем возможность стать им
+        if (!is_master_)
         {
-            std::this_thread::sleep_for(check_time);
-
-            // Если мы не мастер, проверяем возможность стать им
-            if (!is_master_)
+            updateMasterStatus();
+            // Если стали мастером, запускаем управление дочерними процессами
+            if (is_master_)
+            {
+                startChildManager();
+            }
+        }
+        else
+        {
+            // Если мы мастер, продлеваем аренду; не вышло - её перехватили
+            if (!shared_data_.renewLease())
             {
                 updateMasterStatus();
-                // Если стали мастером, запускаем управление дочерними процессами
-                if (is_master_ && !child_manager_thread_.joinable())
+                if (!is_master_)
                 {
-                    child_manager_thread_ = std::thread(&Application::childManagerThread, this);
+                    stopChildManager();
                 }
             }
-            else
+        }
+    }
+
+    void Application::childManagerTick()
+    {
+#if !defined(_WIN32)
+        // Собираем копии, не взятые под reaper_: их завершение видно только здесь.
+        // Только их: waitpid(-1) отнял бы у reaper_ его копии
+        for (auto it = unreaped_.begin(); it != unreaped_.end();)
+        {
+            if (waitpid(*it, nullptr, WNOHANG) == 0)
             {
-                // Если мы мастер, проверяем что мы все еще мастер
-                if (!shared_data_.checkMasterAlive())
-                {
-                    updateMasterStatus();
-                }
+                ++it;
+                continue;
             }
+            markWorkerExited(*it);
+            it = unreaped_.erase(it);
+        }
+
+        startCheckpoint();
+#else
+        // Контрольная точка общего состояния на диск; здесь это уже отдельный поток
+        if (shared_data_.isPersistent() && !shared_data_.checkpoint())
+        {
+            CPLIB_LOG_ERROR(logger_, "Checkpoint failed");
+        }
+#endif
+
+        // Освобождаем слоты участников, переставших отвечать
+        int reaped = shared_data_.reapMembers();
+        if (reaped > 0)
+        {
+            CPLIB_LOG_INFO(logger_, "Reaped {} dead member(s)", reaped);
         }
+
+        // Задачи, зависшие у живого воркера или потерянные прежним мастером
+        std::vector<uint64_t> expired;
+        if (pool_.isValid() && pool_.dropExpired(config_.task_timeout.count(), expired) > 0)
+        {
+            dropTasks(expired, "timed out");
+        }
+
+        submitDemoTasks();
+        maintainPool();
     }
 
-    void Application::childManagerThread()
+    int Application::targetWorkers()
     {
-        while (running_ && is_master_)
+        int workers = config_.workers > 0 ? config_.workers : static_cast<int>(std::thread::hardware_concurrency());
+        return std::max(1, std::min(workers, MAX_WORKERS));
+    }
+
+    std::chrono::milliseconds Application::restartDelay(int failures)
+    {
+        if (failures <= 0)
         {
-            std::this_thread::sleep_for(child_launch_interval);
+            return std::chrono::milliseconds(0);
+        }
+        auto delay = config_.restart_backoff_min * (1LL << std::min(failures - 1, 20));
+        return std::min<std::chrono::milliseconds>(config_.restart_backoff_max, delay);
+    }
 
-            // Проверяем, завершились ли предыдущие копии
-            int child1_pid = shared_data_.getChild1Pid();
-            int child2_pid = shared_data_.getChild2Pid();
+    void Application::maintainPool()
+    {
+        if (!is_master_ || !pool_.isValid())
+        {
+            return;
+        }
 
-            bool child1_running = (child1_pid != 0) && shared_data_.checkProcessAlive(child1_pid);
-            bool child2_running = (child2_pid != 0) && shared_data_.checkProcessAlive(child2_pid);
+        auto now = std::chrono::steady_clock::now();
+        auto next_wake = std::chrono::steady_clock::time_point::max();
+        int target = targetWorkers();
+        for (int slot = 0; slot < MAX_WORKERS; ++slot)
+        {
+            WorkerRestart &restart = restarts_[slot];
+            int pid = pool_.workerPid(slot);
+#if defined(_WIN32)
+            if (restart.process != NULL && WaitForSingleObject(restart.process, 0) == WAIT_OBJECT_0)
+            {
+                restart.exited = true;
+            }
+#endif
+            // Свой воркер - по уведомлению о завершении, запущенный прежним мастером - по
+            // heartbeat слота. kill(pid, 0) не годится: PID мог достаться другому процессу
+            bool alive = pid != 0 && (pid == restart.pid ? !restart.exited : pool_.workerAlive(slot));
+            if (pid != 0 && !alive)
+            {
+                // Умер, не освободив слот
+                pool_.setWorkerPid(slot, 0);
+                dropWorkerTasks(pid);
+            }
 
-            // Запускаем копии, если предыдущие завершились
-            if (!child1_running)
+            if (restart.pid != 0 && !(alive && pid == restart.pid))
             {
-                if (launchChildProcess(1))
+                if (restart.pid != pid)
                 {
-                    logger_.log("Launched child process 1");
+                    dropWorkerTasks(restart.pid);
                 }
-                else
+                // Наш воркер завершился. Упавший быстро - признак сбоя, задержка растёт
+                bool stable = now - restart.started >= config_.stable_run;
+                restart.failures = stable ? 0 : restart.failures + 1;
+                auto delay = restartDelay(restart.failures);
+                restart.next_launch = now + delay;
+                restart.pid = 0;
+                restart.exited = false;
+#if defined(_WIN32)
+                CloseHandle(restart.process);
+                restart.process = NULL;
+#endif
+                if (slot < target)
                 {
-                    logger_.log("Failed to launch child process 1");
+                    CPLIB_LOG_WARNING(logger_, "Worker in slot {} exited, restart in {} ms", slot, static_cast<long long>(delay.count()));
                 }
             }
-            else
+
+            if (slot >= target || alive)
             {
-                logger_.log("Child process 1 is still running, skipping launch");
+                continue;
+            }
+            if (now < restart.next_launch)
+            {
+                next_wake = std::min(next_wake, restart.next_launch);
+                continue;
             }
 
-            if (!child2_running)
+            int launched = 0;
+            if (launchWorker(slot, launched))
             {
-                if (launchChildProcess(2))
-                {
-                    logger_.log("Launched child process 2");
-                }
-                else
-                {
-                    logger_.log("Failed to launch child process 2");
-                }
+                restart.pid = launched;
+                restart.exited = false;
+                restart.started = now;
+                CPLIB_LOG_INFO(logger_, "Launched worker {} in slot {}", launched, slot);
             }
             else
             {
-                logger_.log("Child process 2 is still running, skipping launch");
+                restart.failures++;
+                restart.next_launch = now + restartDelay(restart.failures);
+                next_wake = std::min(next_wake, restart.next_launch);
+                CPLIB_LOG_ERROR(logger_, "Failed to launch worker in slot {}", slot);
             }
         }
+
+#if !defined(_WIN32)
+        // Перезапуск после задержки - отдельным таймером, не ждать шага управления
+        loop_.cancel(restart_timer_);
+        restart_timer_ = 0;
+        if (next_wake != std::chrono::steady_clock::time_point::max())
+        {
+            auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(next_wake - now) + std::chrono::milliseconds(1);
+            restart_timer_ = loop_.addTimer(delay, [this]
+                                            { restart_timer_ = 0;
+                                              maintainPool(); });
+        }
+#endif
     }
 
-    bool Application::launchChildProcess(int child_type)
+    void Application::submitDemoTasks()
     {
-#if defined(_WIN32)
-        STARTUPINFO si;
-        PROCESS_INFORMATION pi;
-        ZeroMemory(&si, sizeof(si));
-        si.cb = sizeof(si);
-        ZeroMemory(&pi, sizeof(pi));
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        // Следующая пара - только когда предыдущая выполнена
+        if (!demo_tasks_.empty())
+        {
+            return;
+        }
+        uint64_t add = pool_.submit(static_cast<uint32_t>(TaskKind::AddCounter), 10);
+        uint64_t double_halve = pool_.submit(static_cast<uint32_t>(TaskKind::DoubleHalve), 2000);
+        if (add != 0)
+        {
+            demo_tasks_.insert(add);
+        }
+        if (double_halve != 0)
+        {
+            demo_tasks_.insert(double_halve);
+        }
+#if !defined(_WIN32)
+        updateResultPolling();
+#endif
+    }
 
-        std::string command = "LAB.exe --child " + std::to_string(child_type);
+    void Application::dropWorkerTasks(int pid)
+    {
+        // Результаты, отправленные им до выхода, ещё засчитываются
+        collectResults();
+        std::vector<uint64_t> ids;
+        if (pool_.dropWorkerTasks(pid, ids) > 0)
+        {
+            dropTasks(ids, "worker exited");
+        }
+    }
 
-        if (!CreateProcess(NULL, (LPSTR)command.c_str(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+    void Application::dropTasks(const std::vector<uint64_t> &ids, const char *reason)
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        for (uint64_t id : ids)
         {
-            return false;
+            if (demo_tasks_.erase(id) > 0)
+            {
+                CPLIB_LOG_WARNING(logger_, "Task {} dropped: {}", id, reason);
+                continue;
+            }
+            auto task = task_jobs_.find(id);
+            if (task == task_jobs_.end())
+            {
+                continue;
+            }
+            // Остальные задачи подсчёта забываются, их результаты придут как чужие
+            uint64_t job = task->second;
+            auto primes = jobs_.find(job);
+            if (primes != jobs_.end())
+            {
+                CPLIB_LOG_ERROR(logger_, "Primes below {} failed: task {} {}", primes->second.limit, id, reason);
+                std::cout << "Primes below " << primes->second.limit << ": failed, task " << id << " " << reason << std::endl
+                          << "> " << std::flush;
+                jobs_.erase(primes);
+            }
+            for (auto it = task_jobs_.begin(); it != task_jobs_.end();)
+            {
+                it = it->second == job ? task_jobs_.erase(it) : std::next(it);
+            }
         }
+#if !defined(_WIN32)
+        updateResultPolling();
+#endif
+    }
 
-        if (child_type == 1)
+    void Application::abandonTasks()
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        for (const auto &job : jobs_)
         {
-            shared_data_.setChild1Pid(pi.dwProcessId);
+            CPLIB_LOG_WARNING(logger_, "Primes below {} abandoned: no longer the master", job.second.limit);
         }
-        else
+        // Стань мы мастером снова, номера прежних задач не должны задерживать новые
+        demo_tasks_.clear();
+        task_jobs_.clear();
+        jobs_.clear();
+    }
+
+    void Application::startPrimes(long long limit)
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        int tasks = targetWorkers() * PRIMES_TASKS_PER_WORKER;
+        long long chunk = std::max(1LL, (limit + tasks - 1) / tasks);
+        uint64_t job = 0;
+        PrimesJob primes = {limit, 0, 0, std::chrono::steady_clock::now()};
+        for (long long from = 0; from < limit; from += chunk)
+        {
+            uint64_t id = pool_.submit(static_cast<uint32_t>(TaskKind::CountPrimes), from, std::min(limit, from + chunk));
+            if (id == 0)
+            {
+                std::cout << "Task queue is full, " << from << " numbers submitted" << std::endl;
+                break;
+            }
+            job = job == 0 ? id : job;
+            task_jobs_[id] = job;
+            primes.remaining++;
+        }
+        if (job != 0)
         {
-            shared_data_.setChild2Pid(pi.dwProcessId);
+            jobs_[job] = primes;
         }
+#if !defined(_WIN32)
+        updateResultPolling();
+#endif
+    }
 
-        CloseHandle(pi.hThread);
-        CloseHandle(pi.hProcess);
-        return true;
-#else
-        pid_t pid = fork();
-        if (pid == 0)
+    void Application::collectResults()
+    {
+        std::vector<WorkerResult> results;
+        if (!pool_.isValid() || pool_.collect(results) == 0)
         {
-            // Дочерний процесс
-            struct sigaction action;
-            action.sa_handler = SIG_DFL;
-            sigaction(SIGTERM, &action, NULL);
-            execl("./LAB", "./LAB", "--child", std::to_string(child_type).c_str(), NULL);
-            exit(1); // Если execl failed
+            return;
         }
-        else if (pid > 0)
+
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        for (const WorkerResult &result : results)
         {
-            // Родительский процесс
-            if (child_type == 1)
+            if (demo_tasks_.erase(result.id) > 0)
             {
-                shared_data_.setChild1Pid(pid);
+                CPLIB_LOG_INFO(logger_, "Task {} done by worker {}, counter {}", result.id, result.pid, result.value);
+                continue;
             }
-            else
+            auto task = task_jobs_.find(result.id);
+            if (task == task_jobs_.end())
+            {
+                // Задача прежнего мастера
+                CPLIB_LOG_DEBUG(logger_, "Result of unknown task {} from worker {}", result.id, result.pid);
+                continue;
+            }
+            PrimesJob &job = jobs_[task->second];
+            job.count += result.value;
+            if (--job.remaining == 0)
             {
-                shared_data_.setChild2Pid(pid);
+                long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - job.started).count();
+                CPLIB_LOG_INFO(logger_, "Primes below {}: {} in {} ms", job.limit, job.count, elapsed);
+                std::cout << "Primes below " << job.limit << ": " << job.count << " (" << elapsed << " ms)" << std::endl
+                          << "> " << std::flush;
+                jobs_.erase(task->second);
             }
+            task_jobs_.erase(task);
+        }
+#if !defined(_WIN32)
+        updateResultPolling();
+#endif
+    }
+
+    bool Application::handleCommand(const std::string &line)
+    {
+        std::istringstream input(line);
+        std::string command;
+        if (!(input >> command))
+        {
             return true;
         }
-        else
+
+        if (command == "show" || command == "s")
+        {
+            std::cout << "Counter: " << shared_data_.getCounter();
+            if (is_master_)
+            {
+                std::cout << " [MASTER]";
+            }
+            else
+            {
+                std::cout << " [SLAVE]";
+            }
+            std::cout << std::endl;
+        }
+        else if (command == "set" || command == "m")
+        {
+            int64_t value;
+            if (input >> value)
+            {
+                shared_data_.setCounter(value);
+                std::cout << "Counter set to: " << value << std::endl;
+            }
+            else
+            {
+                std::cout << "Invalid value!" << std::endl;
+            }
+        }
+        else if (command == "primes" || command == "p")
+        {
+            long long limit;
+            if (!(input >> limit) || limit < 2)
+            {
+                std::cout << "Invalid value!" << std::endl;
+            }
+            else if (!is_master_)
+            {
+                std::cout << "Jobs run on the MASTER process" << std::endl;
+            }
+            else
+            {
+                startPrimes(limit);
+            }
+        }
+        else if (command == "exit" || command == "e" || command == "q")
         {
             return false;
         }
-#endif
+        else
+        {
+            std::cout << "Unknown command!" << std::endl;
+        }
+        return true;
     }
 
-    void Application::userInputThread()
+#if defined(_WIN32)
+    void Application::startChildManager()
     {
-        std::string command;
+        pool_.setTarget(targetWorkers());
+        // Поток сам завершается, когда мы перестаём быть мастером
+        if (!child_manager_thread_.joinable())
+        {
+            child_manager_thread_ = std::thread(&Application::childManagerThread, this);
+        }
+    }
 
-        std::cout << "Commands: 'show' (s), 'set <value>' (m <value>), 'exit' (e, q)" << std::endl;
+    void Application::stopChildManager()
+    {
+        abandonTasks();
+    }
 
+    void Application::counterTimerThread()
+    {
         while (running_)
         {
-            std::cout << "> ";
-            std::cin >> command;
+            std::this_thread::sleep_for(sleep_time);
+            counterTick();
+        }
+    }
 
-            if (command == "show" || command == "s")
+    void Application::masterCheckThread()
+    {
+        while (running_)
+        {
+            // Номер берём до проверок: запись, случившаяся во время них, разбудит сразу
+            uint32_t seen = shared_data_.stateVersion();
+
+            masterCheck();
+
+            // Спим до изменения общего состояния (например, мастер ушёл) либо до
+            // продления/истечения аренды - так замечается мастер, умерший без записи
+            shared_data_.waitStateChange(seen, shared_data_.nextCheckDelay());
+        }
+    }
+
+    void Application::childManagerThread()
+    {
+        auto last_tick = std::chrono::steady_clock::now();
+        while (running_ && is_master_)
+        {
+            std::this_thread::sleep_for(result_poll_interval);
+            collectResults();
+            if (std::chrono::steady_clock::now() - last_tick >= child_launch_interval)
             {
-                std::cout << "Counter: " << shared_data_.getCounter();
-                if (is_master_)
-                {
-                    std::cout << " [MASTER]";
-                }
-                else
-                {
-                    std::cout << " [SLAVE]";
-                }
-                std::cout << std::endl;
+                childManagerTick();
+                last_tick = std::chrono::steady_clock::now();
             }
-            else if (command == "set" || command == "m")
+        }
+    }
+
+    void Application::userInputThread()
+    {
+        std::string line;
+        while (running_)
+        {
+            std::cout << "> ";
+            if (!std::getline(std::cin, line) || !handleCommand(line))
             {
-                int value;
-                if (std::cin >> value)
-                {
-                    shared_data_.setCounter(value);
-                    std::cout << "Counter set to: " << value << std::endl;
-                }
-                else
+                break;
+            }
+        }
+        running_ = false;
+    }
+#else
+    void Application::startChildManager()
+    {
+        if (child_timer_ == 0)
+        {
+            pool_.setTarget(targetWorkers());
+            child_timer_ = loop_.addPeriodic(child_launch_interval, [this]
+                                             { childManagerTick(); });
+            // Пул поднимается сразу, задачи - по таймеру
+            maintainPool();
+        }
+    }
+
+    void Application::stopChildManager()
+    {
+        // Воркеры остаются: их подхватит новый мастер
+        loop_.cancel(child_timer_);
+        loop_.cancel(restart_timer_);
+        loop_.cancel(results_timer_);
+        child_timer_ = restart_timer_ = results_timer_ = 0;
+        abandonTasks();
+    }
+
+    void Application::startCheckpoint()
+    {
+        // msync может надолго заблокировать - не в цикле событий. Одна за раз
+        if (!shared_data_.isPersistent() || checkpoint_running_)
+        {
+            return;
+        }
+        if (checkpoint_thread_.joinable())
+        {
+            checkpoint_thread_.join();
+        }
+        checkpoint_running_ = true;
+        checkpoint_thread_ = std::thread([this]
+                                         {
+            bool ok = shared_data_.checkpoint();
+            loop_.post([this, ok]
+                       {
+                checkpoint_running_ = false;
+                if (!ok)
                 {
-                    std::cout << "Invalid value!" << std::endl;
-                    std::cin.clear();
-                    std::cin.ignore(10000, '\n');
-                }
+                    CPLIB_LOG_ERROR(logger_, "Checkpoint failed");
+                } }); });
+    }
+
+    void Application::updateResultPolling()
+    {
+        bool pending = !demo_tasks_.empty() || !task_jobs_.empty();
+        if (pending && results_timer_ == 0)
+        {
+            results_timer_ = loop_.addPeriodic(result_poll_interval, [this]
+                                               { collectResults(); });
+        }
+        else if (!pending && results_timer_ != 0)
+        {
+            loop_.cancel(results_timer_);
+            results_timer_ = 0;
+        }
+    }
+
+    void Application::scheduleMasterCheck()
+    {
+        masterCheck();
+        // Следующая проверка - к продлению/истечению аренды: так замечается мастер,
+        // умерший без записи. Об остальных изменениях будит stateWatcherThread
+        loop_.cancel(master_timer_);
+        master_timer_ = loop_.addTimer(shared_data_.nextCheckDelay(), [this]
+                                       { scheduleMasterCheck(); });
+    }
+
+    void Application::stateWatcherThread()
+    {
+        // futex не встраивается в epoll: ожидание остаётся в своём потоке, а проверка
+        // выполняется в цикле событий
+        uint32_t seen = shared_data_.stateVersion();
+        while (running_)
+        {
+            shared_data_.waitStateChange(seen, lease_time);
+            uint32_t version = shared_data_.stateVersion();
+            if (version != seen)
+            {
+                seen = version;
+                loop_.post([this]
+                           { scheduleMasterCheck(); });
             }
-            else if (command == "exit" || command == "e" || command == "q")
+        }
+    }
+
+    bool Application::readInput()
+    {
+        char buffer[256];
+        ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (count < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            return true;
+        }
+        if (count <= 0)
+        {
+            // Конец ввода - как exit
+            loop_.unwatch(STDIN_FILENO);
+            loop_.stop();
+            return false;
+        }
+
+        input_.append(buffer, count);
+        size_t end;
+        while ((end = input_.find('\n')) != std::string::npos)
+        {
+            std::string line = input_.substr(0, end);
+            input_.erase(0, end + 1);
+            if (!handleCommand(line))
             {
-                running_ = false;
-                break;
+                loop_.stop();
+                return false;
             }
-            else
+            std::cout << "> " << std::flush;
+        }
+        return true;
+    }
+
+    void Application::onWorkerExit(int slot, const ChildExit &exit)
+    {
+        if (exit.exited)
+        {
+            CPLIB_LOG_DEBUG(logger_, "Worker {} in slot {} exited with code {}", exit.pid, slot, exit.exit_code);
+        }
+        else
+        {
+            CPLIB_LOG_WARNING(logger_, "Worker {} in slot {} killed by signal {}", exit.pid, slot, exit.signal);
+        }
+        markWorkerExited(exit.pid);
+        // Взятые им задачи снимаются, перезапуск - сразу или по задержке
+        maintainPool();
+    }
+#endif
+
+    bool Application::launchWorker(int slot, int &pid)
+    {
+#if defined(_WIN32)
+        std::vector<std::string> args = {"LAB.exe", "--worker", std::to_string(slot)};
+#else
+        std::vector<std::string> args = {"./LAB", "--worker", std::to_string(slot)};
+#endif
+        if (!config_.persist_file.empty())
+        {
+            args.push_back("--persist");
+            args.push_back(config_.persist_file);
+        }
+
+        // Если зигота запущена - воркер порождается из прогретого шаблона без exec
+        LaunchOptions options;
+        options.backend = LaunchBackend::Zygote;
+
+        ProcessHandle handle;
+        try
+        {
+            handle = BackgroundLauncher::launch(args, options);
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+
+#if defined(_WIN32)
+        pid = GetProcessId(handle);
+        restarts_[slot].process = handle;
+#else
+        pid = handle;
+        // Воркер собирается по готовности его pidfd в цикле событий
+        if (!reaper_ || !reaper_->add(handle, [this, slot](const ChildExit &exit)
+                                      { onWorkerExit(slot, exit); }))
+        {
+            unreaped_.push_back(pid);
+        }
+#endif
+        // Воркер мог успеть записать себя сам - значение то же
+        pool_.setWorkerPid(slot, pid);
+        return true;
+    }
+
+    void Application::markWorkerExited(int pid)
+    {
+        for (WorkerRestart &restart : restarts_)
+        {
+            if (restart.pid == pid)
             {
-                std::cout << "Unknown command!" << std::endl;
+                restart.exited = true;
             }
         }
     }
 
-}
\ No newline at end of file
+    int Application::runWorker(const std::string &shared_mem_name, const std::string &log_file, int slot, const std::string &persist_file)
+    {
+        Logger logger(log_file, sharedLogging());
+        SharedDataManager shared_data(shared_mem_name, persist_file);
+        WorkerPool pool(shared_mem_name);
+        if (!shared_data.isValid() || !pool.isValid())
+        {
+            return 1;
+        }
+
+        CPLIB_LOG_INFO(logger, "Worker started in slot {}", slot);
+        auto master_seen = std::chrono::steady_clock::now();
+        pool.serve(
+            slot, [&](const WorkerTask &task)
+            { return runTask(shared_data, task); },
+            [&]
+            {
+                auto now = std::chrono::steady_clock::now();
+                if (shared_data.checkMasterAlive())
+                {
+                    master_seen = now;
+                }
+                return now - master_seen < WORKER_ORPHAN_TIMEOUT;
+            });
+        CPLIB_LOG_INFO(logger, "Worker stopped in slot {}", slot);
+        return 0;
+    }
+
+}
@@ -2,46 +2,150 @@
 
 #include "shared_data.hpp"
 #include "logger.hpp"
+#include "worker_pool.hpp"
+#include "background_launcher.h"
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <pthread.h>
+#if !defined(_WIN32)
+#include "event_loop.hpp"
+#include "child_reaper.h"
+#endif
 
 namespace cplib
 {
 
+    struct ApplicationConfig
+    {
+        std::string persist_file; // Состояние в файле, переживает перезапуск группы процессов
+        int workers = 0;          // Размер пула воркеров, 0 - по числу ядер
+        // Воркер, упавший раньше stable_run, перезапускается с задержкой: min, 2*min, ... до max
+        std::chrono::milliseconds restart_backoff_min = std::chrono::milliseconds(100);
+        std::chrono::milliseconds restart_backoff_max = std::chrono::milliseconds(10000);
+        std::chrono::milliseconds stable_run = std::chrono::milliseconds(10000);
+        // Задача, не выполненная за это время с отправки, снимается
+        std::chrono::milliseconds task_timeout = std::chrono::milliseconds(60000);
+    };
+
+    // Задачи воркеров пула
+    enum class TaskKind : uint32_t
+    {
+        AddCounter = 1,  // Прибавить args[0] к счётчику (прежняя копия 1)
+        DoubleHalve = 2, // Удвоить счётчик, подождать args[0] мс, поделить пополам (прежняя копия 2)
+        CountPrimes = 3  // Число простых в [args[0], args[1])
+    };
+
     class Application
     {
     public:
-        Application(const std::string &shared_mem_name, const std::string &log_file);
+        Application(const std::string &shared_mem_name, const std::string &log_file, const ApplicationConfig &config = ApplicationConfig());
         ~Application();
 
         void run();
 
+        // Точка входа процесса-воркера: выполняет задачи пула, пока он нужен мастеру
+        static int runWorker(const std::string &shared_mem_name, const std::string &log_file, int slot, const std::string &persist_file);
+
     private:
-        void counterTimerThread(); // Таймер счетчика
-        void masterCheckThread();  // Проверка состояния мастера
-        void childManagerThread(); // Управление дочерними процессами
-        void userInputThread();    // Пользовательский ввод
-        void updateMasterStatus(); // Обновление статуса мастера
+        // Перезапуск воркеров слота
+        struct WorkerRestart
+        {
+            int pid = 0;         // Запущенный нами воркер, 0 - нет
+            bool exited = false; // Пришло уведомление о его завершении
+#if defined(_WIN32)
+            HANDLE process = NULL; // Завершение видно по описателю, а не по PID
+#endif
+            int failures = 0;
+            std::chrono::steady_clock::time_point started;
+            std::chrono::steady_clock::time_point next_launch;
+        };
+
+        // Подсчёт простых, разбитый на задачи
+        struct PrimesJob
+        {
+            long long limit;
+            int remaining;
+            long long count;
+            std::chrono::steady_clock::time_point started;
+        };
+
+        // Шаги работы. На POSIX их по таймерам и событиям вызывает один EventLoop,
+        // на Windows - отдельные потоки с циклом sleep_for
+        void counterTick();                          // Таймер счетчика
+        void masterCheck();                          // Проверка состояния мастера
+        void childManagerTick();                     // Управление дочерними процессами
+        bool handleCommand(const std::string &line); // Пользовательский ввод; false - выход
+        void updateMasterStatus();                   // Обновление статуса мастера
+        void startChildManager();
+        void stopChildManager();
 
-        bool launchChildProcess(int child_type); // Запуск копии
+        int targetWorkers();
+        std::chrono::milliseconds restartDelay(int failures); // 0 при failures == 0
+        void maintainPool();    // Держать target воркеров, упавших - перезапускать
+        void submitDemoTasks(); // Задачи прежних копий 1 и 2
+        void collectResults();
+        void dropWorkerTasks(int pid); // Воркер завершился - снять взятые им задачи
+        // Снять задачи: демонстрационные забываются, подсчёт простых завершается ошибкой
+        void dropTasks(const std::vector<uint64_t> &ids, const char *reason);
+        void abandonTasks(); // Перестали быть мастером - задачи в работе больше не наши
+        void startPrimes(long long limit);
+        bool launchWorker(int slot, int &pid);
+        void markWorkerExited(int pid); // Уведомление о завершении запущенного нами воркера
 
+        ApplicationConfig config_;
         SharedDataManager shared_data_;
         Logger logger_;
+        WorkerPool pool_;
         std::atomic<bool> running_;
+        WorkerRestart restarts_[MAX_WORKERS];
+        std::mutex tasks_mutex_; // Задачи в работе: ввод и сбор результатов на Windows - разные потоки
+        std::unordered_set<uint64_t> demo_tasks_;
+        std::unordered_map<uint64_t, uint64_t> task_jobs_; // Задача -> подсчёт простых
+        std::map<uint64_t, PrimesJob> jobs_;
+#if defined(_WIN32)
+        void counterTimerThread();
+        void masterCheckThread();
+        void childManagerThread();
+        void userInputThread();
+
         std::thread counter_thread_;
         std::thread master_check_thread_;
         std::thread child_manager_thread_;
-        std::thread input_thread_;
+#else
+        void scheduleMasterCheck(); // Проверка и перевзвод её таймера на nextCheckDelay()
+        void stateWatcherThread();  // Будит цикл при записи в общее состояние (futex)
+        bool readInput();           // false - ввод кончился или exit
+        void onWorkerExit(int slot, const ChildExit &exit);
+        void updateResultPolling(); // Таймер сбора результатов - только пока есть задачи в работе
+        void startCheckpoint();     // Контрольная точка в своём потоке, итог - обратно в цикл
+
+        EventLoop loop_;
+        std::unique_ptr<ChildReaper> reaper_;
+        std::vector<int> unreaped_; // Копии не под reaper_ - собираются waitpid по pid
+        std::thread checkpoint_thread_;
+        bool checkpoint_running_ = false;
+        EventLoop::TimerId master_timer_ = 0;
+        EventLoop::TimerId child_timer_ = 0;
+        EventLoop::TimerId restart_timer_ = 0;
+        EventLoop::TimerId results_timer_ = 0;
+        std::string input_;
+        std::thread state_watcher_;
+#endif
         std::chrono::milliseconds sleep_time = std::chrono::milliseconds(300);
         std::chrono::milliseconds write_time = sleep_time;
-        std::chrono::milliseconds check_time = std::chrono::milliseconds(1000);
+        std::chrono::milliseconds lease_time = std::chrono::milliseconds(1000); // Срок аренды мастера
         std::chrono::milliseconds child_launch_interval = std::chrono::milliseconds(3000);
+        std::chrono::milliseconds result_poll_interval = std::chrono::milliseconds(10);
 
         bool is_master_;
         bool is_slave_;
         bool new_slave_status;
     };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Общие помощники бенчмарков lab3: время, порождение N процессов, перцентили.
+// Только POSIX: процессы порождаются через fork()
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace bench
+{
+
+    inline int64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Анонимная общая память для результатов потомков
+    template <class T>
+    T *sharedArray(size_t count)
+    {
+        void *mem = mmap(nullptr, sizeof(T) * count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        return mem == MAP_FAILED ? nullptr : static_cast<T *>(mem);
+    }
+
+    template <class T>
+    void freeSharedArray(T *array, size_t count)
+    {
+        munmap(array, sizeof(T) * count);
+    }
+
+    // Запустить body(i) в n процессах и дождаться всех; false - кто-то упал
+    inline bool runProcesses(int n, const std::function<void(int)> &body)
+    {
+        std::vector<pid_t> pids;
+        for (int i = 0; i < n; ++i)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                body(i);
+                _exit(0);
+            }
+            if (pid > 0)
+                pids.push_back(pid);
+        }
+
+        bool ok = static_cast<int>(pids.size()) == n;
+        for (pid_t pid : pids)
+        {
+            int status = 0;
+            waitpid(pid, &status, 0);
+            ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        return ok;
+    }
+
+    // Все процессы стартуют одновременно: ждём, пока счётчик не наберёт n
+    inline void barrier(std::atomic<int> &arrived, int n)
+    {
+        arrived.fetch_add(1);
+        while (arrived.load() < n)
+        {
+        }
+    }
+
+    inline double percentile(std::vector<double> &samples, double p)
+    {
+        if (samples.empty())
+            return 0;
+        std::sort(samples.begin(), samples.end());
+        size_t index = static_cast<size_t>(p / 100.0 * (samples.size() - 1));
+        return samples[index];
+    }
+
+    inline std::vector<int> parseCounts(int argc, char **argv, int first, std::vector<int> defaults)
+    {
+        std::vector<int> counts;
+        for (int i = first; i < argc; ++i)
+            counts.push_back(std::stoi(argv[i]));
+        return counts.empty() ? defaults : counts;
+    }
+
+}
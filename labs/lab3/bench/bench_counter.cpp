@@ -0,0 +1,119 @@
+#include "shared_data.hpp"
+#include "shared_counter.hpp"
+#include "bench_common.hpp"
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+// Масштабирование инкремента общего счётчика с числом процессов:
+// слоты SharedDataManager, один общий атомик (SharedCounter) и счётчик под блокировкой.
+// Запуск: LAB_BENCH_COUNTER [инкрементов на процесс] [число процессов ...]
+
+namespace
+{
+    struct LockedCounter
+    {
+        LockedCounter() : value(0) {}
+        long long value;
+    };
+
+    struct Run
+    {
+        double mops; // Суммарно, млн операций в секунду
+        bool correct;
+    };
+
+    std::atomic<int> *arrived;
+
+    // Время прогона - от общего старта до завершения последнего процесса
+    template <class Setup, class Body>
+    double timedRun(int processes, Setup setup, Body body)
+    {
+        int64_t *finished = bench::sharedArray<int64_t>(processes);
+        arrived->store(0);
+        bench::runProcesses(processes, [&](int id)
+                            {
+            auto state = setup();
+            bench::barrier(*arrived, processes);
+            int64_t start = bench::nowNs();
+            body(*state);
+            finished[id] = bench::nowNs() - start; });
+
+        int64_t longest = 0;
+        for (int i = 0; i < processes; ++i)
+            longest = std::max(longest, finished[i]);
+        bench::freeSharedArray(finished, processes);
+        return double(longest);
+    }
+
+    Run runSharded(int processes, long iterations)
+    {
+        cplib::SharedDataManager data("bench_counter_data");
+        data.setCounter(0);
+        double ns = timedRun(
+            processes, []
+            { return std::make_unique<cplib::SharedDataManager>("bench_counter_data"); },
+            [&](cplib::SharedDataManager &mgr)
+            {
+                for (long i = 0; i < iterations; ++i)
+                    mgr.incrementCounter();
+            });
+        return {processes * iterations / ns * 1000.0, data.getCounter() == processes * iterations};
+    }
+
+    Run runAtomic(int processes, long iterations)
+    {
+        cplib::SharedCounter counter("bench_counter_atomic");
+        counter.setValue(0);
+        double ns = timedRun(
+            processes, []
+            { return std::make_unique<cplib::SharedCounter>("bench_counter_atomic"); },
+            [&](cplib::SharedCounter &c)
+            {
+                for (long i = 0; i < iterations; ++i)
+                    c.increment();
+            });
+        return {processes * iterations / ns * 1000.0, counter.getValue() == processes * iterations};
+    }
+
+    Run runLocked(int processes, long iterations)
+    {
+        cplib::SharedMem<LockedCounter> mem("bench_counter_locked");
+        mem.Data()->value = 0;
+        double ns = timedRun(
+            processes, []
+            { return std::make_unique<cplib::SharedMem<LockedCounter>>("bench_counter_locked"); },
+            [&](cplib::SharedMem<LockedCounter> &m)
+            {
+                for (long i = 0; i < iterations; ++i)
+                {
+                    m.Lock();
+                    m.Data()->value++;
+                    m.Unlock();
+                }
+            });
+        return {processes * iterations / ns * 1000.0, mem.Data()->value == processes * iterations};
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? std::stol(argv[1]) : 2000000;
+    std::vector<int> counts = bench::parseCounts(argc, argv, 2, {1, 2, 4, 8, 16});
+    arrived = bench::sharedArray<std::atomic<int>>(1);
+
+    std::cout << std::setw(10) << "processes" << std::setw(16) << "sharded, Mop/s"
+              << std::setw(16) << "atomic, Mop/s" << std::setw(16) << "locked, Mop/s" << std::endl;
+    for (int processes : counts)
+    {
+        Run sharded = runSharded(processes, iterations);
+        Run atomic = runAtomic(processes, iterations);
+        Run locked = runLocked(processes, iterations / 10);
+        std::cout << std::setw(10) << processes << std::fixed << std::setprecision(1)
+                  << std::setw(16) << sharded.mops << std::setw(16) << atomic.mops << std::setw(16) << locked.mops;
+        if (!sharded.correct || !atomic.correct || !locked.correct)
+            std::cout << "  (lost increments!)";
+        std::cout << std::endl;
+    }
+    return 0;
+}
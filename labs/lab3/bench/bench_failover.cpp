@@ -0,0 +1,136 @@
+#include "shared_data.hpp"
+#include "bench_common.hpp"
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+// Время перехода роли мастера: процессы-кандидаты работают как Application
+// (продление аренды и ожидание изменений состояния), мастера раз за разом убивают
+// SIGKILL'ом и замеряют, через сколько аренду займёт новый процесс.
+// Запуск: LAB_BENCH_FAILOVER [число убийств] [срок аренды, мс ...]
+
+namespace
+{
+    const char *SEGMENT = "bench_failover";
+    const char *SEGMENT_PATH = "/bench_failover";
+    const int CANDIDATES = 4;
+
+    // Кто и когда последним стал мастером
+    struct Takeover
+    {
+        std::atomic<uint32_t> epoch;
+        std::atomic<int64_t> at_ns;
+    };
+
+    void candidate(Takeover *takeover)
+    {
+        cplib::SharedDataManager manager(SEGMENT);
+        bool master = false;
+        while (true)
+        {
+            uint32_t seen = manager.stateVersion();
+            if (master)
+                master = manager.renewLease();
+            else if (manager.isMaster())
+            {
+                master = true;
+                takeover->at_ns.store(bench::nowNs());
+                takeover->epoch.store(manager.masterEpoch());
+            }
+            manager.waitStateChange(seen, manager.nextCheckDelay());
+        }
+    }
+
+    pid_t spawnCandidate(Takeover *takeover)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            candidate(takeover);
+            _exit(0);
+        }
+        return pid;
+    }
+
+    // Дождаться мастера новее epoch
+    bool waitTakeover(Takeover *takeover, uint32_t epoch, int64_t timeout_ns)
+    {
+        int64_t deadline = bench::nowNs() + timeout_ns;
+        while (takeover->epoch.load() == epoch)
+        {
+            if (bench::nowNs() > deadline)
+                return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int kills = argc > 1 ? std::stoi(argv[1]) : 20;
+    std::vector<int> leases = bench::parseCounts(argc, argv, 2, {20, 50, 200, 1000});
+
+    Takeover *takeover = bench::sharedArray<Takeover>(1);
+
+    std::cout << std::setw(10) << "lease, ms" << std::setw(12) << "p50, ms" << std::setw(12) << "p99, ms"
+              << std::setw(12) << "max, ms" << std::setw(10) << "missed" << std::endl;
+
+    for (int lease : leases)
+    {
+        // Убитые кандидаты не снимают регистрацию в сегменте - удаляем его явно
+        shm_unlink(SEGMENT_PATH);
+        // Сегмент создаёт и держит наблюдатель; он не участвует в выборах
+        cplib::SharedDataManager observer(SEGMENT);
+        observer.setLeaseDuration(std::chrono::milliseconds(lease));
+        takeover->epoch.store(0);
+
+        std::vector<pid_t> pids;
+        for (int i = 0; i < CANDIDATES; ++i)
+            pids.push_back(spawnCandidate(takeover));
+
+        std::vector<double> failover_ms;
+        int missed = 0;
+        int64_t timeout = int64_t(lease) * 20 * 1000000;
+        for (int k = 0; k < kills; ++k)
+        {
+            uint32_t epoch = takeover->epoch.load();
+            int master = observer.masterPid();
+            if (master == 0)
+            {
+                waitTakeover(takeover, epoch, timeout);
+                continue;
+            }
+
+            int64_t killed_at = bench::nowNs();
+            kill(master, SIGKILL);
+            waitpid(master, nullptr, 0);
+            if (waitTakeover(takeover, epoch, timeout))
+                failover_ms.push_back((takeover->at_ns.load() - killed_at) / 1e6);
+            else
+                missed++;
+
+            // Замена убитому
+            for (pid_t &pid : pids)
+                if (pid == master)
+                    pid = spawnCandidate(takeover);
+        }
+
+        for (pid_t pid : pids)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+        shm_unlink(SEGMENT_PATH);
+
+        std::cout << std::setw(10) << lease << std::fixed << std::setprecision(2)
+                  << std::setw(12) << bench::percentile(failover_ms, 50)
+                  << std::setw(12) << bench::percentile(failover_ms, 99)
+                  << std::setw(12) << (failover_ms.empty() ? 0.0 : failover_ms.back())
+                  << std::setw(10) << missed << std::endl;
+    }
+
+    bench::freeSharedArray(takeover, 1);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "shared_memory.hpp"
+#include "bench_common.hpp"
+#include <iomanip>
+#include <iostream>
+#include <semaphore.h>
+
+// Цена пары Lock/Unlock у SharedMem под конкуренцией N процессов
+// в сравнении с именованным семафором (прежняя реализация).
+// Запуск: LAB_BENCH_LOCK [итераций на процесс] [число процессов ...]
+
+namespace
+{
+    struct LockBenchData
+    {
+        LockBenchData() : value(0), arrived(0) {}
+        long long value;
+        std::atomic<int> arrived;
+    };
+
+    const char *SEGMENT_NAME = "bench_lock";
+    const char *SEM_NAME = "/bench_lock_baseline_sem";
+
+    // Среднее время пары lock/unlock в наносекундах по всем процессам
+    double runMutex(int processes, int iterations)
+    {
+        cplib::SharedMem<LockBenchData> mem(SEGMENT_NAME);
+        if (!mem.IsValid())
+            return -1;
+        mem.Data()->arrived = 0;
+        mem.Data()->value = 0;
+
+        double *results = bench::sharedArray<double>(processes);
+        bench::runProcesses(processes, [&](int id)
+                            {
+            cplib::SharedMem<LockBenchData> child(SEGMENT_NAME, false);
+            bench::barrier(child.Data()->arrived, processes);
+            int64_t start = bench::nowNs();
+            for (int i = 0; i < iterations; ++i)
+            {
+                child.Lock();
+                child.Data()->value++;
+                child.Unlock();
+            }
+            results[id] = double(bench::nowNs() - start) / iterations; });
+
+        double sum = 0;
+        for (int i = 0; i < processes; ++i)
+            sum += results[i];
+        bool correct = mem.Data()->value == (long long)processes * iterations;
+        bench::freeSharedArray(results, processes);
+        return correct ? sum / processes : -1;
+    }
+
+    double runSemaphore(int processes, int iterations)
+    {
+        sem_unlink(SEM_NAME);
+        sem_t *sem = sem_open(SEM_NAME, O_CREAT | O_EXCL, 0644, 1);
+        if (sem == SEM_FAILED)
+            return -1;
+
+        struct Shared
+        {
+            long long value;
+            std::atomic<int> arrived;
+        } *shared = bench::sharedArray<Shared>(1);
+        double *results = bench::sharedArray<double>(processes);
+        shared->value = 0;
+        shared->arrived = 0;
+
+        bench::runProcesses(processes, [&](int id)
+                            {
+            bench::barrier(shared->arrived, processes);
+            int64_t start = bench::nowNs();
+            for (int i = 0; i < iterations; ++i)
+            {
+                sem_wait(sem);
+                shared->value++;
+                sem_post(sem);
+            }
+            results[id] = double(bench::nowNs() - start) / iterations; });
+
+        double sum = 0;
+        for (int i = 0; i < processes; ++i)
+            sum += results[i];
+        bench::freeSharedArray(results, processes);
+        bench::freeSharedArray(shared, 1);
+        sem_close(sem);
+        sem_unlink(SEM_NAME);
+        return sum / processes;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 200000;
+    std::vector<int> counts = bench::parseCounts(argc, argv, 2, {1, 2, 8, 32});
+
+    std::cout << std::setw(10) << "processes" << std::setw(18) << "mutex, ns/op" << std::setw(18) << "sem, ns/op" << std::endl;
+    for (int processes : counts)
+    {
+        double mutex_ns = runMutex(processes, iterations);
+        double sem_ns = runSemaphore(processes, iterations);
+        std::cout << std::setw(10) << processes << std::fixed << std::setprecision(1)
+                  << std::setw(18) << mutex_ns << std::setw(18) << sem_ns << std::endl;
+    }
+    return 0;
+}
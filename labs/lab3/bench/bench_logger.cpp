@@ -0,0 +1,260 @@
+#include "logger.hpp"
+#include "bench_common.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+
+// Стоимость вызова Logger::log: синхронный путь (ofstream + endl) против очередей
+// потоков с фоновой записью пачками, затем несколько процессов в один файл:
+// каждый сам против общего кольца (Shared). Задержка - время одного вызова,
+// "total" - до попадания последней строки в файл (включая flush). В конце -
+// отсчёт счётчика: строка из stringstream против структурной записи, текстом и двоично.
+// Запуск: LAB_BENCH_LOGGER [записей на поток] [число потоков/процессов ...]
+
+namespace
+{
+    const char *LOG_FILE = "bench_logger.log";
+
+    struct Result
+    {
+        double p50_ns, p99_ns, p999_ns;
+        double total_krecords_per_sec;
+        long lines;
+    };
+
+    // Число строк; ordered - метки времени не убывают
+    long countLines(const char *path, bool *ordered = NULL)
+    {
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+            return 0;
+        long lines = 0;
+        char line[512];
+        std::string previous;
+        if (ordered != NULL)
+            *ordered = true;
+        while (fgets(line, sizeof(line), file) != NULL)
+        {
+            lines++;
+            std::string stamp(line, std::min<size_t>(strlen(line), 25));
+            if (ordered != NULL && stamp < previous)
+                *ordered = false;
+            previous = stamp;
+        }
+        fclose(file);
+        return lines;
+    }
+
+    Result run(const cplib::LoggerOptions &options, int threads, long records)
+    {
+        remove(LOG_FILE);
+        std::vector<std::vector<double>> latencies(threads);
+        std::atomic<int> arrived(0);
+        int64_t start = 0;
+        {
+            cplib::Logger logger(LOG_FILE, options);
+            std::vector<std::thread> workers;
+            start = bench::nowNs();
+            for (int t = 0; t < threads; ++t)
+                workers.emplace_back([&, t]
+                                     {
+                    std::string message = "worker " + std::to_string(t) + " counter value: 123456";
+                    latencies[t].reserve(records);
+                    bench::barrier(arrived, threads);
+                    for (long i = 0; i < records; ++i)
+                    {
+                        int64_t before = bench::nowNs();
+                        logger.log(message);
+                        latencies[t].push_back(double(bench::nowNs() - before));
+                    } });
+            for (auto &worker : workers)
+                worker.join();
+            logger.flush();
+        }
+        double elapsed_s = (bench::nowNs() - start) / 1e9;
+
+        std::vector<double> all;
+        for (auto &samples : latencies)
+            all.insert(all.end(), samples.begin(), samples.end());
+        Result result;
+        result.p50_ns = bench::percentile(all, 50);
+        result.p99_ns = bench::percentile(all, 99);
+        result.p999_ns = bench::percentile(all, 99.9);
+        result.total_krecords_per_sec = threads * records / elapsed_s / 1000.0;
+        result.lines = countLines(LOG_FILE);
+        remove(LOG_FILE);
+        return result;
+    }
+
+    struct ProcessResult
+    {
+        double p50_ns, p99_ns;
+        double total_krecords_per_sec;
+        long lines;
+        bool ordered;
+    };
+
+    ProcessResult runGroup(const cplib::LoggerOptions &options, int processes, long records)
+    {
+        remove(LOG_FILE);
+        double *p50 = bench::sharedArray<double>(processes);
+        double *p99 = bench::sharedArray<double>(processes);
+        std::atomic<int> *arrived = bench::sharedArray<std::atomic<int>>(1);
+        arrived->store(0);
+        int64_t start = bench::nowNs();
+        bench::runProcesses(processes, [&](int id)
+                            {
+            std::vector<double> latencies;
+            latencies.reserve(records);
+            {
+                cplib::Logger logger(LOG_FILE, options);
+                std::string message = "process " + std::to_string(id) + " counter value: 123456";
+                bench::barrier(*arrived, processes);
+                for (long i = 0; i < records; ++i)
+                {
+                    int64_t before = bench::nowNs();
+                    logger.log(message);
+                    latencies.push_back(double(bench::nowNs() - before));
+                }
+            }
+            p50[id] = bench::percentile(latencies, 50);
+            p99[id] = bench::percentile(latencies, 99); });
+        double elapsed_s = (bench::nowNs() - start) / 1e9;
+
+        ProcessResult result;
+        std::vector<double> medians(p50, p50 + processes), tails(p99, p99 + processes);
+        result.p50_ns = bench::percentile(medians, 50);
+        result.p99_ns = bench::percentile(tails, 100);
+        result.total_krecords_per_sec = processes * records / elapsed_s / 1000.0;
+        result.lines = countLines(LOG_FILE, &result.ordered);
+        bench::freeSharedArray(p50, processes);
+        bench::freeSharedArray(p99, processes);
+        bench::freeSharedArray(arrived, 1);
+        remove(LOG_FILE);
+        return result;
+    }
+
+    struct CounterResult
+    {
+        double p50_ns, p99_ns;
+        double bytes_per_record;
+    };
+
+    CounterResult runCounter(const cplib::LoggerOptions &options, bool structured, long records)
+    {
+        remove(LOG_FILE);
+        std::vector<double> latencies;
+        latencies.reserve(records);
+        {
+            cplib::Logger logger(LOG_FILE, options);
+            for (long i = 0; i < records; ++i)
+            {
+                int64_t before = bench::nowNs();
+                if (structured)
+                    logger.logf(CPLIB_LOG_FORMAT("Counter value: {}"), i);
+                else
+                {
+                    // Как было в logCounter
+                    std::stringstream ss;
+                    ss << "Counter value: " << i;
+                    logger.log(ss.str());
+                }
+                latencies.push_back(double(bench::nowNs() - before));
+            }
+        }
+        struct stat st;
+        CounterResult result;
+        result.p50_ns = bench::percentile(latencies, 50);
+        result.p99_ns = bench::percentile(latencies, 99);
+        result.bytes_per_record = stat(LOG_FILE, &st) == 0 ? double(st.st_size) / records : 0;
+        remove(LOG_FILE);
+        return result;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long records = argc > 1 ? std::stol(argv[1]) : 200000;
+    std::vector<int> counts = bench::parseCounts(argc, argv, 2, {1, 4});
+
+    cplib::LoggerOptions sync;
+    cplib::LoggerOptions async;
+    async.mode = cplib::LogMode::Async;
+    async.queue_size = 1 << 20;
+    cplib::LoggerOptions durable = async;
+    durable.durability = cplib::LogDurability::Data;
+    durable.flush_interval = std::chrono::milliseconds(10);
+
+    struct Mode
+    {
+        const char *name;
+        cplib::LoggerOptions options;
+    };
+    const Mode modes[] = {{"sync", sync}, {"async", async}, {"async+fdatasync", durable}};
+
+    std::cout << std::setw(8) << "threads" << std::setw(18) << "mode" << std::setw(10) << "p50, ns" << std::setw(10)
+              << "p99, ns" << std::setw(12) << "p99.9, ns" << std::setw(14) << "total, k/s" << std::endl;
+    for (int threads : counts)
+    {
+        for (const Mode &mode : modes)
+        {
+            Result r = run(mode.options, threads, records);
+            std::cout << std::setw(8) << threads << std::setw(18) << mode.name << std::fixed << std::setprecision(0)
+                      << std::setw(10) << r.p50_ns << std::setw(10) << r.p99_ns << std::setw(12) << r.p999_ns
+                      << std::setw(14) << r.total_krecords_per_sec;
+            if (r.lines != threads * records)
+                std::cout << "  (lines in file: " << r.lines << ")";
+            std::cout << std::endl;
+        }
+    }
+
+    cplib::LoggerOptions group;
+    group.mode = cplib::LogMode::Shared;
+    group.shared_name = "bench_logger";
+    const Mode groupModes[] = {{"sync", sync}, {"shared ring", group}};
+
+    std::cout << std::endl
+              << std::setw(10) << "processes" << std::setw(16) << "mode" << std::setw(10) << "p50, ns"
+              << std::setw(10) << "p99, ns" << std::setw(14) << "total, k/s" << std::endl;
+    for (int processes : counts)
+    {
+        for (const Mode &mode : groupModes)
+        {
+            ProcessResult r = runGroup(mode.options, processes, records);
+            std::cout << std::setw(10) << processes << std::setw(16) << mode.name << std::fixed << std::setprecision(0)
+                      << std::setw(10) << r.p50_ns << std::setw(10) << r.p99_ns << std::setw(14) << r.total_krecords_per_sec;
+            if (r.lines != processes * records)
+                std::cout << "  (lines in file: " << r.lines << ")";
+            if (!r.ordered)
+                std::cout << "  (out of order)";
+            std::cout << std::endl;
+        }
+    }
+
+    cplib::LoggerOptions binary = async;
+    binary.binary = true;
+    struct CounterMode
+    {
+        const char *name;
+        cplib::LoggerOptions options;
+        bool structured;
+    };
+    const CounterMode counterModes[] = {{"async, stringstream", async, false},
+                                        {"async, logf", async, true},
+                                        {"async, logf, binary", binary, true}};
+
+    std::cout << std::endl
+              << std::setw(24) << "counter sample" << std::setw(10) << "p50, ns" << std::setw(10) << "p99, ns"
+              << std::setw(16) << "bytes/record" << std::endl;
+    for (const CounterMode &mode : counterModes)
+    {
+        CounterResult r = runCounter(mode.options, mode.structured, records);
+        std::cout << std::setw(24) << mode.name << std::fixed << std::setprecision(0) << std::setw(10) << r.p50_ns
+                  << std::setw(10) << r.p99_ns << std::setprecision(1) << std::setw(16) << r.bytes_per_record << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "shared_memory.hpp"
+#include "bench_common.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+
+// Стоимость доступа к хвосту SharedMem при разных параметрах отображения:
+// подключение, первое касание каждой страницы и случайные зависимые чтения
+// (погоня за указателем - видны промахи TLB).
+// Запуск: LAB_BENCH_MAPPING [размер хвоста, МиБ] [число чтений]
+
+namespace
+{
+    struct Empty
+    {
+        int unused;
+    };
+
+    using Segment = cplib::SharedMem<Empty>;
+
+    const char *SEGMENT_NAME = "bench_mapping";
+    const size_t PAGE = 4096;
+    const size_t NODE = 64; // Узел цепочки - кэш-линия
+
+    struct Config
+    {
+        const char *name;
+        bool populate;
+        bool lock_pages;
+        bool read_only;
+        cplib::SharedMemPages pages;
+    };
+
+    struct Result
+    {
+        double open_ms;
+        double touch_ns_per_page;
+        double read_ns;
+        double pmd_mib; // Сколько сегмента отображено большими страницами
+        bool huge;
+        bool locked;
+    };
+
+    // Разделяемая память, отображённая большими страницами (PMD), по всему процессу
+    double pmdMappedMiB()
+    {
+        std::ifstream rollup("/proc/self/smaps_rollup");
+        std::string key;
+        double total = 0;
+        while (rollup >> key)
+        {
+            long kb = 0;
+            if ((key == "ShmemPmdMapped:" || key == "FilePmdMapped:" || key == "Shared_Hugetlb:") && rollup >> kb)
+                total += kb / 1024.0;
+            rollup.ignore(256, '\n');
+        }
+        return total;
+    }
+
+    // Случайный цикл по узлам хвоста: в каждом узле - смещение следующего
+    void buildChain(char *tail, size_t size)
+    {
+        std::vector<size_t> order(size / NODE);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin() + 1, order.end(), std::mt19937_64(42));
+        for (size_t i = 0; i < order.size(); ++i)
+            *reinterpret_cast<uint64_t *>(tail + order[i] * NODE) = order[(i + 1) % order.size()] * NODE;
+    }
+
+    double chase(const char *tail, long reads)
+    {
+        uint64_t offset = 0;
+        int64_t start = bench::nowNs();
+        for (long i = 0; i < reads; ++i)
+            offset = *reinterpret_cast<const volatile uint64_t *>(tail + offset);
+        int64_t elapsed = bench::nowNs() - start;
+        // Не даём компилятору выбросить цикл
+        if (offset == 1)
+            std::cout << "";
+        return double(elapsed) / reads;
+    }
+
+    Result run(const Config &config, size_t size, long reads)
+    {
+        shm_unlink("/bench_mapping");
+        unlink(HUGETLBFS_DIR "/bench_mapping");
+
+        cplib::SharedMemOptions options;
+        options.tail_size = options.max_tail_size = size;
+        options.populate = config.populate;
+        options.lock_pages = config.lock_pages;
+        options.pages = config.pages;
+
+        // Только для чтения отображается уже созданный и заполненный сегмент
+        std::unique_ptr<Segment> writer;
+        if (config.read_only)
+        {
+            cplib::SharedMemOptions plain;
+            plain.tail_size = plain.max_tail_size = size;
+            writer.reset(new Segment(SEGMENT_NAME, true, plain));
+            buildChain(static_cast<char *>(writer->Tail()), size);
+            options.read_only = true;
+        }
+
+        Result result;
+        int64_t start = bench::nowNs();
+        Segment segment(SEGMENT_NAME, true, options);
+        result.open_ms = (bench::nowNs() - start) / 1e6;
+        char *tail = static_cast<char *>(segment.Tail());
+        if (tail == NULL)
+            return {0, 0, 0, 0, false, false};
+
+        start = bench::nowNs();
+        volatile char sink = 0;
+        for (size_t i = 0; i < size; i += PAGE)
+        {
+            if (config.read_only)
+                sink = sink + tail[i];
+            else
+                tail[i] = 1;
+        }
+        result.touch_ns_per_page = double(bench::nowNs() - start) / (size / PAGE);
+
+        if (!config.read_only)
+            buildChain(tail, size);
+        result.read_ns = chase(tail, reads);
+        result.pmd_mib = pmdMappedMiB();
+        result.huge = segment.HugePages();
+        result.locked = segment.PagesLocked();
+        return result;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (argc > 1 ? std::stoul(argv[1]) : 256) << 20;
+    long reads = argc > 2 ? std::stol(argv[2]) : 10000000;
+
+    using cplib::SharedMemPages;
+    const Config configs[] = {
+        {"default", false, false, false, SharedMemPages::Normal},
+        {"populate", true, false, false, SharedMemPages::Normal},
+        {"mlock", false, true, false, SharedMemPages::Normal},
+        {"populate+mlock", true, true, false, SharedMemPages::Normal},
+        {"transparent", false, false, false, SharedMemPages::Transparent},
+        {"transparent+populate", true, false, false, SharedMemPages::Transparent},
+        {"huge", false, false, false, SharedMemPages::Huge},
+        {"huge+populate", true, false, false, SharedMemPages::Huge},
+        {"read-only", false, false, true, SharedMemPages::Normal},
+    };
+
+    std::cout << "tail " << (size >> 20) << " MiB, " << reads << " dependent reads" << std::endl;
+    std::cout << std::left << std::setw(22) << "mapping" << std::right << std::setw(10) << "open, ms"
+              << std::setw(16) << "touch, ns/page" << std::setw(14) << "read, ns" << std::setw(12) << "pmd, MiB"
+              << "  notes" << std::endl;
+    for (const Config &config : configs)
+    {
+        Result r = run(config, size, reads);
+        std::cout << std::left << std::setw(22) << config.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << r.open_ms << std::setw(16) << r.touch_ns_per_page << std::setw(14) << r.read_ns
+                  << std::setw(12) << r.pmd_mib << " ";
+        if (config.pages == SharedMemPages::Huge)
+            std::cout << (r.huge ? " hugetlbfs" : " no hugetlbfs pages, fell back to transparent");
+        if (config.lock_pages && !r.locked)
+            std::cout << " mlock failed (RLIMIT_MEMLOCK)";
+        std::cout << std::endl;
+    }
+    shm_unlink("/bench_mapping");
+    return 0;
+}
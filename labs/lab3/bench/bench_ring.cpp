@@ -0,0 +1,214 @@
+#include "shared_ring.hpp"
+#include "bench_common.hpp"
+#include <iomanip>
+#include <iostream>
+#include <sched.h>
+#include <sys/socket.h>
+
+// Пропускная способность и задержка передачи записей между двумя процессами:
+// SharedRing (SPSC и MPMC), pipe и Unix-сокет.
+// Запуск: LAB_BENCH_RING [число сообщений] [размер пачки]
+
+namespace
+{
+    struct Message
+    {
+        uint64_t seq;
+        int64_t sent_ns;
+        char payload[48];
+    };
+
+    const size_t RING_SIZE = 4096;
+    const size_t MAX_BATCH = 64;
+    const int SPINS_BEFORE_YIELD = 64;
+
+    struct Result
+    {
+        double msgs_per_sec;
+        double p50_us, p99_us, p999_us;
+        bool ordered;
+    };
+
+    // Читатель пишет сюда задержки каждой записи
+    struct Report
+    {
+        double elapsed_s;
+        bool ordered;
+        size_t samples;
+        float latency_us[1]; // Фактически count элементов
+    };
+
+    Result summarize(Report *report)
+    {
+        std::vector<double> latencies(report->latency_us, report->latency_us + report->samples);
+        Result r;
+        r.msgs_per_sec = report->samples / report->elapsed_s;
+        r.p50_us = bench::percentile(latencies, 50);
+        r.p99_us = bench::percentile(latencies, 99);
+        r.p999_us = bench::percentile(latencies, 99.9);
+        r.ordered = report->ordered;
+        return r;
+    }
+
+    void backoff(int &spins)
+    {
+        if (++spins > SPINS_BEFORE_YIELD)
+        {
+            sched_yield();
+            spins = 0;
+        }
+    }
+
+    // send(batch, n) -> отправлено; recv(batch, max) -> получено
+    template <class Send, class Recv>
+    Result runPair(size_t count, size_t batch, Send send, Recv recv)
+    {
+        size_t report_size = sizeof(Report) + sizeof(float) * count;
+        Report *report = static_cast<Report *>(mmap(nullptr, report_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+
+        bench::runProcesses(2, [&](int id)
+                            {
+            Message buffer[MAX_BATCH];
+            int spins = 0;
+            if (id == 0)
+            {
+                // Писатель
+                uint64_t seq = 0;
+                while (seq < count)
+                {
+                    size_t n = std::min(batch, count - seq);
+                    int64_t now = bench::nowNs();
+                    for (size_t i = 0; i < n; i++)
+                    {
+                        buffer[i].seq = seq + i;
+                        buffer[i].sent_ns = now;
+                    }
+                    size_t sent = 0;
+                    while (sent < n)
+                    {
+                        size_t k = send(buffer + sent, n - sent);
+                        if (k == 0)
+                            backoff(spins);
+                        sent += k;
+                    }
+                    seq += n;
+                }
+                return;
+            }
+
+            // Читатель
+            uint64_t expected = 0;
+            bool ordered = true;
+            int64_t start = 0;
+            while (expected < count)
+            {
+                size_t n = recv(buffer, batch);
+                if (n == 0)
+                {
+                    backoff(spins);
+                    continue;
+                }
+                int64_t now = bench::nowNs();
+                if (start == 0)
+                    start = buffer[0].sent_ns;
+                for (size_t i = 0; i < n; i++)
+                {
+                    ordered = ordered && buffer[i].seq == expected;
+                    report->latency_us[expected] = float((now - buffer[i].sent_ns) / 1000.0);
+                    expected++;
+                }
+            }
+            report->elapsed_s = (bench::nowNs() - start) / 1e9;
+            report->ordered = ordered;
+            report->samples = count; });
+
+        Result result = summarize(report);
+        munmap(report, report_size);
+        return result;
+    }
+
+    // Потоковый дескриптор: сообщения целиком, без разрывов
+    size_t sendFd(int fd, Message *items, size_t n)
+    {
+        size_t bytes = n * sizeof(Message), done = 0;
+        while (done < bytes)
+        {
+            ssize_t k = write(fd, reinterpret_cast<char *>(items) + done, bytes - done);
+            if (k > 0)
+                done += k;
+        }
+        return n;
+    }
+
+    size_t recvFd(int fd, Message *items, size_t max)
+    {
+        ssize_t k = read(fd, items, max * sizeof(Message));
+        if (k <= 0)
+            return 0;
+        size_t done = k;
+        // Дочитываем последнее сообщение, если оно пришло не целиком
+        while (done % sizeof(Message) != 0)
+        {
+            ssize_t more = read(fd, reinterpret_cast<char *>(items) + done, sizeof(Message) - done % sizeof(Message));
+            if (more > 0)
+                done += more;
+        }
+        return done / sizeof(Message);
+    }
+
+    // Потомки получают отображение кольца через fork
+    template <cplib::RingMode Mode>
+    Result runRing(const char *name, size_t count, size_t batch)
+    {
+        cplib::SharedRing<Message, RING_SIZE, Mode> ring(name);
+        return runPair(count, batch, [&](Message *m, size_t n)
+                       { return ring.PushBatch(m, n); },
+                       [&](Message *m, size_t n)
+                       { return ring.PopBatch(m, n); });
+    }
+
+    void print(const char *name, const Result &r)
+    {
+        std::cout << std::setw(12) << name << std::fixed << std::setprecision(0)
+                  << std::setw(14) << r.msgs_per_sec << std::setprecision(1)
+                  << std::setw(10) << r.p50_us << std::setw(10) << r.p99_us << std::setw(10) << r.p999_us
+                  << (r.ordered ? "" : "  (out of order!)") << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    size_t batch = argc > 2 ? std::min<size_t>(std::stoul(argv[2]), MAX_BATCH) : 16;
+
+    std::cout << std::setw(12) << "transport" << std::setw(14) << "msgs/s"
+              << std::setw(10) << "p50, us" << std::setw(10) << "p99, us" << std::setw(10) << "p99.9, us" << std::endl;
+
+    print("spsc ring", runRing<cplib::RingMode::SPSC>("bench_ring_spsc", count, batch));
+    print("mpmc ring", runRing<cplib::RingMode::MPMC>("bench_ring_mpmc", count, batch));
+    {
+        int fds[2];
+        if (pipe(fds) == 0)
+        {
+            print("pipe", runPair(count, batch, [&](Message *m, size_t n)
+                                  { return sendFd(fds[1], m, n); },
+                                  [&](Message *m, size_t n)
+                                  { return recvFd(fds[0], m, n); }));
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0)
+        {
+            print("socket", runPair(count, batch, [&](Message *m, size_t n)
+                                    { return sendFd(fds[1], m, n); },
+                                    [&](Message *m, size_t n)
+                                    { return recvFd(fds[0], m, n); }));
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+    return 0;
+}
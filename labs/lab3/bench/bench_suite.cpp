@@ -0,0 +1,442 @@
+#include "shared_data.hpp"
+#include "shared_counter.hpp"
+#include "bench_common.hpp"
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+// Сводный прогон IPC-слоя lab3 с выводом в JSON, чтобы результаты разных
+// сборок можно было сравнивать скриптом. N процессов в течение заданного времени
+// гоняют один из сценариев:
+//   lock_heavy        - короткая запись под Lock/Unlock SharedMem
+//   read_mostly       - masterPid/getCounter/checkMasterAlive SharedDataManager,
+//                       каждая 64-я операция - heartbeat и инкремент
+//   increment_sharded - incrementCounter SharedDataManager (слоты процессов)
+//   increment_atomic  - increment SharedCounter (один атомик)
+// Затем мастера раз за разом убивают и замеряют время перехода аренды.
+// Латентность измеряется у каждой SAMPLE_EVERY-й операции, чтобы вызовы часов
+// не съедали пропускную способность коротких операций.
+// Запуск: LAB_BENCH_SUITE [длительность сценария, мс] [убийств мастера] [число процессов ...]
+
+namespace
+{
+    const int HIST_BUCKETS = 40; // Корзина b - [2^b, 2^(b+1)) нс
+    const int SAMPLE_EVERY = 16;
+    const int BATCH = 256; // Операций между проверками срока
+    const int READ_RATIO = 64;
+    const int FAILOVER_CANDIDATES = 4;
+    const int FAILOVER_LEASES_MS[] = {50, 200};
+
+    const char *LOCK_SEGMENT = "bench_suite_lock";
+    const char *DATA_SEGMENT = "bench_suite_data";
+    const char *ATOMIC_SEGMENT = "bench_suite_atomic";
+    const char *FAILOVER_SEGMENT = "bench_suite_failover";
+    const char *FAILOVER_SEGMENT_PATH = "/bench_suite_failover";
+
+    struct LockRecord
+    {
+        LockRecord() : value(0), fields() {}
+        long long value;
+        long long fields[8]; // Запись в несколько кэш-линий, как у реального состояния
+    };
+
+    struct Histogram
+    {
+        uint64_t buckets[HIST_BUCKETS];
+
+        void add(int64_t ns)
+        {
+            int bucket = 0;
+            while (bucket < HIST_BUCKETS - 1 && (int64_t(2) << bucket) <= ns)
+                bucket++;
+            buckets[bucket]++;
+        }
+
+        void merge(const Histogram &other)
+        {
+            for (int i = 0; i < HIST_BUCKETS; ++i)
+                buckets[i] += other.buckets[i];
+        }
+
+        uint64_t total() const
+        {
+            uint64_t sum = 0;
+            for (uint64_t count : buckets)
+                sum += count;
+            return sum;
+        }
+
+        // Верхняя граница корзины, в которую попал перцентиль
+        int64_t percentile(double p) const
+        {
+            uint64_t all = total();
+            if (all == 0)
+                return 0;
+            uint64_t rank = uint64_t(p / 100.0 * (all - 1)) + 1;
+            uint64_t seen = 0;
+            for (int i = 0; i < HIST_BUCKETS; ++i)
+            {
+                seen += buckets[i];
+                if (seen >= rank)
+                    return int64_t(2) << i;
+            }
+            return int64_t(2) << (HIST_BUCKETS - 1);
+        }
+    };
+
+    // Результат одного процесса; лежит в анонимной общей памяти
+    struct ProcessResult
+    {
+        int64_t ops;
+        int64_t elapsed_ns;
+        Histogram latency;
+    };
+
+    struct ScenarioResult
+    {
+        std::string name;
+        int processes;
+        int64_t ops;
+        double ops_per_sec;
+        bool correct;
+        Histogram latency;
+    };
+
+    std::atomic<int> *arrived;
+
+    // Каждый процесс создаёт своё подключение (setup), ждёт остальных и выполняет
+    // op(state, i), пока не выйдет время
+    template <class Setup, class Op>
+    ScenarioResult runScenario(const std::string &name, int processes, int duration_ms, Setup setup, Op op)
+    {
+        ProcessResult *results = bench::sharedArray<ProcessResult>(processes);
+        arrived->store(0);
+        int64_t duration_ns = int64_t(duration_ms) * 1000000;
+        bench::runProcesses(processes, [&](int id)
+                            {
+            auto state = setup();
+            ProcessResult &result = results[id];
+            bench::barrier(*arrived, processes);
+            int64_t start = bench::nowNs();
+            int64_t ops = 0;
+            do
+            {
+                for (int k = 0; k < BATCH; ++k, ++ops)
+                {
+                    if (ops % SAMPLE_EVERY == 0)
+                    {
+                        int64_t before = bench::nowNs();
+                        op(*state, ops);
+                        result.latency.add(bench::nowNs() - before);
+                    }
+                    else
+                        op(*state, ops);
+                }
+            } while (bench::nowNs() - start < duration_ns);
+            result.ops = ops;
+            result.elapsed_ns = bench::nowNs() - start; });
+
+        ScenarioResult total = {name, processes, 0, 0, true, Histogram()};
+        int64_t longest = 1;
+        for (int i = 0; i < processes; ++i)
+        {
+            total.ops += results[i].ops;
+            longest = std::max(longest, results[i].elapsed_ns);
+            total.latency.merge(results[i].latency);
+        }
+        total.ops_per_sec = total.ops / (longest / 1e9);
+        bench::freeSharedArray(results, processes);
+        return total;
+    }
+
+    ScenarioResult runLockHeavy(int processes, int duration_ms)
+    {
+        cplib::SharedMem<LockRecord> mem(LOCK_SEGMENT);
+        mem.Data()->value = 0;
+        ScenarioResult result = runScenario(
+            "lock_heavy", processes, duration_ms, []
+            { return std::make_unique<cplib::SharedMem<LockRecord>>(LOCK_SEGMENT, false); },
+            [](cplib::SharedMem<LockRecord> &m, int64_t i)
+            {
+                m.Lock();
+                LockRecord *record = m.Data();
+                record->value++;
+                for (long long &field : record->fields)
+                    field = i;
+                m.Unlock();
+            });
+        result.correct = mem.Data()->value == result.ops;
+        return result;
+    }
+
+    ScenarioResult runReadMostly(int processes, int duration_ms)
+    {
+        cplib::SharedDataManager data(DATA_SEGMENT);
+        data.setCounter(0);
+        ScenarioResult result = runScenario(
+            "read_mostly", processes, duration_ms, [&]
+            {
+                auto manager = std::make_unique<cplib::SharedDataManager>(DATA_SEGMENT);
+                manager->registerConnection();
+                return manager; },
+            [](cplib::SharedDataManager &mgr, int64_t i)
+            {
+                if (i % READ_RATIO == 0)
+                {
+                    mgr.heartbeat();
+                    mgr.incrementCounter();
+                    return;
+                }
+                volatile int64_t sink = mgr.masterPid() + mgr.getCounter() + mgr.checkMasterAlive();
+                (void)sink;
+            });
+        // Каждый процесс выполняет целое число пачек по BATCH - инкрементов ровно ops / READ_RATIO
+        result.correct = data.getCounter() == result.ops / READ_RATIO;
+        return result;
+    }
+
+    ScenarioResult runIncrementSharded(int processes, int duration_ms)
+    {
+        cplib::SharedDataManager data(DATA_SEGMENT);
+        data.setCounter(0);
+        ScenarioResult result = runScenario(
+            "increment_sharded", processes, duration_ms, []
+            { return std::make_unique<cplib::SharedDataManager>(DATA_SEGMENT); },
+            [](cplib::SharedDataManager &mgr, int64_t)
+            { mgr.incrementCounter(); });
+        result.correct = data.getCounter() == result.ops;
+        return result;
+    }
+
+    ScenarioResult runIncrementAtomic(int processes, int duration_ms)
+    {
+        cplib::SharedCounter counter(ATOMIC_SEGMENT);
+        counter.setValue(0);
+        ScenarioResult result = runScenario(
+            "increment_atomic", processes, duration_ms, []
+            { return std::make_unique<cplib::SharedCounter>(ATOMIC_SEGMENT); },
+            [](cplib::SharedCounter &c, int64_t)
+            { c.increment(); });
+        result.correct = counter.getValue() == result.ops;
+        return result;
+    }
+
+    // Переход аренды: как в LAB_BENCH_FAILOVER, кандидаты ведут себя как Application
+    struct Takeover
+    {
+        std::atomic<uint32_t> epoch;
+        std::atomic<int64_t> at_ns;
+    };
+
+    struct FailoverResult
+    {
+        int lease_ms;
+        int kills;
+        int missed;
+        std::vector<double> failover_ms;
+    };
+
+    void candidate(Takeover *takeover)
+    {
+        cplib::SharedDataManager manager(FAILOVER_SEGMENT);
+        bool master = false;
+        while (true)
+        {
+            uint32_t seen = manager.stateVersion();
+            if (master)
+                master = manager.renewLease();
+            else if (manager.isMaster())
+            {
+                master = true;
+                takeover->at_ns.store(bench::nowNs());
+                takeover->epoch.store(manager.masterEpoch());
+            }
+            manager.waitStateChange(seen, manager.nextCheckDelay());
+        }
+    }
+
+    pid_t spawnCandidate(Takeover *takeover)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            candidate(takeover);
+            _exit(0);
+        }
+        return pid;
+    }
+
+    bool waitTakeover(Takeover *takeover, uint32_t epoch, int64_t timeout_ns)
+    {
+        int64_t deadline = bench::nowNs() + timeout_ns;
+        while (takeover->epoch.load() == epoch)
+        {
+            if (bench::nowNs() > deadline)
+                return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+
+    FailoverResult runFailover(int lease, int kills)
+    {
+        FailoverResult result = {lease, kills, 0, {}};
+        Takeover *takeover = bench::sharedArray<Takeover>(1);
+        takeover->epoch.store(0);
+
+        // Убитые кандидаты не снимают регистрацию в сегменте - удаляем его явно
+        shm_unlink(FAILOVER_SEGMENT_PATH);
+        {
+            cplib::SharedDataManager observer(FAILOVER_SEGMENT);
+            observer.setLeaseDuration(std::chrono::milliseconds(lease));
+
+            std::vector<pid_t> pids;
+            for (int i = 0; i < FAILOVER_CANDIDATES; ++i)
+                pids.push_back(spawnCandidate(takeover));
+
+            int64_t timeout = int64_t(lease) * 20 * 1000000;
+            for (int k = 0; k < kills; ++k)
+            {
+                uint32_t epoch = takeover->epoch.load();
+                int master = observer.masterPid();
+                if (master == 0)
+                {
+                    waitTakeover(takeover, epoch, timeout);
+                    master = observer.masterPid();
+                    epoch = takeover->epoch.load();
+                    if (master == 0)
+                    {
+                        result.missed++;
+                        continue;
+                    }
+                }
+
+                int64_t killed_at = bench::nowNs();
+                kill(master, SIGKILL);
+                waitpid(master, nullptr, 0);
+                if (waitTakeover(takeover, epoch, timeout))
+                    result.failover_ms.push_back((takeover->at_ns.load() - killed_at) / 1e6);
+                else
+                    result.missed++;
+
+                // Замена убитому
+                for (pid_t &pid : pids)
+                    if (pid == master)
+                        pid = spawnCandidate(takeover);
+            }
+
+            for (pid_t pid : pids)
+            {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+            }
+        }
+        shm_unlink(FAILOVER_SEGMENT_PATH);
+        bench::freeSharedArray(takeover, 1);
+        return result;
+    }
+
+    void writeHistogram(std::ostream &out, const Histogram &histogram)
+    {
+        out << "{\"samples\": " << histogram.total()
+            << ", \"p50\": " << histogram.percentile(50)
+            << ", \"p90\": " << histogram.percentile(90)
+            << ", \"p99\": " << histogram.percentile(99)
+            << ", \"p999\": " << histogram.percentile(99.9)
+            << ", \"max\": " << histogram.percentile(100)
+            << ", \"buckets\": [";
+        bool first = true;
+        for (int i = 0; i < HIST_BUCKETS; ++i)
+        {
+            if (histogram.buckets[i] == 0)
+                continue;
+            out << (first ? "" : ", ") << "{\"le\": " << (int64_t(2) << i) << ", \"count\": " << histogram.buckets[i] << "}";
+            first = false;
+        }
+        out << "]}";
+    }
+
+    void writeScenario(std::ostream &out, const ScenarioResult &result)
+    {
+        char rate[32];
+        std::snprintf(rate, sizeof(rate), "%.0f", result.ops_per_sec);
+        out << "    {\"scenario\": \"" << result.name << "\", \"processes\": " << result.processes
+            << ", \"ops\": " << result.ops << ", \"ops_per_sec\": " << rate
+            << ", \"correct\": " << (result.correct ? "true" : "false") << ",\n     \"latency_ns\": ";
+        writeHistogram(out, result.latency);
+        out << "}";
+    }
+
+    void writeFailover(std::ostream &out, FailoverResult &result)
+    {
+        std::vector<double> &samples = result.failover_ms;
+        // percentile сортирует выборку - максимум берём после
+        double p50 = bench::percentile(samples, 50);
+        double p99 = bench::percentile(samples, 99);
+        double max = samples.empty() ? 0.0 : samples.back();
+        char stats[160];
+        std::snprintf(stats, sizeof(stats), "\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f", p50, p99, max);
+        out << "    {\"lease_ms\": " << result.lease_ms << ", \"kills\": " << result.kills
+            << ", \"missed\": " << result.missed << ", \"failover_ms\": {" << stats << ", \"samples\": [";
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            char sample[32];
+            std::snprintf(sample, sizeof(sample), "%.3f", samples[i]);
+            out << (i ? ", " : "") << sample;
+        }
+        out << "]}}";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int duration_ms = argc > 1 ? std::stoi(argv[1]) : 1000;
+    int kills = argc > 2 ? std::stoi(argv[2]) : 10;
+    std::vector<int> counts = bench::parseCounts(argc, argv, 3, {1, 2, 4, 8});
+    arrived = bench::sharedArray<std::atomic<int>>(1);
+
+    // Прогресс - в stderr, stdout остаётся чистым JSON
+    std::vector<ScenarioResult> scenarios;
+    for (int processes : counts)
+    {
+        std::cerr << "processes: " << processes << std::endl;
+        scenarios.push_back(runLockHeavy(processes, duration_ms));
+        scenarios.push_back(runReadMostly(processes, duration_ms));
+        scenarios.push_back(runIncrementSharded(processes, duration_ms));
+        scenarios.push_back(runIncrementAtomic(processes, duration_ms));
+    }
+
+    std::vector<FailoverResult> failovers;
+    for (int lease : FAILOVER_LEASES_MS)
+    {
+        std::cerr << "failover, lease " << lease << " ms" << std::endl;
+        failovers.push_back(runFailover(lease, kills));
+    }
+
+    std::ostringstream out;
+    out << "{\n  \"duration_ms\": " << duration_ms << ",\n  \"sample_every\": " << SAMPLE_EVERY
+        << ",\n  \"scenarios\": [\n";
+    for (size_t i = 0; i < scenarios.size(); ++i)
+    {
+        writeScenario(out, scenarios[i]);
+        out << (i + 1 < scenarios.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"failover\": [\n";
+    for (size_t i = 0; i < failovers.size(); ++i)
+    {
+        writeFailover(out, failovers[i]);
+        out << (i + 1 < failovers.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    std::cout << out.str();
+
+    bool correct = true;
+    for (const ScenarioResult &result : scenarios)
+        correct = correct && result.correct;
+    bench::freeSharedArray(arrived, 1);
+    // Потерянные операции - ошибка прогона, скрипт сравнения увидит её по коду выхода
+    return correct ? 0 : 1;
+}
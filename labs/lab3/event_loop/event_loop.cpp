@@ -0,0 +1,311 @@
+#include "event_loop.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace cplib
+{
+
+    namespace
+    {
+        const int MAX_EVENTS = 64;
+
+        int64_t monotonicNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        bool addToEpoll(int epoll_fd, int fd)
+        {
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+        }
+
+        void drainCounter(int fd)
+        {
+            uint64_t value;
+            while (read(fd, &value, sizeof(value)) < 0 && errno == EINTR)
+            {
+            }
+        }
+    }
+
+    EventLoop::EventLoop(std::chrono::milliseconds resolution)
+        : start_ns_(monotonicNs()),
+          resolution_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(std::max(resolution, std::chrono::milliseconds(1))).count())
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (!isValid() || !addToEpoll(epoll_fd_, timer_fd_) || !addToEpoll(epoll_fd_, wake_fd_))
+        {
+            // isValid() будет false
+            if (epoll_fd_ >= 0)
+                close(epoll_fd_);
+            epoll_fd_ = -1;
+        }
+    }
+
+    EventLoop::~EventLoop()
+    {
+        if (epoll_fd_ >= 0)
+            close(epoll_fd_);
+        if (timer_fd_ >= 0)
+            close(timer_fd_);
+        if (wake_fd_ >= 0)
+            close(wake_fd_);
+    }
+
+    bool EventLoop::isValid() const
+    {
+        return epoll_fd_ >= 0 && timer_fd_ >= 0 && wake_fd_ >= 0;
+    }
+
+    uint64_t EventLoop::nowTick() const
+    {
+        return static_cast<uint64_t>((monotonicNs() - start_ns_) / resolution_ns_);
+    }
+
+    EventLoop::TimerId EventLoop::addTimer(std::chrono::milliseconds delay, Callback callback)
+    {
+        return addTimer(std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count(), 0, std::move(callback));
+    }
+
+    EventLoop::TimerId EventLoop::addPeriodic(std::chrono::milliseconds period, Callback callback)
+    {
+        int64_t period_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count();
+        uint64_t ticks = std::max<int64_t>((period_ns + resolution_ns_ - 1) / resolution_ns_, 1);
+        return addTimer(period_ns, ticks, std::move(callback));
+    }
+
+    EventLoop::TimerId EventLoop::addTimer(int64_t delay_ns, uint64_t period, Callback callback)
+    {
+        TimerId id = next_id_++;
+        // Вверх до границы тика: таймер не срабатывает раньше срока
+        int64_t at = monotonicNs() - start_ns_ + std::max<int64_t>(delay_ns, 0);
+        uint64_t expires = std::max(static_cast<uint64_t>((at + resolution_ns_ - 1) / resolution_ns_), current_);
+        timers_[id] = Timer{expires, period, std::move(callback)};
+        place(id, expires);
+        return id;
+    }
+
+    void EventLoop::cancel(TimerId id)
+    {
+        timers_.erase(id);
+    }
+
+    // Уровень - первый, на котором срок попадает в ближайшие 64 слота. Слот уровня k
+    // перекладывается на уровни ниже, когда до него доходит current_
+    void EventLoop::place(TimerId id, uint64_t expires)
+    {
+        expires = std::max(expires, current_);
+        int level = 0;
+        uint64_t slot = 0;
+        for (; level < WHEEL_LEVELS; ++level)
+        {
+            int shift = level * WHEEL_BITS;
+            if ((expires >> shift) - (current_ >> shift) < WHEEL_SLOTS)
+            {
+                slot = (expires >> shift) & (WHEEL_SLOTS - 1);
+                break;
+            }
+        }
+        if (level == WHEEL_LEVELS)
+        {
+            // За горизонтом колеса: в самый дальний слот верхнего уровня, оттуда - ещё раз
+            level = WHEEL_LEVELS - 1;
+            slot = ((current_ >> (level * WHEEL_BITS)) + WHEEL_SLOTS - 1) & (WHEEL_SLOTS - 1);
+        }
+        wheel_[level][slot].push_back(id);
+        occupied_[level] |= uint64_t(1) << slot;
+    }
+
+    uint64_t EventLoop::nextTick() const
+    {
+        uint64_t next = UINT64_MAX;
+        for (int level = 0; level < WHEEL_LEVELS; ++level)
+        {
+            int shift = level * WHEEL_BITS;
+            // Первый ещё не переложенный блок уровня
+            uint64_t first = (current_ + (uint64_t(1) << shift) - 1) >> shift;
+            for (uint64_t bits = occupied_[level]; bits != 0; bits &= bits - 1)
+            {
+                uint64_t slot = __builtin_ctzll(bits);
+                uint64_t block = first + ((slot - first) & (WHEEL_SLOTS - 1));
+                next = std::min(next, block << shift);
+            }
+        }
+        return next;
+    }
+
+    void EventLoop::advance(uint64_t now)
+    {
+        now_ = now;
+        for (uint64_t tick = nextTick(); tick <= now; tick = nextTick())
+        {
+            current_ = tick;
+            processTick(tick);
+        }
+        // Между обработанными тиками - только пустые слоты
+        current_ = std::max(current_, now + 1);
+    }
+
+    void EventLoop::processTick(uint64_t tick)
+    {
+        // Сначала верхние уровни: их таймеры могут попасть в слот этого же тика
+        for (int level = WHEEL_LEVELS - 1; level > 0; --level)
+        {
+            int shift = level * WHEEL_BITS;
+            if ((tick & ((uint64_t(1) << shift) - 1)) != 0)
+                continue;
+            uint64_t slot = (tick >> shift) & (WHEEL_SLOTS - 1);
+            std::vector<TimerId> ids;
+            ids.swap(wheel_[level][slot]);
+            occupied_[level] &= ~(uint64_t(1) << slot);
+            for (TimerId id : ids)
+            {
+                auto it = timers_.find(id);
+                if (it != timers_.end())
+                    place(id, it->second.expires);
+            }
+        }
+
+        uint64_t slot = tick & (WHEEL_SLOTS - 1);
+        std::vector<TimerId> ids;
+        ids.swap(wheel_[0][slot]);
+        occupied_[0] &= ~(uint64_t(1) << slot);
+        // Таймеры, добавленные обработчиками, уже не попадут в этот тик
+        current_ = tick + 1;
+        for (TimerId id : ids)
+        {
+            auto it = timers_.find(id);
+            if (it == timers_.end())
+                continue;
+            Timer &timer = it->second;
+            if (timer.period == 0)
+            {
+                Callback callback = std::move(timer.callback);
+                timers_.erase(it);
+                callback();
+                continue;
+            }
+            // Перевзвод до вызова: обработчик может отменить свой таймер
+            timer.expires += timer.period;
+            if (timer.expires <= now_)
+                timer.expires += (now_ - timer.expires) / timer.period * timer.period + timer.period;
+            place(id, timer.expires);
+            Callback callback = timer.callback;
+            callback();
+        }
+    }
+
+    void EventLoop::armTimer()
+    {
+        uint64_t next = nextTick();
+        if (next == armed_)
+            return;
+        armed_ = next;
+        itimerspec spec = {};
+        if (next != UINT64_MAX)
+        {
+            int64_t at = start_ns_ + static_cast<int64_t>(next) * resolution_ns_;
+            spec.it_value.tv_sec = at / 1000000000;
+            spec.it_value.tv_nsec = at % 1000000000;
+        }
+        // Нулевое время снимает таймер
+        timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, NULL);
+    }
+
+    bool EventLoop::watch(int fd, Callback on_readable)
+    {
+        if (!addToEpoll(epoll_fd_, fd))
+            return false;
+        watches_[fd] = std::move(on_readable);
+        return true;
+    }
+
+    void EventLoop::unwatch(int fd)
+    {
+        if (watches_.erase(fd) > 0)
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+    }
+
+    void EventLoop::post(Callback callback)
+    {
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex_);
+            posted_.push_back(std::move(callback));
+        }
+        uint64_t one = 1;
+        while (write(wake_fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    void EventLoop::runPosted()
+    {
+        std::vector<Callback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex_);
+            callbacks.swap(posted_);
+        }
+        for (Callback &callback : callbacks)
+            callback();
+    }
+
+    void EventLoop::stop()
+    {
+        stopped_ = true;
+        uint64_t one = 1;
+        while (write(wake_fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    void EventLoop::run()
+    {
+        if (!isValid())
+            return;
+        epoll_event events[MAX_EVENTS];
+        while (!stopped_)
+        {
+            armTimer();
+            int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+            if (count < 0 && errno != EINTR)
+                break;
+            for (int i = 0; i < count && !stopped_; ++i)
+            {
+                int fd = events[i].data.fd;
+                if (fd == timer_fd_)
+                {
+                    drainCounter(timer_fd_);
+                    armed_ = UINT64_MAX;
+                }
+                else if (fd == wake_fd_)
+                {
+                    drainCounter(wake_fd_);
+                    runPosted();
+                }
+                else
+                {
+                    // Копия: обработчик может снять свой же fd
+                    auto it = watches_.find(fd);
+                    if (it == watches_.end())
+                        continue;
+                    Callback callback = it->second;
+                    callback();
+                }
+            }
+            if (!stopped_)
+                advance(nowTick());
+        }
+    }
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cplib
+{
+
+    // Однопоточный цикл событий (Linux): epoll по дескрипторам и таймеры на
+    // иерархическом колесе. Один timerfd взведён на ближайший непустой слот, поэтому
+    // без таймеров и событий поток спит. Обработчики выполняются в потоке run();
+    // из других потоков можно вызывать только post() и stop()
+    class EventLoop
+    {
+    public:
+        using Callback = std::function<void()>;
+        using TimerId = uint64_t; // 0 - нет таймера
+
+        explicit EventLoop(std::chrono::milliseconds resolution = std::chrono::milliseconds(1));
+        ~EventLoop();
+        EventLoop(const EventLoop &) = delete;
+        EventLoop &operator=(const EventLoop &) = delete;
+
+        bool isValid() const;
+
+        TimerId addTimer(std::chrono::milliseconds delay, Callback callback);
+        // Следующий срок отсчитывается от планового момента предыдущего, а не от конца
+        // обработчика - опоздания не накапливаются. Пропущенные сроки не догоняются
+        TimerId addPeriodic(std::chrono::milliseconds period, Callback callback);
+        void cancel(TimerId id);
+
+        // Обработчик вызывается, пока в fd есть данные (level-triggered)
+        bool watch(int fd, Callback on_readable);
+        void unwatch(int fd);
+
+        void post(Callback callback);
+        void run(); // До stop()
+        void stop();
+
+    private:
+        static const int WHEEL_LEVELS = 4;
+        static const int WHEEL_BITS = 6;
+        static const uint64_t WHEEL_SLOTS = 1 << WHEEL_BITS; // 4 уровня по 64 слота - 2^24 тиков
+
+        struct Timer
+        {
+            uint64_t expires; // Тик срабатывания
+            uint64_t period;  // 0 - однократный
+            Callback callback;
+        };
+
+        uint64_t nowTick() const;
+        TimerId addTimer(int64_t delay_ns, uint64_t period, Callback callback);
+        void place(TimerId id, uint64_t expires);
+        uint64_t nextTick() const; // UINT64_MAX - таймеров нет
+        void advance(uint64_t now);
+        void processTick(uint64_t tick);
+        void armTimer();
+        void runPosted();
+
+        int epoll_fd_ = -1;
+        int timer_fd_ = -1;
+        int wake_fd_ = -1;
+        std::atomic<bool> stopped_{false};
+
+        int64_t start_ns_;
+        int64_t resolution_ns_;
+        uint64_t current_ = 0; // Первый ещё не обработанный тик
+        uint64_t now_ = 0;     // Тик, до которого идёт обработка
+        uint64_t armed_ = UINT64_MAX;
+        TimerId next_id_ = 1;
+        std::unordered_map<TimerId, Timer> timers_;
+        // Отменённые таймеры остаются в слотах и пропускаются при обработке
+        std::vector<TimerId> wheel_[WHEEL_LEVELS][WHEEL_SLOTS];
+        uint64_t occupied_[WHEEL_LEVELS] = {}; // Бит на непустой слот
+
+        std::unordered_map<int, Callback> watches_;
+        std::mutex posted_mutex_;
+        std::vector<Callback> posted_;
+    };
+
+}
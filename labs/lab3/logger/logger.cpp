@@ -1,22 +1,396 @@
 #include "logger.hpp"
+#include "shared_ring.hpp"
 #include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <unordered_map>
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#endif
 
 namespace cplib
 {
 
-    Logger::Logger(const std::string &filename)
+    namespace
+    {
+        const size_t MIN_QUEUE_SIZE = 4096;
+        const size_t RECORD_ALIGN = 8;
+
+        // Запись в очереди: заголовок и аргументы, вместе выровнены на RECORD_ALIGN
+        struct RecordHeader
+        {
+            int64_t time_ns;
+            uint64_t length;
+            uint64_t format;
+            const char *text;
+            int64_t level;
+        };
+
+        // Простое сообщение log() - формат из одной строки
+        const LogFormat PLAIN_FORMAT = CPLIB_LOG_FORMAT("{}");
+        const size_t STRING_ARG_OVERHEAD = 1 + sizeof(uint32_t);
+
+        void encodeString(std::string &out, const char *data, size_t size)
+        {
+            uint32_t length = static_cast<uint32_t>(size);
+            out += 's';
+            out.append(reinterpret_cast<const char *>(&length), sizeof(length));
+            out.append(data, size);
+        }
+
+        // Подставить следующий аргумент; false - аргументы кончились или испорчены
+        bool appendArg(std::string &out, const char *args, size_t size, size_t &pos)
+        {
+            if (pos >= size)
+                return false;
+            char tag = args[pos++];
+            char number[32];
+            if (tag == 'i' && pos + sizeof(int64_t) <= size)
+            {
+                int64_t value;
+                memcpy(&value, args + pos, sizeof(value));
+                snprintf(number, sizeof(number), "%lld", static_cast<long long>(value));
+            }
+            else if (tag == 'u' && pos + sizeof(uint64_t) <= size)
+            {
+                uint64_t value;
+                memcpy(&value, args + pos, sizeof(value));
+                snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(value));
+            }
+            else if (tag == 'f' && pos + sizeof(double) <= size)
+            {
+                double value;
+                memcpy(&value, args + pos, sizeof(value));
+                snprintf(number, sizeof(number), "%g", value);
+            }
+            else if (tag == 's' && pos + sizeof(uint32_t) <= size)
+            {
+                uint32_t length;
+                memcpy(&length, args + pos, sizeof(length));
+                pos += sizeof(length);
+                if (pos + length > size)
+                    return false;
+                out.append(args + pos, length);
+                pos += length;
+                return true;
+            }
+            else
+                return false;
+            pos += 8;
+            out += number;
+            return true;
+        }
+
+        // Текст формата с аргументами на месте {}
+        void formatArgs(std::string &out, const char *format, const char *args, size_t size)
+        {
+            size_t pos = 0;
+            for (const char *p = format; *p != 0; ++p)
+            {
+                if (p[0] == '{' && p[1] == '}')
+                {
+                    if (!appendArg(out, args, size, pos))
+                        out += "{}";
+                    ++p;
+                }
+                else
+                    out += *p;
+            }
+        }
+
+        const char *logLevelTag(LogLevel level)
+        {
+            switch (level)
+            {
+            case LogLevel::Debug:
+                return "[DEBUG] ";
+            case LogLevel::Info:
+                return "[INFO] ";
+            case LogLevel::Warning:
+                return "[WARNING] ";
+            case LogLevel::Error:
+                return "[ERROR] ";
+            default:
+                return "";
+            }
+        }
+
+        // Строка журнала. Дата и время форматируются раз в секунду, а не на каждую строку
+        void appendLogLine(std::string &out, int64_t &cachedSecond, std::string &cachedPrefix,
+                           int64_t time_ns, int pid, LogLevel level, const char *format, const char *args, size_t size)
+        {
+            int64_t second = time_ns / 1000000000;
+            if (second != cachedSecond)
+            {
+                std::time_t time = static_cast<std::time_t>(second);
+                std::tm tm;
+#if defined(_WIN32)
+                localtime_s(&tm, &time);
+#else
+                localtime_r(&time, &tm);
+#endif
+                std::stringstream ss;
+                ss << "[" << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+                cachedPrefix = ss.str();
+                cachedSecond = second;
+            }
+            char tag[32];
+            snprintf(tag, sizeof(tag), ".%03d] PID %d: ", static_cast<int>(time_ns / 1000000 % 1000), pid);
+            out += cachedPrefix;
+            out += tag;
+            out += logLevelTag(level);
+            if (format != NULL)
+                formatArgs(out, format, args, size);
+            else
+                out += "<unknown format>";
+            out += '\n';
+        }
+
+        // Двоичный журнал - последовательность записей: вид, длина остатка, номер формата.
+        // 'D' - текст формата, до первой записи с ним от каждого пишущего;
+        // 'R' - время, PID и аргументы; 'L' - то же с уровнем (int32) после PID
+        const char BINARY_FORMAT = 'D';
+        const char BINARY_RECORD = 'R';
+        const char BINARY_LEVEL_RECORD = 'L';
+
+        template <class T>
+        void appendValue(std::string &out, T value)
+        {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        size_t alignRecord(size_t size)
+        {
+            return (size + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+        }
+
+        int64_t wallClockNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+        int64_t monotonicNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        // Режим Shared: запись фиксированного размера, длинный текст обрезается
+        const size_t SHARED_DATA_SIZE = 232;
+        const size_t SHARED_RING_SLOTS = 4096;
+        const int SHARED_PUSH_ATTEMPTS = 1000;
+        const int64_t DRAIN_LEASE_NS = 1000000000LL;
+        const size_t SHARED_FORMAT_SLOTS = 256;
+        const size_t SHARED_FORMAT_SIZE = 240;
+        const int SHARED_FORMAT_WAIT_STEPS = 1000;
+
+        struct SharedRecord
+        {
+            int64_t time_ns;
+            int32_t pid;
+            uint16_t length;
+            uint16_t level;
+            uint64_t format;
+            char data[SHARED_DATA_SIZE]; // Аргументы
+        };
+        static_assert(LogArgs::CAPACITY <= SHARED_DATA_SIZE, "structured arguments must fit a shared record");
+
+        // Текст формата по номеру: пишущий кольцо форматирует записи других процессов
+        struct SharedFormat
+        {
+            std::atomic<uint64_t> id; // 0 - слот свободен
+            std::atomic<int> ready;   // Текст дописан
+            char text[SHARED_FORMAT_SIZE];
+        };
+
+        // Кто из процессов пишет кольцо в файл: аренда с пульсом, как у мастера в SharedDataManager
+        struct SharedLogState
+        {
+            SharedLogState() : owner(0), heartbeat_ns(0)
+            {
+                for (auto &format : formats)
+                {
+                    format.id.store(0);
+                    format.ready.store(0);
+                }
+            }
+            std::atomic<uint64_t> owner;       // Эпоха << 32 | PID, PID 0 - никто
+            std::atomic<int64_t> heartbeat_ns; // steady_clock, 0 - аренда отпущена
+            SharedFormat formats[SHARED_FORMAT_SLOTS]; // Открытая адресация, только добавление
+        };
+
+        uint64_t nextOwner(uint64_t owner, int pid) { return ((owner >> 32) + 1) << 32 | static_cast<uint32_t>(pid); }
+
+        // Имя объекта общей памяти из имени файла: только буквы, цифры и '_'
+        std::string sharedNameFor(const std::string &filename)
+        {
+            std::string name = "log_";
+            for (char c : filename)
+                name += isalnum(static_cast<unsigned char>(c)) ? c : '_';
+            return name;
+        }
+    }
+
+    struct Logger::SharedTransport
+    {
+        explicit SharedTransport(const std::string &name)
+            : ring((name + "_ring").c_str()), state((name + "_drain").c_str()) {}
+
+        // Добавить текст формата в общую таблицу; false - таблица полна или текст длинный.
+        // Уже известный формат - одно чтение
+        bool registerFormat(const LogFormat &format)
+        {
+            SharedFormat *formats = state.Data()->formats;
+            for (size_t i = 0; i < SHARED_FORMAT_SLOTS; ++i)
+            {
+                SharedFormat &slot = formats[(format.id + i) % SHARED_FORMAT_SLOTS];
+                uint64_t id = slot.id.load(std::memory_order_acquire);
+                if (id == 0)
+                {
+                    size_t length = strlen(format.text);
+                    if (length >= SHARED_FORMAT_SIZE)
+                        return false;
+                    if (slot.id.compare_exchange_strong(id, format.id))
+                    {
+                        memcpy(slot.text, format.text, length + 1);
+                        slot.ready.store(1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                if (id == format.id)
+                    return true;
+            }
+            return false;
+        }
+
+        const char *findFormat(uint64_t id)
+        {
+            SharedFormat *formats = state.Data()->formats;
+            for (size_t i = 0; i < SHARED_FORMAT_SLOTS; ++i)
+            {
+                SharedFormat &slot = formats[(id + i) % SHARED_FORMAT_SLOTS];
+                uint64_t slotId = slot.id.load(std::memory_order_acquire);
+                if (slotId == 0)
+                    return NULL;
+                if (slotId != id)
+                    continue;
+                // Слот занят, но текст ещё копируется
+                for (int step = 0; step < SHARED_FORMAT_WAIT_STEPS && !slot.ready.load(std::memory_order_acquire); ++step)
+                    std::this_thread::yield();
+                return slot.ready.load(std::memory_order_acquire) ? slot.text : NULL;
+            }
+            return NULL;
+        }
+
+        SharedRing<SharedRecord, SHARED_RING_SLOTS, RingMode::MPMC> ring;
+        SharedMem<SharedLogState> state; // Его событие будит пишущего
+    };
+
+    // Очередь одного потока (один писатель - этот поток, один читатель - фоновый):
+    // запись - две копии памяти и одна атомарная публикация, без блокировок
+    struct Logger::ThreadQueue
+    {
+        explicit ThreadQueue(size_t size) : buffer(size), mask(size - 1) {}
+
+        void copyIn(uint64_t position, const void *data, size_t size)
+        {
+            size_t offset = position & mask;
+            size_t first = std::min(size, buffer.size() - offset);
+            memcpy(&buffer[offset], data, first);
+            memcpy(&buffer[0], static_cast<const char *>(data) + first, size - first);
+        }
+
+        void copyOut(uint64_t position, void *data, size_t size) const
+        {
+            size_t offset = position & mask;
+            size_t first = std::min(size, buffer.size() - offset);
+            memcpy(data, &buffer[offset], first);
+            memcpy(static_cast<char *>(data) + first, &buffer[0], size - first);
+        }
+
+        alignas(64) std::atomic<uint64_t> head{0}; // Сдвигает фоновый поток
+        alignas(64) std::atomic<uint64_t> tail{0}; // Сдвигает владелец
+        uint64_t cachedHead = 0;                   // Копия head у владельца
+        std::vector<char> buffer;
+        size_t mask;
+    };
+
+    Logger::Logger(const std::string &filename, const LoggerOptions &options) : options(options)
     {
 #if defined(_WIN32)
         processId = GetCurrentProcessId();
 #else
         processId = getpid();
 #endif
+        static std::atomic<uint64_t> nextInstanceId{1};
+        instanceId = nextInstanceId++;
+
+        if (options.mode == LogMode::Sync)
+        {
+            logFile.open(filename, options.binary ? std::ios::app | std::ios::binary : std::ios::app);
+            return;
+        }
+
+        size_t queueSize = MIN_QUEUE_SIZE;
+        while (queueSize < options.queue_size)
+            queueSize <<= 1;
+        this->options.queue_size = queueSize;
+        if (options.mode == LogMode::Shared)
+        {
+            shared.reset(new SharedTransport(options.shared_name.empty() ? sharedNameFor(filename) : options.shared_name));
+            if (!shared->ring.IsValid() || !shared->state.IsValid())
+                shared.reset();
+        }
 
-        logFile.open(filename, std::ios::app);
+        // Дописывание в конец: пачки разных процессов не перетирают друг друга
+#if defined(_WIN32)
+        fileHandle = CreateFileA(filename.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                 OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        bool opened = fileHandle != INVALID_HANDLE_VALUE;
+#else
+        fileDescriptor = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        bool opened = fileDescriptor >= 0;
+#endif
+        // Общее кольцо не открылось - хотя бы очереди своего процесса
+        if (opened && shared)
+            writer = std::thread(&Logger::sharedThread, this);
+        else if (opened)
+            writer = std::thread(&Logger::writerThread, this);
+        else
+            shared.reset();
     }
 
     Logger::~Logger()
     {
+        if (writer.joinable() && shared)
+        {
+            sharedStopping.store(true);
+            shared->state.SignalEvent();
+            writer.join();
+        }
+        else if (writer.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                stopping = true;
+            }
+            wakeCondition.notify_one();
+            writer.join();
+        }
+#if defined(_WIN32)
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+#else
+        if (fileDescriptor >= 0)
+            close(fileDescriptor);
+#endif
         if (logFile.is_open())
         {
             logFile.close();
@@ -25,22 +399,520 @@ namespace cplib
 
     void Logger::log(const std::string &message)
     {
-        if (logFile.is_open())
+        if (options.mode == LogMode::Sync && !options.binary)
+        {
+            if (logFile.is_open())
+            {
+                logFile << "[" << getCurrentTime(true) << "] PID " << processId << ": " << message << std::endl;
+            }
+            return;
+        }
+
+        // Слишком длинное сообщение обрезается: иначе оно не поместится в очередь или кольцо
+        size_t limit = shared ? SHARED_DATA_SIZE : options.queue_size / 2 - sizeof(RecordHeader);
+        std::string args;
+        encodeString(args, message.data(), std::min(message.size(), limit - STRING_ARG_OVERHEAD));
+        logEncoded(PLAIN_FORMAT, args.data(), args.size(), LogLevel::Off);
+    }
+
+    void Logger::logStructured(const LogFormat &format, const LogArgs &args, LogLevel level)
+    {
+        logEncoded(format, args.data(), args.size(), level);
+    }
+
+    bool Logger::admit(LogRateLimit &limit, uint64_t &suppressed)
+    {
+        if (options.rate_limit <= 0)
+            return true;
+        // Каждая запись сдвигает момент полного ведра на interval; если он ушёл
+        // дальше burst интервалов вперёд - токенов нет
+        int64_t interval = static_cast<int64_t>(1e9 / options.rate_limit);
+        int64_t capacity = interval * std::max<int64_t>(options.rate_burst, 1);
+        int64_t now = monotonicNs();
+        int64_t fullAt = limit.full_at.load(std::memory_order_relaxed);
+        int64_t next;
+        do
+        {
+            next = std::max(fullAt, now) + interval;
+            if (next - now > capacity)
+            {
+                limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while (!limit.full_at.compare_exchange_weak(fullAt, next, std::memory_order_relaxed));
+        suppressed = limit.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    void Logger::logEncoded(const LogFormat &format, const char *args, size_t size, LogLevel level)
+    {
+        if (options.mode == LogMode::Sync)
         {
-            logFile << "[" << getCurrentTime(true) << "] PID " << processId << ": " << message << std::endl;
+            if (!logFile.is_open())
+                return;
+            std::lock_guard<std::mutex> lock(batchMutex);
+            batch.clear();
+            appendRecord({wallClockNs(), processId, format.id, format.text, std::string(args, size), level});
+            logFile.write(batch.data(), batch.size());
+            logFile.flush();
+            return;
+        }
+
+        if (shared)
+        {
+            if (shared->registerFormat(format))
+            {
+                pushShared(format.id, args, size, level);
+                return;
+            }
+            // Таблица форматов полна - форматируем здесь и отправляем готовый текст
+            std::string text;
+            formatArgs(text, format.text, args, size);
+            std::string plain;
+            encodeString(plain, text.data(), std::min(text.size(), SHARED_DATA_SIZE - STRING_ARG_OVERHEAD));
+            pushShared(PLAIN_FORMAT.id, plain.data(), plain.size(), level);
+            return;
+        }
+
+        ThreadQueue *queue = threadQueue();
+        if (queue == nullptr)
+            return;
+
+        RecordHeader header;
+        header.time_ns = wallClockNs();
+        header.length = size;
+        header.format = format.id;
+        header.text = format.text;
+        header.level = static_cast<int64_t>(level);
+        size_t recordSize = alignRecord(sizeof(RecordHeader) + size);
+        if (recordSize > queue->buffer.size() / 2)
+            return;
+
+        uint64_t tail = queue->tail.load(std::memory_order_relaxed);
+        if (queue->buffer.size() - (tail - queue->cachedHead) < recordSize)
+        {
+            queue->cachedHead = queue->head.load(std::memory_order_acquire);
+            // Очередь полна: будим фоновый поток и ждём места
+            while (queue->buffer.size() - (tail - queue->cachedHead) < recordSize)
+            {
+                if (!wakeRequested.exchange(true))
+                    wakeCondition.notify_one();
+                std::this_thread::yield();
+                queue->cachedHead = queue->head.load(std::memory_order_acquire);
+            }
+        }
+        queue->copyIn(tail, &header, sizeof(header));
+        queue->copyIn(tail + sizeof(header), args, size);
+        queue->tail.store(tail + recordSize, std::memory_order_release);
+
+        // Заполнена больше чем наполовину - не ждём конца интервала. Уведомление без
+        // мьютекса может потеряться, тогда фоновый поток проснётся по flush_interval
+        if (tail + recordSize - queue->cachedHead > queue->buffer.size() / 2)
+        {
+            queue->cachedHead = queue->head.load(std::memory_order_acquire);
+            if (tail + recordSize - queue->cachedHead > queue->buffer.size() / 2 && !wakeRequested.exchange(true))
+                wakeCondition.notify_one();
         }
     }
 
+    void Logger::pushShared(uint64_t format, const char *args, size_t size, LogLevel level)
+    {
+        SharedRecord record;
+        record.pid = processId;
+        record.format = format;
+        record.level = static_cast<uint16_t>(level);
+        record.length = static_cast<uint16_t>(std::min(size, SHARED_DATA_SIZE));
+        memcpy(record.data, args, record.length);
+        // Время - момент попадания в кольцо: запись, прождавшая место,
+        // не окажется старше окна переупорядочивания
+        for (int attempt = 1; record.time_ns = wallClockNs(), !shared->ring.Push(record); ++attempt)
+        {
+            // Кольцо полно: пишущий не успевает - ждём его, а если его нет,
+            // не теряем запись и пишем её сами, пусть и не по порядку
+            if (attempt == 1)
+                shared->state.SignalEvent();
+            if (attempt % SHARED_PUSH_ATTEMPTS == 0 && !drainerAlive())
+            {
+                std::lock_guard<std::mutex> lock(batchMutex);
+                batch.clear();
+                appendRecord({record.time_ns, record.pid, record.format, shared->findFormat(record.format),
+                              std::string(record.data, record.length), static_cast<LogLevel>(record.level)});
+                writeBatch();
+                return;
+            }
+            std::this_thread::yield();
+        }
+        if (shared->ring.Size() > SHARED_RING_SLOTS / 2)
+            shared->state.SignalEvent();
+    }
+
+    void Logger::flush()
+    {
+        if (options.mode == LogMode::Sync)
+        {
+            logFile.flush();
+            return;
+        }
+        // Shared: записи в кольце, их запишет тот, кто держит аренду
+        if (!writer.joinable() || shared)
+            return;
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        uint64_t request = ++flushRequested;
+        wakeCondition.notify_one();
+        flushedCondition.wait(lock, [&]
+                              { return flushCompleted >= request; });
+    }
+
+    Logger::ThreadQueue *Logger::threadQueue()
+    {
+        // Очереди этого потока у разных логгеров; идентификаторы не повторяются,
+        // поэтому запись удалённого логгера просто никогда не совпадёт
+        thread_local std::vector<std::pair<uint64_t, ThreadQueue *>> cache;
+        for (auto &entry : cache)
+        {
+            if (entry.first == instanceId)
+                return entry.second;
+        }
+        if (!writer.joinable())
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(queuesMutex);
+        queues.emplace_back(new ThreadQueue(options.queue_size));
+        cache.emplace_back(instanceId, queues.back().get());
+        return queues.back().get();
+    }
+
+    void Logger::writerThread()
+    {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (true)
+        {
+            wakeCondition.wait_for(lock, options.flush_interval, [this]
+                                   { return stopping || wakeRequested.load() || flushRequested != flushCompleted; });
+            bool stop = stopping;
+            uint64_t request = flushRequested;
+            wakeRequested.store(false);
+            lock.unlock();
+
+            drain();
+
+            lock.lock();
+            flushCompleted = request;
+            flushedCondition.notify_all();
+            if (stop)
+                break;
+        }
+    }
+
+    bool Logger::drain()
+    {
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(queuesMutex);
+            for (auto &queue : queues)
+            {
+                uint64_t head = queue->head.load(std::memory_order_relaxed);
+                uint64_t tail = queue->tail.load(std::memory_order_acquire);
+                while (head != tail)
+                {
+                    RecordHeader header;
+                    queue->copyOut(head, &header, sizeof(header));
+                    // Строки переиспользуются между пачками
+                    if (count == pending.size())
+                        pending.emplace_back();
+                    Record &record = pending[count++];
+                    record.time_ns = header.time_ns;
+                    record.pid = processId;
+                    record.format = header.format;
+                    record.text = header.text;
+                    record.level = static_cast<LogLevel>(header.level);
+                    record.args.resize(header.length);
+                    queue->copyOut(head + sizeof(header), &record.args[0], header.length);
+                    head += alignRecord(sizeof(header) + header.length);
+                }
+                queue->head.store(head, std::memory_order_release);
+            }
+        }
+        if (count == 0)
+            return false;
+
+        // Записи разных потоков - в порядке времени
+        std::stable_sort(pending.begin(), pending.begin() + count, [](const Record &a, const Record &b)
+                         { return a.time_ns < b.time_ns; });
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batch.clear();
+        for (size_t i = 0; i < count; ++i)
+            appendRecord(pending[i]);
+        writeBatch();
+        return true;
+    }
+
+    void Logger::appendRecord(const Record &record)
+    {
+        if (!options.binary)
+        {
+            appendLogLine(batch, cachedSecond, cachedPrefix, record.time_ns, record.pid, record.level, record.text,
+                          record.args.data(), record.args.size());
+            return;
+        }
+        // Текст формата - перед первой записью с ним
+        if (record.text != NULL && writtenFormats.insert(record.format).second)
+        {
+            size_t length = strlen(record.text);
+            batch += BINARY_FORMAT;
+            appendValue<uint32_t>(batch, static_cast<uint32_t>(sizeof(uint64_t) + length));
+            appendValue<uint64_t>(batch, record.format);
+            batch.append(record.text, length);
+        }
+        // Запись без уровня - прежнего вида
+        bool leveled = record.level != LogLevel::Off;
+        size_t fields = sizeof(uint64_t) + sizeof(int64_t) + sizeof(int32_t) + (leveled ? sizeof(int32_t) : 0);
+        batch += leveled ? BINARY_LEVEL_RECORD : BINARY_RECORD;
+        appendValue<uint32_t>(batch, static_cast<uint32_t>(fields + record.args.size()));
+        appendValue<uint64_t>(batch, record.format);
+        appendValue<int64_t>(batch, record.time_ns);
+        appendValue<int32_t>(batch, record.pid);
+        if (leveled)
+            appendValue<int32_t>(batch, static_cast<int32_t>(record.level));
+        batch += record.args;
+    }
+
+    void Logger::writeBatch()
+    {
+#if defined(_WIN32)
+        DWORD written = 0;
+        WriteFile(fileHandle, batch.data(), static_cast<DWORD>(batch.size()), &written, NULL);
+        if (options.durability == LogDurability::Data)
+            FlushFileBuffers(fileHandle);
+#else
+        // Одна пачка - один write(), пока файл не отказывается принять её целиком
+        size_t offset = 0;
+        while (offset < batch.size())
+        {
+            ssize_t written = ::write(fileDescriptor, batch.data() + offset, batch.size() - offset);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                break;
+            offset += written;
+        }
+        if (options.durability == LogDurability::Data)
+        {
+#if defined(__linux__)
+            fdatasync(fileDescriptor);
+#else
+            fsync(fileDescriptor);
+#endif
+        }
+#endif
+    }
+
+    // Фоновый поток режима Shared: пока держим аренду - переносим кольцо в файл,
+    // иначе следим, не пора ли её перехватить
+    void Logger::sharedThread()
+    {
+        SharedMem<SharedLogState> &state = shared->state;
+        while (!sharedStopping.load())
+        {
+            uint32_t seen = state.EventSeq();
+            if (holdDrain())
+                drainShared(false);
+            else if (!pending.empty())
+                returnPending();
+            // Пишущий успевает обновить пульс до конца аренды
+            int64_t timeout = DRAIN_LEASE_NS / 2000000;
+            if (drainLease != 0 && options.flush_interval.count() < timeout)
+                timeout = options.flush_interval.count();
+            state.WaitEvent(seen, static_cast<int>(timeout));
+        }
+        // Уходя, пишущий (или первый, кто застал аренду свободной) переносит всё,
+        // дав догнать себя записям других процессов из окна переупорядочивания.
+        // Уходящий, кто застал аренду занятой, рассчитывает на пишущего: если после
+        // нашего последнего снятия в кольце что-то появилось - берём аренду снова
+        while (holdDrain())
+        {
+            std::this_thread::sleep_for(options.reorder_window);
+            drainShared(true);
+            releaseDrain();
+            if (shared->ring.Empty())
+                break;
+        }
+        if (!pending.empty())
+        {
+            returnPending();
+        }
+        // Если пишущий ушёл раньше нас - кольцо подхватит следующий по событию
+        state.SignalEvent();
+    }
+
+    bool Logger::holdDrain()
+    {
+        SharedLogState *state = shared->state.Data();
+        int64_t now = monotonicNs();
+        uint64_t owner = state->owner.load();
+        if (drainLease != 0 && owner == drainLease)
+        {
+            // Истёкшую аренду не продлеваем: претендент мог уже сменить пульс и вот-вот
+            // сменит владельца. Пульс меняем только с нашего значения
+            int64_t heartbeat = drainHeartbeat;
+            if (now - heartbeat < DRAIN_LEASE_NS && state->heartbeat_ns.compare_exchange_strong(heartbeat, now))
+            {
+                drainHeartbeat = now;
+                return true;
+            }
+        }
+        // Аренду перехватили или она истекла, пока мы спали
+        drainLease = 0;
+        int64_t heartbeat = state->heartbeat_ns.load();
+        if (heartbeat != 0 && now - heartbeat < DRAIN_LEASE_NS)
+            return false;
+        // Сначала пульс: из нескольких претендентов его сменит один
+        if (!state->heartbeat_ns.compare_exchange_strong(heartbeat, now))
+            return false;
+        uint64_t next = nextOwner(owner, processId);
+        if (!state->owner.compare_exchange_strong(owner, next))
+            return false;
+        drainLease = next;
+        drainHeartbeat = now;
+        return true;
+    }
+
+    bool Logger::drainerAlive()
+    {
+        int64_t heartbeat = shared->state.Data()->heartbeat_ns.load();
+        return heartbeat != 0 && monotonicNs() - heartbeat < DRAIN_LEASE_NS;
+    }
+
+    void Logger::releaseDrain()
+    {
+        SharedLogState *state = shared->state.Data();
+        uint64_t owner = drainLease;
+        drainLease = 0;
+        if (state->owner.compare_exchange_strong(owner, owner & ~0xFFFFFFFFULL))
+            state->heartbeat_ns.store(0);
+    }
+
+    // Записи разных процессов приходят чуть не по порядку: держим их reorder_window
+    // и пишем только те, раньше которых уже ничего не придёт
+    void Logger::drainShared(bool everything)
+    {
+        SharedRecord records[64];
+        size_t count;
+        while ((count = shared->ring.PopBatch(records, 64)) > 0)
+        {
+            for (size_t i = 0; i < count; ++i)
+                pending.push_back({records[i].time_ns, records[i].pid, records[i].format, shared->findFormat(records[i].format),
+                                   std::string(records[i].data, records[i].length), static_cast<LogLevel>(records[i].level)});
+        }
+        if (pending.empty())
+            return;
+        std::stable_sort(pending.begin(), pending.end(), [](const Record &a, const Record &b)
+                         { return a.time_ns < b.time_ns; });
+        int64_t horizon = everything ? INT64_MAX : wallClockNs() - std::chrono::duration_cast<std::chrono::nanoseconds>(options.reorder_window).count();
+        size_t ready = 0;
+        while (ready < pending.size() && pending[ready].time_ns <= horizon)
+            ready++;
+        if (ready == 0)
+            return;
+        std::lock_guard<std::mutex> lock(batchMutex);
+        batch.clear();
+        for (size_t i = 0; i < ready; ++i)
+            appendRecord(pending[i]);
+        writeBatch();
+        pending.erase(pending.begin(), pending.begin() + ready);
+    }
+
+    // Записи, снятые с кольца, но не записанные из-за окна переупорядочивания, допишет
+    // новый пишущий. Места в кольце нет - пишем сами, пусть и не по порядку
+    void Logger::returnPending()
+    {
+        size_t returned = 0;
+        for (; returned < pending.size(); ++returned)
+        {
+            const Record &pendingRecord = pending[returned];
+            SharedRecord record;
+            record.time_ns = pendingRecord.time_ns;
+            record.pid = pendingRecord.pid;
+            record.format = pendingRecord.format;
+            record.level = static_cast<uint16_t>(pendingRecord.level);
+            record.length = static_cast<uint16_t>(std::min(pendingRecord.args.size(), SHARED_DATA_SIZE));
+            memcpy(record.data, pendingRecord.args.data(), record.length);
+            if (!shared->ring.Push(record))
+                break;
+        }
+        if (returned < pending.size())
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            batch.clear();
+            for (size_t i = returned; i < pending.size(); ++i)
+                appendRecord(pending[i]);
+            writeBatch();
+        }
+        pending.clear();
+        shared->state.SignalEvent();
+    }
+
     void Logger::logStartup()
     {
         log("Process started at " + getCurrentTime());
     }
 
-    void Logger::logCounter(int counter)
+    void Logger::logCounter(int64_t counter)
     {
-        std::stringstream ss;
-        ss << "Counter value: " << counter;
-        log(ss.str());
+        logf(CPLIB_LOG_FORMAT("Counter value: {}"), counter);
+    }
+
+    bool Logger::decode(const std::string &binary_file, std::ostream &out)
+    {
+        std::ifstream in(binary_file, std::ios::binary);
+        if (!in)
+            return false;
+        std::unordered_map<uint64_t, std::string> formats;
+        std::string payload;
+        std::string line;
+        int64_t cachedSecond = -1;
+        std::string cachedPrefix;
+        const size_t recordFields = sizeof(uint64_t) + sizeof(int64_t) + sizeof(int32_t);
+        char kind;
+        while (in.get(kind))
+        {
+            uint32_t size = 0;
+            if (!in.read(reinterpret_cast<char *>(&size), sizeof(size)) || size < sizeof(uint64_t))
+                return false;
+            payload.resize(size);
+            if (!in.read(&payload[0], size))
+                return false; // Оборван на середине записи
+            uint64_t format;
+            memcpy(&format, payload.data(), sizeof(format));
+            if (kind == BINARY_FORMAT)
+            {
+                formats[format] = payload.substr(sizeof(format));
+            }
+            else if ((kind == BINARY_RECORD && size >= recordFields) ||
+                     (kind == BINARY_LEVEL_RECORD && size >= recordFields + sizeof(int32_t)))
+            {
+                int64_t time_ns;
+                int32_t pid;
+                int32_t level = static_cast<int32_t>(LogLevel::Off);
+                size_t fields = recordFields;
+                memcpy(&time_ns, payload.data() + sizeof(format), sizeof(time_ns));
+                memcpy(&pid, payload.data() + sizeof(format) + sizeof(time_ns), sizeof(pid));
+                if (kind == BINARY_LEVEL_RECORD)
+                {
+                    memcpy(&level, payload.data() + recordFields, sizeof(level));
+                    fields += sizeof(level);
+                }
+                auto known = formats.find(format);
+                line.clear();
+                appendLogLine(line, cachedSecond, cachedPrefix, time_ns, pid, static_cast<LogLevel>(level),
+                              known == formats.end() ? NULL : known->second.c_str(),
+                              payload.data() + fields, size - fields);
+                out << line;
+            }
+            else
+                return false;
+        }
+        return true;
     }
 
     std::string Logger::getCurrentTime(bool withMilliseconds)
@@ -63,4 +935,4 @@ namespace cplib
         return ss.str();
     }
 
-}
\ No newline at end of file
+}
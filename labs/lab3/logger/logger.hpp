@@ -5,6 +5,17 @@
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -15,20 +26,256 @@
 namespace cplib
 {
 
+    enum class LogMode
+    {
+        Sync, // Строка пишется и сбрасывается в потоке вызывающего
+        Async, // Запись кладётся в очередь потока, в файл её пишет фоновый поток пачками
+        Shared // Записи всех процессов - в общее кольцо, в файл его пишет один выбранный процесс
+    };
+
+    // Что гарантирует запись пачки в режимах Async и Shared
+    enum class LogDurability
+    {
+        Buffered, // write(): переживает падение процесса, но не системы
+        Data      // write() + fdatasync: переживает и падение системы
+    };
+
+    struct LoggerOptions
+    {
+        LogMode mode = LogMode::Sync;
+        // Не дольше этого запись лежит в очереди до write()
+        std::chrono::milliseconds flush_interval = std::chrono::milliseconds(100);
+        LogDurability durability = LogDurability::Buffered;
+        size_t queue_size = 64 * 1024; // Байт на поток, округляется до степени двойки
+        // Shared: имя кольца в общей памяти, по умолчанию - из имени файла
+        std::string shared_name;
+        // Shared: запись ждёт столько, чтобы успели прийти более ранние записи других процессов
+        std::chrono::milliseconds reorder_window = std::chrono::milliseconds(50);
+        // Двоичный журнал: номера форматов и аргументы без форматирования.
+        // Читать - Logger::decode (LAB_LOG_DECODE)
+        bool binary = false;
+        // Записей в секунду с одного места вызова CPLIB_LOG_*; 0 - без ограничения.
+        // Ведро места вызова одно на процесс: Logger'ы, пишущие из одного места, делят его
+        double rate_limit = 100;
+        unsigned rate_burst = 100; // Сколько записей подряд проходит без ожидания
+    };
+
+    enum class LogLevel
+    {
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Off // У записи: без уровня (log, logf)
+    };
+
+// Уровень, ниже которого CPLIB_LOG_* не компилируются: 0 - Debug, 1 - Info, 2 - Warning, 3 - Error, 4 - Off
+#ifndef CPLIB_LOG_MIN_LEVEL
+#define CPLIB_LOG_MIN_LEVEL 1
+#endif
+
+    constexpr LogLevel LOG_MIN_LEVEL = static_cast<LogLevel>(CPLIB_LOG_MIN_LEVEL);
+
+    constexpr bool logLevelEnabled(LogLevel level)
+    {
+        return level != LogLevel::Off && level >= LOG_MIN_LEVEL;
+    }
+
+    // Ведро токенов одного места вызова CPLIB_LOG_*. Хранится одно число - момент, когда
+    // ведро снова будет полным (GCRA), поэтому проверка - один CAS без блокировок.
+    // Это static в месте вызова, а не поле Logger: частоту ограничивают rate_limit и
+    // rate_burst того Logger'а, что пишет сейчас, а счёт общий
+    struct LogRateLimit
+    {
+        std::atomic<int64_t> full_at{0}; // Монотонное время, нс
+        std::atomic<uint64_t> suppressed{0}; // Отброшено с последней прошедшей записи
+    };
+
+    // Формат структурной записи: текст с {} на местах аргументов. Номер - хеш текста,
+    // одинаковый во всех процессах и запусках. Текст должен жить всё время работы
+    // логгера (строковый литерал) - форматирование откладывается
+    struct LogFormat
+    {
+        uint64_t id;
+        const char *text;
+    };
+
+    // FNV-1a
+    constexpr uint64_t logFormatId(const char *text)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (; *text != 0; ++text)
+            hash = (hash ^ static_cast<unsigned char>(*text)) * 1099511628211ULL;
+        return hash;
+    }
+
+// Номер считается при компиляции
+#define CPLIB_LOG_FORMAT(text) (::cplib::LogFormat{std::integral_constant<uint64_t, ::cplib::logFormatId(text)>::value, text})
+
+    // Аргументы структурной записи в двоичном виде: тег типа и значение.
+    // Не поместившиеся аргументы отбрасываются, длинные строки обрезаются
+    class LogArgs
+    {
+    public:
+        static const size_t CAPACITY = 224;
+
+        template <class... Args>
+        explicit LogArgs(const Args &...args) { (add(args), ...); }
+
+        const char *data() const { return buffer; }
+        size_t size() const { return length; }
+
+    private:
+        template <class T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type add(T value) { put('i', static_cast<int64_t>(value)); }
+        template <class T>
+        typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type add(T value) { put('u', static_cast<uint64_t>(value)); }
+        template <class T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type add(T value) { put('f', static_cast<double>(value)); }
+        void add(char value) { addString(&value, 1); }
+        void add(const char *value) { addString(value, strlen(value)); }
+        void add(const std::string &value) { addString(value.data(), value.size()); }
+
+        template <class T>
+        void put(char tag, T value)
+        {
+            if (length + 1 + sizeof(T) > CAPACITY)
+                return;
+            buffer[length++] = tag;
+            memcpy(buffer + length, &value, sizeof(T));
+            length += sizeof(T);
+        }
+        void addString(const char *value, size_t size)
+        {
+            if (length + 1 + sizeof(uint32_t) > CAPACITY)
+                return;
+            uint32_t stored = static_cast<uint32_t>(std::min(size, CAPACITY - length - 1 - sizeof(uint32_t)));
+            put('s', stored);
+            memcpy(buffer + length, value, stored);
+            length += stored;
+        }
+
+        char buffer[CAPACITY];
+        size_t length = 0;
+    };
+
     class Logger
     {
     public:
-        Logger(const std::string &filename);
+        Logger(const std::string &filename, const LoggerOptions &options = LoggerOptions());
         ~Logger();
 
         void log(const std::string &message);
+        // Структурная запись: аргументы копируются в двоичном виде, строка собирается
+        // только при записи в файл, а в двоичном журнале - только при чтении
+        template <class... Args>
+        void logf(const LogFormat &format, const Args &...args) { logStructured(format, LogArgs(args...)); }
+        void logStructured(const LogFormat &format, const LogArgs &args, LogLevel level = LogLevel::Off);
+        // Запись из CPLIB_LOG_*: проходит, если в ведре места вызова есть токен. Сколько
+        // отброшено, сообщает следующая прошедшая запись этого места
+        template <class... Args>
+        void logLimited(LogRateLimit &limit, LogLevel level, uint64_t id, const char *text, const Args &...args)
+        {
+            uint64_t suppressed = 0;
+            if (!admit(limit, suppressed))
+                return;
+            if (suppressed > 0)
+                logStructured(CPLIB_LOG_FORMAT("Suppressed {} record(s): {}"), LogArgs(suppressed, text), level);
+            logStructured({id, text}, LogArgs(args...), level);
+        }
         void logStartup();
-        void logCounter(int counter);
+        void logCounter(int64_t counter);
         std::string getCurrentTime(bool withMilliseconds = false);
+        // Async: дождаться, пока всё записанное до вызова окажется в файле
+        void flush();
+
+        // Двоичный журнал - в текст того же вида, что пишет текстовый режим
+        static bool decode(const std::string &binary_file, std::ostream &out);
 
     private:
+        struct ThreadQueue;
+        struct SharedTransport;
+        struct Record
+        {
+            int64_t time_ns;
+            int pid;
+            uint64_t format;
+            const char *text; // Текст формата; NULL - неизвестен
+            std::string args;
+            LogLevel level;
+        };
+
+        bool admit(LogRateLimit &limit, uint64_t &suppressed);
+        ThreadQueue *threadQueue();
+        void writerThread();
+        bool drain(); // false - очереди были пусты
+        void logEncoded(const LogFormat &format, const char *args, size_t size, LogLevel level);
+        void pushShared(uint64_t format, const char *args, size_t size, LogLevel level);
+        void appendRecord(const Record &record);
+        void writeBatch();
+        void sharedThread();
+        bool holdDrain(); // Shared: этот процесс сейчас пишет кольцо в файл
+        bool drainerAlive();
+        void releaseDrain();
+        void drainShared(bool everything);
+        void returnPending(); // Аренду потеряли: отложенные записи - обратно в кольцо
+
+        LoggerOptions options;
         std::ofstream logFile;
         int processId;
+
+        // Режим Async
+        uint64_t instanceId;
+#if defined(_WIN32)
+        HANDLE fileHandle = INVALID_HANDLE_VALUE;
+#else
+        int fileDescriptor = -1;
+#endif
+        std::mutex queuesMutex;
+        std::vector<std::unique_ptr<ThreadQueue>> queues;
+        std::thread writer;
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable flushedCondition;
+        std::atomic<bool> wakeRequested{false};
+        std::unique_ptr<SharedTransport> shared;
+        std::atomic<bool> sharedStopping{false};
+        uint64_t drainLease = 0; // Слово владельца, с которым мы взяли аренду; 0 - не держим
+        int64_t drainHeartbeat = 0; // Пульс, записанный нами последним
+        bool stopping = false;
+        uint64_t flushRequested = 0;
+        uint64_t flushCompleted = 0;
+        // Состояние фонового потока
+        std::vector<Record> pending;
+        std::mutex batchMutex; // Пачку пишет и log(), если общее кольцо переполнено
+        std::string batch;
+        int64_t cachedSecond = -1;
+        std::string cachedPrefix;
+        std::unordered_set<uint64_t> writtenFormats; // Форматы, уже описанные в двоичном журнале
     };
 
-}
\ No newline at end of file
+}
+
+#define CPLIB_LOG_EXPAND(x) x
+#define CPLIB_LOG_FIRST(first, ...) first
+// Номер формата по первому аргументу (тексту), считается при компиляции
+#define CPLIB_LOG_ID(...) \
+    std::integral_constant<uint64_t, ::cplib::logFormatId(CPLIB_LOG_EXPAND(CPLIB_LOG_FIRST(__VA_ARGS__, 0)))>::value
+
+// CPLIB_LOG_INFO(logger, "Launched child process {}", type): структурная запись с уровнем
+// и ограничением частоты на место вызова (ведро общее для всех Logger'ов, см. LogRateLimit).
+// Ниже CPLIB_LOG_MIN_LEVEL вызов вместе с аргументами выбрасывается при компиляции
+#define CPLIB_LOG_AT(logger, level, ...)                                                            \
+    do                                                                                              \
+    {                                                                                               \
+        if constexpr (::cplib::logLevelEnabled(level))                                              \
+        {                                                                                           \
+            static ::cplib::LogRateLimit cplib_log_limit;                                           \
+            (logger).logLimited(cplib_log_limit, level, CPLIB_LOG_ID(__VA_ARGS__), __VA_ARGS__);    \
+        }                                                                                           \
+    } while (0)
+
+#define CPLIB_LOG_DEBUG(logger, ...) CPLIB_LOG_AT(logger, ::cplib::LogLevel::Debug, __VA_ARGS__)
+#define CPLIB_LOG_INFO(logger, ...) CPLIB_LOG_AT(logger, ::cplib::LogLevel::Info, __VA_ARGS__)
+#define CPLIB_LOG_WARNING(logger, ...) CPLIB_LOG_AT(logger, ::cplib::LogLevel::Warning, __VA_ARGS__)
+#define CPLIB_LOG_ERROR(logger, ...) CPLIB_LOG_AT(logger, ::cplib::LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,936 @@
+#pragma once
+
+#include "shared_memory.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+// Аллокатор внутри общего сегмента и контейнеры поверх него.
+// Указатели хранятся как смещения, поэтому не зависят от адреса, по которому
+// сегмент отображён в конкретном процессе. Сами контейнеры не синхронизированы:
+// их чтение и изменение - под блокировкой сегмента (SharedArenaSegment::Lock),
+// выделение памяти арена защищает сама
+
+namespace cplib
+{
+	/// Указатель, хранящий смещение цели относительно самого себя.
+	/// Корректен в любом процессе, если и он, и цель лежат в одном сегменте
+	template <class T>
+	class OffsetPtr
+	{
+	public:
+		OffsetPtr() : _off(NULL_OFFSET) {}
+		OffsetPtr(T *p) { Set(p); }
+		OffsetPtr(const OffsetPtr &other) { Set(other.Get()); }
+		OffsetPtr &operator=(const OffsetPtr &other)
+		{
+			Set(other.Get());
+			return *this;
+		}
+		OffsetPtr &operator=(T *p)
+		{
+			Set(p);
+			return *this;
+		}
+
+		T *Get() const
+		{
+			if (_off == NULL_OFFSET)
+				return NULL;
+			return reinterpret_cast<T *>(reinterpret_cast<intptr_t>(this) + _off);
+		}
+		T *operator->() const { return Get(); }
+		T &operator*() const { return *Get(); }
+		T &operator[](size_t i) const { return Get()[i]; }
+		explicit operator bool() const { return _off != NULL_OFFSET; }
+
+	private:
+		void Set(T *p) { _off = p ? reinterpret_cast<intptr_t>(p) - reinterpret_cast<intptr_t>(this) : NULL_OFFSET; }
+
+		// 0 - указатель на самого себя, поэтому пустой обозначаем 1 (цели выровнены)
+		static const intptr_t NULL_OFFSET = 1;
+		intptr_t _off;
+	};
+
+	class SharedArena;
+
+	/// Блокировка внутри арены. POSIX - robust pthread mutex: о смерти владельца
+	/// сообщает ядро, поэтому повторно выданный его PID ничего не ломает.
+	/// Windows - спин-блокировка, владелец которой - PID вместе со временем создания процесса
+	class ArenaMutex
+	{
+	public:
+		ArenaMutex() { Init(); }
+		ArenaMutex(const ArenaMutex &) = delete;
+		ArenaMutex &operator=(const ArenaMutex &) = delete;
+
+		// Заново - для сегмента, продолженного из файла прошлого сеанса
+		void Init()
+		{
+#if defined(WIN32)
+			_owner.store(0);
+#else
+			pthread_mutexattr_t attr;
+			pthread_mutexattr_init(&attr);
+			pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+			pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+			pthread_mutex_init(&_mutex, &attr);
+			pthread_mutexattr_destroy(&attr);
+#endif
+		}
+		// Захватывает всегда; false - прежний владелец умер, не отпустив её
+		bool Lock()
+		{
+#if defined(WIN32)
+			uint64_t self = OwnerToken(GetCurrentProcessId());
+			for (unsigned spins = 1;; spins++)
+			{
+				uint64_t owner = 0;
+				if (_owner.compare_exchange_weak(owner, self, std::memory_order_acquire))
+					return true;
+				if (spins % LOCK_SPINS == 0)
+				{
+					if (owner != 0 && OwnerToken(static_cast<DWORD>(owner >> 32)) != owner &&
+						_owner.compare_exchange_strong(owner, self, std::memory_order_acquire))
+						return false;
+					std::this_thread::yield();
+				}
+			}
+#else
+			int err = pthread_mutex_lock(&_mutex);
+			if (err == EOWNERDEAD)
+			{
+				pthread_mutex_consistent(&_mutex);
+				return false;
+			}
+			return true;
+#endif
+		}
+		void Unlock()
+		{
+#if defined(WIN32)
+			_owner.store(0, std::memory_order_release);
+#else
+			pthread_mutex_unlock(&_mutex);
+#endif
+		}
+
+	private:
+#if defined(WIN32)
+		static const unsigned LOCK_SPINS = 64;
+
+		// PID (старшие 32 бита) и младшие биты времени создания процесса; 0 - процесса нет
+		static uint64_t OwnerToken(DWORD pid)
+		{
+			HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+			if (process == NULL)
+				return 0;
+			FILETIME created, exited, kernel, user;
+			DWORD code = 0;
+			bool alive = GetProcessTimes(process, &created, &exited, &kernel, &user) &&
+						 GetExitCodeProcess(process, &code) && code == STILL_ACTIVE;
+			CloseHandle(process);
+			return alive ? (static_cast<uint64_t>(pid) << 32) | created.dwLowDateTime : 0;
+		}
+
+		std::atomic<uint64_t> _owner;
+#else
+		pthread_mutex_t _mutex;
+#endif
+	};
+
+	/// Отображение арен в этом процессе. Арена в растущем хвосте SharedMem
+	/// (SharedArenaSegment) регистрирует здесь, как догнать размер, увеличенный другим
+	/// процессом, и как вырасти самой. Иначе блок за концом своего отображения - SIGSEGV.
+	/// Арены без регистрации отображены целиком
+	class ArenaMappings
+	{
+	public:
+		using MapFn = std::function<size_t()>;		 // Догнать размер сегмента; сколько байт арены отображено
+		using GrowFn = std::function<bool(size_t)>; // Увеличить арену хотя бы до стольких байт
+
+		static void Register(const SharedArena *arena, MapFn map, GrowFn grow)
+		{
+			std::lock_guard<std::mutex> guard(Mutex());
+			Entries()[arena] = Entry{std::move(map), std::move(grow), 0};
+		}
+		static void Unregister(const SharedArena *arena)
+		{
+			std::lock_guard<std::mutex> guard(Mutex());
+			Entries().erase(arena);
+		}
+		// Отображено ли в этом процессе не меньше size байт арены
+		static bool Ensure(const SharedArena *arena, size_t size)
+		{
+			std::lock_guard<std::mutex> guard(Mutex());
+			auto it = Entries().find(arena);
+			if (it == Entries().end() || it->second.mapped >= size)
+				return true;
+			it->second.mapped = it->second.map();
+			return it->second.mapped >= size;
+		}
+		static bool Grow(const SharedArena *arena, size_t size)
+		{
+			GrowFn grow;
+			{
+				std::lock_guard<std::mutex> guard(Mutex());
+				auto it = Entries().find(arena);
+				if (it == Entries().end())
+					return false;
+				grow = it->second.grow;
+			}
+			return grow(size);
+		}
+
+	private:
+		struct Entry
+		{
+			MapFn map;
+			GrowFn grow;
+			size_t mapped;
+		};
+		static std::mutex &Mutex()
+		{
+			static std::mutex mutex;
+			return mutex;
+		}
+		static std::unordered_map<const SharedArena *, Entry> &Entries()
+		{
+			static std::unordered_map<const SharedArena *, Entry> entries;
+			return entries;
+		}
+	};
+
+	// Контейнерам нужна арена: если T принимает её первым аргументом - передаём
+	template <class T, class... Args>
+	typename std::enable_if<std::is_constructible<T, SharedArena &, Args...>::value, T *>::type
+	ArenaConstruct(void *p, SharedArena &arena, Args &&...args)
+	{
+		return new (p) T(arena, std::forward<Args>(args)...);
+	}
+
+	template <class T, class... Args>
+	typename std::enable_if<!std::is_constructible<T, SharedArena &, Args...>::value, T *>::type
+	ArenaConstruct(void *p, SharedArena &, Args &&...args)
+	{
+		return new (p) T(std::forward<Args>(args)...);
+	}
+
+	const size_t ARENA_ALIGN = 16;
+
+	/// Аллокатор с классами размеров (16..4096 байт) и списком свободных больших блоков.
+	/// Объект целиком лежит в общей памяти, в начале размечаемой области
+	class SharedArena
+	{
+	public:
+		// Разметить область [base, base + size); NULL - область слишком мала
+		static SharedArena *Create(void *base, size_t size)
+		{
+			if (size < sizeof(SharedArena) + ARENA_ALIGN || reinterpret_cast<uintptr_t>(base) % ARENA_ALIGN != 0)
+				return NULL;
+			return new (base) SharedArena(size);
+		}
+		// Подключиться к уже размеченной области; NULL - там нет арены
+		static SharedArena *Attach(void *base)
+		{
+			SharedArena *arena = static_cast<SharedArena *>(base);
+			return arena->_magic == ARENA_MAGIC ? arena : NULL;
+		}
+
+		// Арена в растущем хвосте SharedMem: после Resize сообщить новый размер области.
+		// Вызывать только когда новая часть уже отображена у вызывающего (Tail() после
+		// Resize). Остальные процессы отобразят её через ArenaMappings при первом обращении
+		void Extend(size_t size)
+		{
+			LockArena();
+			if (size > _capacity)
+				_capacity = size;
+			UnlockArena();
+		}
+
+		// NULL - память в арене закончилась, а вырасти она не смогла
+		void *Allocate(size_t bytes)
+		{
+			while (true)
+			{
+				LockArena();
+				// Блоки из списков свободных могут лежать за концом нашего отображения:
+				// пока держим блокировку, _capacity не меняется
+				void *p = ArenaMappings::Ensure(this, _capacity) ? AllocateLocked(bytes) : NULL;
+				uint64_t capacity = _capacity;
+				UnlockArena();
+				if (p != NULL || !ArenaMappings::Grow(this, capacity + sizeof(BlockHeader) + AlignUp(bytes ? bytes : 1)))
+					return p;
+			}
+		}
+		void Deallocate(void *p)
+		{
+			if (p == NULL)
+				return;
+			BlockHeader *block = HeaderOf(p);
+			LockArena();
+			uint64_t offset = ToOffset(p);
+			if (block->size_class >= 0)
+			{
+				*static_cast<uint64_t *>(p) = _free_small[block->size_class];
+				_free_small[block->size_class] = offset;
+			}
+			else
+			{
+				*static_cast<uint64_t *>(p) = _free_large;
+				_free_large = offset;
+			}
+			_used -= block->size;
+			UnlockArena();
+		}
+
+		template <class T, class... Args>
+		T *New(Args &&...args)
+		{
+			static_assert(alignof(T) <= ARENA_ALIGN, "SharedArena cannot satisfy this alignment");
+			void *p = Allocate(sizeof(T));
+			return p ? ArenaConstruct<T>(p, *this, std::forward<Args>(args)...) : NULL;
+		}
+		template <class T>
+		void Delete(T *p)
+		{
+			if (p == NULL)
+				return;
+			p->~T();
+			Deallocate(p);
+		}
+
+		// Корневой объект арены: создаётся первым обратившимся процессом,
+		// остальные получают его же. Строящий умер на полпути - строит следующий
+		// (память недостроенного теряется). NULL - не хватило памяти или тип не тот
+		template <class T>
+		T *Root()
+		{
+			if (_root_state.load(std::memory_order_acquire) != ROOT_READY)
+			{
+				if (!_root_lock.Lock())
+					_recoveries++;
+				if (_root_state.load(std::memory_order_relaxed) != ROOT_READY)
+				{
+					T *root = New<T>();
+					_root = root ? ToOffset(root) : 0;
+					_root_size = sizeof(T);
+					_root_state.store(ROOT_READY, std::memory_order_release);
+				}
+				_root_lock.Unlock();
+			}
+			if (_root == 0 || _root_size != sizeof(T))
+				return NULL;
+			return static_cast<T *>(FromOffset(_root));
+		}
+
+		// Смещения от начала арены - для передачи указателей между процессами
+		// через другие каналы (например, SharedRing)
+		uint64_t ToOffset(const void *p) const { return p ? static_cast<const char *>(p) - reinterpret_cast<const char *>(this) : 0; }
+		// NULL - блок за концом арены или его не удалось отобразить
+		void *FromOffset(uint64_t offset)
+		{
+			if (offset == 0 || offset >= _capacity || !ArenaMappings::Ensure(this, offset + 1))
+				return NULL;
+			return At(offset);
+		}
+
+		// Сегмент продолжен из файла прошлого сеанса: блокировки того сеанса недействительны
+		void OnReattach()
+		{
+			_lock.Init();
+			_root_lock.Init();
+		}
+		bool Contains(const void *p) const
+		{
+			const char *c = static_cast<const char *>(p);
+			return c >= reinterpret_cast<const char *>(this) && c < reinterpret_cast<const char *>(this) + _capacity;
+		}
+
+		size_t Capacity() const { return _capacity; }
+		size_t Used() const { return _used; }		// Байт в живых блоках
+		size_t Reserved() const { return _top; }	// Байт, когда-либо выданных из хвоста
+		int Recoveries() const { return _recoveries.load(); }
+
+	private:
+		struct BlockHeader
+		{
+			uint64_t size;		// Полезный размер блока
+			int64_t size_class; // -1 - большой блок
+		};
+		static_assert(sizeof(BlockHeader) == ARENA_ALIGN, "BlockHeader must keep payloads aligned");
+
+		static const uint64_t ARENA_MAGIC = 0x414E455241524853ULL;
+		static const int SIZE_CLASSES = 9; // 16 << 0 .. 16 << 8
+		static const size_t MAX_SMALL = ARENA_ALIGN << (SIZE_CLASSES - 1);
+		enum
+		{
+			ROOT_NONE,
+			ROOT_READY
+		};
+
+		explicit SharedArena(size_t size)
+			: _capacity(size), _recoveries(0), _free_large(0), _used(0),
+			  _root_state(ROOT_NONE), _root(0), _root_size(0)
+		{
+			for (int i = 0; i < SIZE_CLASSES; i++)
+				_free_small[i] = 0;
+			_top = AlignUp(sizeof(SharedArena));
+			_magic = ARENA_MAGIC;
+		}
+
+		static size_t AlignUp(size_t n) { return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1); }
+		void *At(uint64_t offset) { return reinterpret_cast<char *>(this) + offset; }
+		static BlockHeader *HeaderOf(void *p) { return reinterpret_cast<BlockHeader *>(static_cast<char *>(p) - sizeof(BlockHeader)); }
+		static int SizeClass(size_t bytes)
+		{
+			if (bytes > MAX_SMALL)
+				return -1;
+			int cls = 0;
+			while ((ARENA_ALIGN << cls) < bytes)
+				cls++;
+			return cls;
+		}
+
+		void *AllocateLocked(size_t bytes)
+		{
+			if (bytes == 0)
+				bytes = 1;
+			int cls = SizeClass(bytes);
+			uint64_t size = cls >= 0 ? ARENA_ALIGN << cls : AlignUp(bytes);
+			void *p = NULL;
+			if (cls >= 0 && _free_small[cls] != 0)
+			{
+				p = At(_free_small[cls]);
+				_free_small[cls] = *static_cast<uint64_t *>(p);
+			}
+			else if (cls < 0)
+			{
+				// Первый подходящий из освобождённых больших блоков
+				uint64_t *link = &_free_large;
+				while (*link != 0)
+				{
+					void *candidate = At(*link);
+					if (HeaderOf(candidate)->size >= size)
+					{
+						*link = *static_cast<uint64_t *>(candidate);
+						p = candidate;
+						size = HeaderOf(candidate)->size;
+						break;
+					}
+					link = static_cast<uint64_t *>(candidate);
+				}
+			}
+			if (p == NULL)
+			{
+				if (_capacity - _top < sizeof(BlockHeader) + size)
+					return NULL;
+				BlockHeader *block = reinterpret_cast<BlockHeader *>(reinterpret_cast<char *>(this) + _top);
+				block->size = size;
+				block->size_class = cls;
+				_top += sizeof(BlockHeader) + size;
+				p = block + 1;
+			}
+			_used += size;
+			return p;
+		}
+
+		// Критические секции - несколько присваиваний
+		void LockArena()
+		{
+			if (!_lock.Lock())
+				_recoveries++;
+		}
+		void UnlockArena() { _lock.Unlock(); }
+
+		uint64_t _magic;
+		uint64_t _capacity;
+		uint64_t _top; // Граница нетронутой части
+		ArenaMutex _lock;
+		ArenaMutex _root_lock;
+		std::atomic<int> _recoveries;
+		uint64_t _free_small[SIZE_CLASSES];
+		uint64_t _free_large;
+		uint64_t _used;
+		std::atomic<int> _root_state;
+		uint64_t _root;
+		uint64_t _root_size;
+	};
+
+	/// Вектор в арене. Элементы сами могут быть контейнерами арены
+	template <class T>
+	class SharedVector
+	{
+		static_assert(alignof(T) <= ARENA_ALIGN, "SharedArena cannot satisfy this alignment");
+
+	public:
+		explicit SharedVector(SharedArena &arena) : _arena(&arena), _size(0), _capacity(0) {}
+		SharedVector(SharedVector &&other)
+			: _arena(other._arena), _data(other._data), _size(other._size), _capacity(other._capacity)
+		{
+			other._data = NULL;
+			other._size = other._capacity = 0;
+		}
+		SharedVector(const SharedVector &) = delete;
+		SharedVector &operator=(const SharedVector &) = delete;
+		~SharedVector()
+		{
+			Clear();
+			_arena->Deallocate(_data.Get());
+		}
+
+		// false - в арене не хватило памяти, вектор не изменился
+		bool Reserve(size_t capacity)
+		{
+			if (capacity <= _capacity)
+				return true;
+			T *data = static_cast<T *>(_arena->Allocate(sizeof(T) * capacity));
+			if (data == NULL)
+				return false;
+			T *old = _data.Get();
+			for (size_t i = 0; i < _size; i++)
+			{
+				new (&data[i]) T(std::move(old[i]));
+				old[i].~T();
+			}
+			_arena->Deallocate(old);
+			_data = data;
+			_capacity = capacity;
+			return true;
+		}
+		template <class... Args>
+		bool EmplaceBack(Args &&...args)
+		{
+			if (_size == _capacity && !Reserve(_capacity ? _capacity * 2 : MIN_CAPACITY))
+				return false;
+			ArenaConstruct<T>(&_data[_size], *_arena, std::forward<Args>(args)...);
+			_size++;
+			return true;
+		}
+		bool PushBack(const T &value) { return EmplaceBack(value); }
+		void PopBack()
+		{
+			if (_size > 0)
+				_data[--_size].~T();
+		}
+		// Удаление со сдвигом хвоста, порядок сохраняется
+		void Erase(size_t index)
+		{
+			if (index >= _size)
+				return;
+			T *data = _data.Get();
+			data[index].~T();
+			for (size_t i = index + 1; i < _size; i++)
+			{
+				new (&data[i - 1]) T(std::move(data[i]));
+				data[i].~T();
+			}
+			_size--;
+		}
+		void Clear()
+		{
+			while (_size > 0)
+				PopBack();
+		}
+
+		T &operator[](size_t i) { return _data[i]; }
+		const T &operator[](size_t i) const { return _data[i]; }
+		T *Data() { return _data.Get(); }
+		T *begin() { return _data.Get(); }
+		T *end() { return _data.Get() + _size; }
+		size_t Size() const { return _size; }
+		size_t Capacity() const { return _capacity; }
+		bool Empty() const { return _size == 0; }
+
+	private:
+		static const size_t MIN_CAPACITY = 4;
+
+		OffsetPtr<SharedArena> _arena;
+		OffsetPtr<T> _data;
+		size_t _size;
+		size_t _capacity;
+	};
+
+	/// Строка в арене, всегда завершается нулём
+	class SharedString
+	{
+	public:
+		explicit SharedString(SharedArena &arena) : _arena(&arena), _size(0), _capacity(0) {}
+		// При нехватке памяти строка остаётся пустой
+		SharedString(SharedArena &arena, const char *text) : SharedString(arena) { Assign(text, strlen(text)); }
+		SharedString(SharedArena &arena, const std::string &text) : SharedString(arena) { Assign(text.data(), text.size()); }
+		SharedString(SharedString &&other)
+			: _arena(other._arena), _data(other._data), _size(other._size), _capacity(other._capacity)
+		{
+			other._data = NULL;
+			other._size = other._capacity = 0;
+		}
+		SharedString(const SharedString &) = delete;
+		SharedString &operator=(const SharedString &) = delete;
+		~SharedString() { _arena->Deallocate(_data.Get()); }
+
+		bool Assign(const char *text, size_t length)
+		{
+			_size = 0;
+			return Append(text, length);
+		}
+		bool Assign(const std::string &text) { return Assign(text.data(), text.size()); }
+		// text может указывать в саму строку (s.Append(s.CStr(), s.Size()))
+		bool Append(const char *text, size_t length)
+		{
+			char *old = _data.Get();
+			char *data = old;
+			size_t capacity = _capacity;
+			if (_size + length + 1 > capacity)
+			{
+				capacity = capacity ? capacity : MIN_CAPACITY;
+				while (capacity < _size + length + 1)
+					capacity *= 2;
+				data = static_cast<char *>(_arena->Allocate(capacity));
+				if (data == NULL)
+					return false;
+				memcpy(data, CStr(), _size);
+			}
+			// Старый буфер освобождаем только после копирования text
+			memmove(data + _size, text, length);
+			_size += length;
+			data[_size] = '\0';
+			if (data != old)
+			{
+				_arena->Deallocate(old);
+				_data = data;
+				_capacity = capacity;
+			}
+			return true;
+		}
+
+		const char *CStr() const { return _data ? _data.Get() : ""; }
+		std::string Str() const { return std::string(CStr(), _size); }
+		size_t Size() const { return _size; }
+		bool Empty() const { return _size == 0; }
+
+		bool Equals(const char *text, size_t length) const { return _size == length && memcmp(CStr(), text, length) == 0; }
+		bool operator==(const SharedString &other) const { return Equals(other.CStr(), other._size); }
+		bool operator==(const std::string &text) const { return Equals(text.data(), text.size()); }
+		bool operator==(const char *text) const { return Equals(text, strlen(text)); }
+
+	private:
+		static const size_t MIN_CAPACITY = 16;
+
+		OffsetPtr<SharedArena> _arena;
+		OffsetPtr<char> _data;
+		size_t _size;
+		size_t _capacity;
+	};
+
+	template <class K>
+	struct SharedHash
+	{
+		uint64_t operator()(const K &key) const { return std::hash<K>()(key); }
+	};
+
+	// Строки хешируются HashBytes: одинаково во всех процессах, в отличие от std::hash.
+	// Искать по строковому ключу можно без создания SharedString
+	template <>
+	struct SharedHash<SharedString>
+	{
+		uint64_t operator()(const SharedString &key) const { return HashBytes(key.CStr(), key.Size()); }
+		uint64_t operator()(const std::string &key) const { return HashBytes(key.data(), key.size()); }
+		uint64_t operator()(const char *key) const { return HashBytes(key, strlen(key)); }
+	};
+
+	/// Хеш-таблица с открытой адресацией (линейное пробирование) в арене
+	template <class K, class V, class Hash = SharedHash<K>>
+	class SharedHashMap
+	{
+		static_assert(alignof(K) <= ARENA_ALIGN && alignof(V) <= ARENA_ALIGN, "SharedArena cannot satisfy this alignment");
+
+	public:
+		explicit SharedHashMap(SharedArena &arena) : _arena(&arena), _capacity(0), _size(0), _tombstones(0) {}
+		SharedHashMap(const SharedHashMap &) = delete;
+		SharedHashMap &operator=(const SharedHashMap &) = delete;
+		~SharedHashMap()
+		{
+			Clear();
+			_arena->Deallocate(_slots.Get());
+		}
+
+		template <class Q>
+		V *Find(const Q &key)
+		{
+			Slot *slot = Lookup(key);
+			return slot ? &slot->Value() : NULL;
+		}
+		// Как try_emplace: существующее значение не трогается. NULL - нет памяти
+		template <class Q, class... Args>
+		V *Emplace(const Q &key, Args &&...args)
+		{
+			if (V *existing = Find(key))
+				return existing;
+			if ((_size + _tombstones + 1) * MAX_LOAD_DEN > _capacity * MAX_LOAD_NUM && !Rehash(GrowCapacity()))
+				return NULL;
+			Slot *slot = FreeSlot(key);
+			ArenaConstruct<K>(slot->key, *_arena, key);
+			if (!(slot->Key() == key)) // Ключ-строке не хватило памяти
+			{
+				slot->Key().~K();
+				return NULL;
+			}
+			if (slot->state == SLOT_DELETED)
+				_tombstones--;
+			ArenaConstruct<V>(slot->value, *_arena, std::forward<Args>(args)...);
+			slot->state = SLOT_FULL;
+			_size++;
+			return &slot->Value();
+		}
+		template <class Q, class... Args>
+		V *InsertOrAssign(const Q &key, Args &&...args)
+		{
+			if (Slot *slot = Lookup(key))
+			{
+				slot->Value().~V();
+				return ArenaConstruct<V>(slot->value, *_arena, std::forward<Args>(args)...);
+			}
+			return Emplace(key, std::forward<Args>(args)...);
+		}
+		template <class Q>
+		bool Erase(const Q &key)
+		{
+			Slot *slot = Lookup(key);
+			if (slot == NULL)
+				return false;
+			slot->Key().~K();
+			slot->Value().~V();
+			slot->state = SLOT_DELETED;
+			_size--;
+			_tombstones++;
+			return true;
+		}
+		void Clear()
+		{
+			for (size_t i = 0; i < _capacity; i++)
+			{
+				Slot &slot = _slots[i];
+				if (slot.state == SLOT_FULL)
+				{
+					slot.Key().~K();
+					slot.Value().~V();
+				}
+				slot.state = SLOT_EMPTY;
+			}
+			_size = _tombstones = 0;
+		}
+		// f(const K &, V &)
+		template <class F>
+		void ForEach(F f)
+		{
+			for (size_t i = 0; i < _capacity; i++)
+				if (_slots[i].state == SLOT_FULL)
+					f(static_cast<const K &>(_slots[i].Key()), _slots[i].Value());
+		}
+
+		size_t Size() const { return _size; }
+		bool Empty() const { return _size == 0; }
+
+	private:
+		enum : uint8_t
+		{
+			SLOT_EMPTY,
+			SLOT_FULL,
+			SLOT_DELETED
+		};
+		struct Slot
+		{
+			uint8_t state;
+			alignas(K) unsigned char key[sizeof(K)];
+			alignas(V) unsigned char value[sizeof(V)];
+			K &Key() { return *reinterpret_cast<K *>(key); }
+			V &Value() { return *reinterpret_cast<V *>(value); }
+		};
+
+		static const size_t MIN_CAPACITY = 8;
+		// Заполнение (с учётом удалённых) не выше 3/4
+		static const size_t MAX_LOAD_NUM = 3;
+		static const size_t MAX_LOAD_DEN = 4;
+
+		template <class Q>
+		size_t Home(const Q &key) const
+		{
+			// Перемешиваем: std::hash для целых - тождественная функция
+			return static_cast<size_t>((Hash()(key) * 0x9E3779B97F4A7C15ULL) >> 32) & (_capacity - 1);
+		}
+		template <class Q>
+		Slot *Lookup(const Q &key)
+		{
+			if (_size == 0)
+				return NULL;
+			for (size_t i = Home(key), probes = 0; probes < _capacity; i = (i + 1) & (_capacity - 1), probes++)
+			{
+				Slot &slot = _slots[i];
+				if (slot.state == SLOT_EMPTY)
+					return NULL;
+				if (slot.state == SLOT_FULL && slot.Key() == key)
+					return &slot;
+			}
+			return NULL;
+		}
+		template <class Q>
+		Slot *FreeSlot(const Q &key)
+		{
+			size_t i = Home(key);
+			while (_slots[i].state == SLOT_FULL)
+				i = (i + 1) & (_capacity - 1);
+			return &_slots[i];
+		}
+		// Если место заняли в основном удалённые записи - перестраиваем без роста
+		size_t GrowCapacity() const
+		{
+			if (_capacity == 0)
+				return MIN_CAPACITY;
+			return (_size + 1) * MAX_LOAD_DEN * 2 > _capacity * MAX_LOAD_NUM ? _capacity * 2 : _capacity;
+		}
+		bool Rehash(size_t capacity)
+		{
+			Slot *slots = static_cast<Slot *>(_arena->Allocate(sizeof(Slot) * capacity));
+			if (slots == NULL)
+				return false;
+			for (size_t i = 0; i < capacity; i++)
+				slots[i].state = SLOT_EMPTY;
+
+			Slot *old = _slots.Get();
+			size_t old_capacity = _capacity;
+			_slots = slots;
+			_capacity = capacity;
+			_tombstones = 0;
+			for (size_t i = 0; i < old_capacity; i++)
+			{
+				if (old[i].state != SLOT_FULL)
+					continue;
+				Slot *slot = FreeSlot(old[i].Key());
+				new (slot->key) K(std::move(old[i].Key()));
+				new (slot->value) V(std::move(old[i].Value()));
+				slot->state = SLOT_FULL;
+				old[i].Key().~K();
+				old[i].Value().~V();
+			}
+			_arena->Deallocate(old);
+			return true;
+		}
+
+		OffsetPtr<SharedArena> _arena;
+		OffsetPtr<Slot> _slots;
+		size_t _capacity; // Степень двойки
+		size_t _size;
+		size_t _tombstones;
+	};
+
+	/// Арена фиксированного размера внутри T другого сегмента SharedMem
+	template <size_t Bytes>
+	struct SharedArenaStorage
+	{
+		SharedArenaStorage() { SharedArena::Create(bytes, Bytes); }
+		void OnReattach()
+		{
+			if (SharedArena *arena = SharedArena::Attach(bytes))
+				arena->OnReattach();
+		}
+		alignas(ARENA_ALIGN) unsigned char bytes[Bytes];
+	};
+
+	/// Именованный сегмент SharedMem, размеченный под арену. Арена лежит в хвосте
+	/// сегмента и растёт до max_bytes, когда в ней кончается место; остальные
+	/// процессы отображают новую часть сами. Контейнеры арены читаются и меняются
+	/// под Lock(): он же догоняет размер, увеличенный другими. Это не блокировка
+	/// SharedMem - под ней арена растёт через Resize
+	class SharedArenaSegment
+	{
+	public:
+		SharedArenaSegment(const char *name, size_t bytes, size_t max_bytes = 0, bool create_if_not_exists = true)
+			: _mem(name, create_if_not_exists, TailOptions(bytes, max_bytes)), _arena(NULL)
+		{
+			if (!_mem.IsValid() || _mem.Tail() == NULL)
+				return;
+			// Размечает первый подключившийся
+			_mem.Lock();
+			void *tail = _mem.Tail();
+			if (_mem.Data()->formatted == 0)
+			{
+				SharedArena::Create(tail, _mem.TailSize());
+				_mem.Data()->formatted = 1;
+			}
+			_arena = SharedArena::Attach(tail);
+			_mem.Unlock();
+			if (_arena != NULL)
+				ArenaMappings::Register(
+					_arena, [this]
+					{ return _mem.TailSize(); },
+					[this](size_t size)
+					{ return Grow(size); });
+		}
+		~SharedArenaSegment()
+		{
+			if (_arena != NULL)
+				ArenaMappings::Unregister(_arena);
+		}
+		SharedArenaSegment(const SharedArenaSegment &) = delete;
+		SharedArenaSegment &operator=(const SharedArenaSegment &) = delete;
+
+		bool IsValid() { return _arena != NULL; }
+		SharedArena *Arena() { return _arena; }
+		template <class T>
+		T *Root()
+		{
+			return _arena ? _arena->Root<T>() : NULL;
+		}
+		// Блокировка контейнеров; false - прежний владелец умер, не отпустив её
+		bool Lock()
+		{
+			bool clean = _mem.Data()->lock.Lock();
+			if (_arena != NULL)
+				ArenaMappings::Ensure(_arena, _arena->Capacity());
+			return clean;
+		}
+		void Unlock() { _mem.Data()->lock.Unlock(); }
+
+	private:
+		struct Header
+		{
+			Header() : formatted(0) {}
+			int formatted; // Арена в хвосте размечена
+			ArenaMutex lock;
+		};
+
+		static SharedMemOptions TailOptions(size_t bytes, size_t max_bytes)
+		{
+			SharedMemOptions options;
+			options.tail_size = bytes;
+			options.max_tail_size = max_bytes > bytes ? max_bytes : bytes;
+			return options;
+		}
+
+		// Вырасти вдвое (или до size), не больше max_bytes
+		bool Grow(size_t size)
+		{
+			size_t capacity = _arena->Capacity();
+			size_t limit = _mem.MaxTailSize();
+			size_t target = capacity * 2 > size ? capacity * 2 : size;
+			target = target < limit ? target : limit;
+			if (target <= capacity)
+				return capacity >= size;
+			if (!_mem.Resize(target))
+				return false;
+			_arena->Extend(target);
+			return true;
+		}
+
+		SharedMem<Header> _mem;
+		SharedArena *_arena;
+	};
+}
@@ -9,26 +9,34 @@ namespace cplib
     {
     }
 
-    int SharedCounter::getValue()
+    int64_t SharedCounter::getValue()
     {
-        counterMem.Lock();
-        int value = counterMem.Data()->value;
-        counterMem.Unlock();
-        return value;
+        return value().load();
     }
 
-    void SharedCounter::setValue(int value)
+    void SharedCounter::setValue(int64_t new_value)
     {
-        counterMem.Lock();
-        counterMem.Data()->value = value;
-        counterMem.Unlock();
+        value().store(new_value);
     }
 
     void SharedCounter::increment()
     {
-        counterMem.Lock();
-        counterMem.Data()->value++;
-        counterMem.Unlock();
+        value().fetch_add(1, std::memory_order_relaxed);
     }
 
-}
\ No newline at end of file
+    int64_t SharedCounter::fetchAdd(int64_t delta)
+    {
+        return value().fetch_add(delta);
+    }
+
+    bool SharedCounter::compareExchange(int64_t &expected, int64_t desired)
+    {
+        return value().compare_exchange_strong(expected, desired);
+    }
+
+    int64_t SharedCounter::exchange(int64_t new_value)
+    {
+        return value().exchange(new_value);
+    }
+
+}
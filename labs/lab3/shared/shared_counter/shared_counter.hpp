@@ -1,14 +1,20 @@
 #pragma once
 #include "../shared_memory.hpp"
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 namespace cplib
 {
 
+    // Счётчик живёт прямо в общей памяти: lock-free атомик не зависит от адреса
+    // отображения, поэтому работает между процессами без блокировки
+    static_assert(std::atomic<int64_t>::is_always_lock_free, "SharedCounter requires lock-free 64-bit atomics");
+
     struct CounterData
     {
         CounterData() : value(0) {}
-        int value;
+        std::atomic<int64_t> value;
     };
 
     class SharedCounter
@@ -21,12 +27,18 @@ namespace cplib
         {
             return const_cast<SharedMem<CounterData> &>(counterMem).IsValid();
         }
-        int getValue();
-        void setValue(int value);
+        int64_t getValue();
+        void setValue(int64_t value);
         void increment();
 
+        int64_t fetchAdd(int64_t delta);                            // Возвращает прежнее значение
+        bool compareExchange(int64_t &expected, int64_t desired); // При неудаче expected = текущее
+        int64_t exchange(int64_t value);                          // Возвращает прежнее значение
+
     private:
+        std::atomic<int64_t> &value() { return counterMem.Data()->value; }
+
         SharedMem<CounterData> counterMem;
     };
 
-} // namespace cplib
\ No newline at end of file
+} // namespace cplib
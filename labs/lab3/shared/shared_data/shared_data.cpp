@@ -1,4 +1,5 @@
 #include "shared_data.hpp"
+#include <algorithm>
 #if defined(_WIN32)
 #include <windows.h>
 #else
@@ -9,6 +10,36 @@
 namespace cplib
 {
 
+    namespace
+    {
+        const int LEASE_RENEWALS_PER_TERM = 3; // Мастер успевает продлить аренду несколько раз за срок
+
+        int currentProcessId()
+        {
+#if defined(_WIN32)
+            return GetCurrentProcessId();
+#else
+            return getpid();
+#endif
+        }
+
+        // Монотонные часы общие для всех процессов машины (CLOCK_MONOTONIC / QPC)
+        int64_t monotonicNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        uint64_t makeLease(uint32_t epoch, int pid)
+        {
+            return (static_cast<uint64_t>(epoch) << 32) | static_cast<uint32_t>(pid);
+        }
+        uint32_t leaseEpoch(uint64_t lease) { return static_cast<uint32_t>(lease >> 32); }
+        int leasePid(uint64_t lease) { return static_cast<int>(lease & 0xFFFFFFFFu); }
+        int memberPid(uint64_t claim) { return static_cast<int>(claim & 0xFFFFFFFFu); }
+    }
+
     void SharedDataManager::Lock()
     {
         shared_mem_.Lock();
@@ -18,9 +49,74 @@ namespace cplib
         shared_mem_.Unlock();
     }
 
-    SharedDataManager::SharedDataManager(const std::string &name)
-        : shared_mem_(name.c_str())
+    void SharedData::OnReattach()
+    {
+        // Владельцы слотов счётчика ушли, значения слотов - часть счётчика
+        for (int i = 0; i < COUNTER_SHARDS; ++i)
+            counter_shards[i].owner_pid.store(0);
+        // Эпоха продолжается; heartbeat прошлого сеанса мог быть по часам до перезагрузки
+        master_lease.store(master_lease.load() & ~0xFFFFFFFFull);
+        lease_heartbeat_ns.store(0);
+        members.~MemberTable();
+        new (&members) MemberTable();
+    }
+
+    SharedMemOptions SharedDataManager::memOptions(const std::string &persist_file)
+    {
+        SharedMemOptions options;
+        if (!persist_file.empty())
+            options.backing_file = persist_file.c_str();
+        return options;
+    }
+
+    SharedDataManager::SharedDataManager(const std::string &name, const std::string &persist_file)
+        : persistent_(!persist_file.empty()), shared_mem_(name.c_str(), true, memOptions(persist_file))
+    {
+        if (isValid())
+            claimCounterShard();
+    }
+
+    SharedDataManager::~SharedDataManager()
     {
+        resignMaster();
+        unregisterConnection();
+        releaseCounterShard();
+    }
+
+    void SharedDataManager::claimCounterShard()
+    {
+        int pid = currentProcessId();
+        CounterShard *shards = shared_mem_.Data()->counter_shards;
+
+        // Сначала свободный слот, затем слот умершего процесса. Накопленное
+        // значение слота остаётся в сумме, поэтому его не нужно переносить
+        for (int pass = 0; pass < 2 && counter_shard_ < 0; ++pass)
+        {
+            for (int i = 0; i < COUNTER_SHARDS; ++i)
+            {
+                int owner = shards[i].owner_pid.load();
+                bool available = pass == 0 ? owner == 0 : (owner != 0 && !checkProcessAlive(owner));
+                if (available && shards[i].owner_pid.compare_exchange_strong(owner, pid))
+                {
+                    counter_shard_ = i;
+                    break;
+                }
+            }
+        }
+
+        // Слотов не хватило - делим слот с другими процессами, атомарность сохраняется
+        if (counter_shard_ < 0)
+            counter_shard_ = pid % COUNTER_SHARDS;
+    }
+
+    void SharedDataManager::releaseCounterShard()
+    {
+        if (counter_shard_ < 0 || !isValid())
+            return;
+
+        int pid = currentProcessId();
+        shared_mem_.Data()->counter_shards[counter_shard_].owner_pid.compare_exchange_strong(pid, 0);
+        counter_shard_ = -1;
     }
 
     long long SharedDataManager::getCurrentTimestamp()
@@ -30,47 +126,182 @@ namespace cplib
             .count();
     }
 
-    void SharedDataManager::registerConnection()
+    bool SharedDataManager::checkpoint()
     {
-        if (!isValid())
+        return persistent_ && shared_mem_.Checkpoint();
+    }
+
+    uint32_t SharedDataManager::stateVersion()
+    {
+        return shared_mem_.EventSeq();
+    }
+
+    bool SharedDataManager::waitStateChange(uint32_t seen, std::chrono::milliseconds timeout)
+    {
+        return shared_mem_.WaitEvent(seen, static_cast<int>(timeout.count()));
+    }
+
+    void SharedDataManager::resignMaster()
+    {
+        if (!isValid() || lease_ == 0)
             return;
 
-        Lock();
-        // Регистрация времени подключения
-        if (shared_mem_.Data()->connection_count < 10)
+        // Эпоха остаётся, PID 0 - место свободно без ожидания срока
+        uint64_t lease = lease_;
+        lease_ = 0;
+        if (shared_mem_.Data()->master_lease.compare_exchange_strong(lease, makeLease(leaseEpoch(lease), 0)))
+            notifyMasterChange();
+    }
+
+    int SharedDataManager::popFreeMember()
+    {
+        MemberTable &table = shared_mem_.Data()->members;
+        uint64_t head = table.free_head.load();
+        while (true)
         {
-            shared_mem_.Data()->connection_timestamps[shared_mem_.Data()->connection_count] = getCurrentTimestamp();
-            shared_mem_.Data()->connection_count++;
+            uint32_t top = static_cast<uint32_t>(head);
+            if (top == 0)
+                return -1; // Все слоты заняты
+            // next_free может быть устаревшим, если вершину успели снять и вернуть -
+            // тогда изменился тег и CAS не пройдёт
+            uint32_t next = table.slots[top - 1].next_free.load();
+            uint64_t tag = (head >> 32) + 1;
+            if (table.free_head.compare_exchange_weak(head, (tag << 32) | next))
+                return static_cast<int>(top - 1);
         }
-        Unlock();
     }
 
-    bool SharedDataManager::checkMasterAlive()
+    void SharedDataManager::pushFreeMember(int slot)
     {
-        if (!isValid())
+        MemberTable &table = shared_mem_.Data()->members;
+        uint64_t head = table.free_head.load();
+        do
+        {
+            table.slots[slot].next_free.store(static_cast<uint32_t>(head));
+        } while (!table.free_head.compare_exchange_weak(head, (((head >> 32) + 1) << 32) | static_cast<uint32_t>(slot + 1)));
+    }
+
+    bool SharedDataManager::releaseMember(int slot, uint64_t claim)
+    {
+        MemberTable &table = shared_mem_.Data()->members;
+        // PID обнуляем, поколение оставляем: следующий захват его увеличит
+        if (!table.slots[slot].claim.compare_exchange_strong(claim, claim & ~0xFFFFFFFFull))
             return false;
+        table.alive.fetch_sub(1);
+        pushFreeMember(slot);
+        return true;
+    }
 
-        Lock();
-        int master_pid = shared_mem_.Data()->master_pid;
-        Unlock();
+    bool SharedDataManager::registerConnection()
+    {
+        if (!isValid())
+            return false;
+        if (member_slot_ >= 0)
+            return true;
 
-        if (master_pid == 0)
+        int slot = popFreeMember();
+        if (slot < 0)
             return false;
 
-        // Проверяем, жив ли мастер
-#if defined(_WIN32)
-        HANDLE process = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, master_pid);
-        if (process)
+        MemberTable &table = shared_mem_.Data()->members;
+        MemberSlot &member = table.slots[slot];
+        member.heartbeat_ns.store(monotonicNs());
+        member.joined_ms.store(getCurrentTimestamp());
+        uint64_t generation = (member.claim.load() >> 32) + 1;
+        member_claim_ = (generation << 32) | static_cast<uint32_t>(currentProcessId());
+        member.claim.store(member_claim_);
+        table.alive.fetch_add(1);
+        member_slot_ = slot;
+        return true;
+    }
+
+    void SharedDataManager::unregisterConnection()
+    {
+        if (member_slot_ < 0 || !isValid())
+            return;
+        releaseMember(member_slot_, member_claim_);
+        member_slot_ = -1;
+        member_claim_ = 0;
+    }
+
+    void SharedDataManager::heartbeat()
+    {
+        if (member_slot_ < 0 || !isValid())
+            return;
+
+        MemberSlot &member = shared_mem_.Data()->members.slots[member_slot_];
+        member.heartbeat_ns.store(monotonicNs());
+        // Слот собрали, пока мы не отвечали: занимаем новый
+        if (member.claim.load() != member_claim_)
         {
-            DWORD exit_code;
-            GetExitCodeProcess(process, &exit_code);
-            CloseHandle(process);
-            return (exit_code == STILL_ACTIVE);
+            member_slot_ = -1;
+            registerConnection();
         }
-        return false;
-#else
-        return (kill(master_pid, 0) == 0);
-#endif
+    }
+
+    int SharedDataManager::memberCount()
+    {
+        return isValid() ? shared_mem_.Data()->members.alive.load() : 0;
+    }
+
+    int SharedDataManager::reapMembers()
+    {
+        if (!isValid())
+            return 0;
+
+        MemberTable &table = shared_mem_.Data()->members;
+        int64_t deadline = monotonicNs() - MEMBER_TIMEOUT_MS * 1000000LL;
+        int reaped = 0;
+        for (int i = 0; i < MEMBER_SLOTS; ++i)
+        {
+            MemberSlot &member = table.slots[i];
+            uint64_t claim = member.claim.load();
+            if (memberPid(claim) != 0 && member.heartbeat_ns.load() < deadline && releaseMember(i, claim))
+                reaped++;
+        }
+        return reaped;
+    }
+
+    std::vector<MemberInfo> SharedDataManager::members()
+    {
+        std::vector<MemberInfo> result;
+        if (!isValid())
+            return result;
+
+        MemberTable &table = shared_mem_.Data()->members;
+        int64_t now = monotonicNs();
+        for (int i = 0; i < MEMBER_SLOTS; ++i)
+        {
+            MemberSlot &member = table.slots[i];
+            int pid = memberPid(member.claim.load());
+            if (pid == 0)
+                continue;
+            long long age_ms = (now - member.heartbeat_ns.load()) / 1000000;
+            result.push_back({pid, member.joined_ms.load(), age_ms,
+                              age_ms < MEMBER_TIMEOUT_MS ? MemberState::Alive : MemberState::Stale});
+        }
+        return result;
+    }
+
+    bool SharedDataManager::checkMasterAlive()
+    {
+        return masterPid() != 0;
+    }
+
+    int SharedDataManager::masterPid()
+    {
+        if (!isValid())
+            return 0;
+
+        SharedData *data = shared_mem_.Data();
+        int pid = leasePid(data->master_lease.load());
+        int64_t age = monotonicNs() - data->lease_heartbeat_ns.load();
+        return age < data->lease_duration_ns.load() ? pid : 0;
+    }
+
+    uint32_t SharedDataManager::masterEpoch()
+    {
+        return isValid() ? leaseEpoch(shared_mem_.Data()->master_lease.load()) : 0;
     }
 
     void SharedDataManager::becomeMaster()
@@ -78,15 +309,10 @@ namespace cplib
         if (!isValid())
             return;
 
-        Lock();
-        shared_mem_.Data()->master_pid =
-#if defined(_WIN32)
-            GetCurrentProcessId();
-#else
-            getpid();
-#endif
-        shared_mem_.Data()->master_timestamp = getCurrentTimestamp();
-        Unlock();
+        SharedData *data = shared_mem_.Data();
+        uint64_t lease = data->master_lease.load();
+        while (lease != lease_ && !takeLease(lease))
+            lease = data->master_lease.load();
     }
 
     bool SharedDataManager::isMaster()
@@ -94,76 +320,123 @@ namespace cplib
         if (!isValid())
             return false;
 
-        // Блокируем для чтения master_pid
-        Lock();
-        int master_pid = shared_mem_.Data()->master_pid;
-        Unlock();
-
-        // Если master_pid = 0, значит мастер еще не назначен
-        if (master_pid == 0)
-        {
-            Lock();
-            shared_mem_.Data()->master_pid =
-#if defined(_WIN32)
-                GetCurrentProcessId();
-#else
-                getpid();
-#endif
-            Unlock();
+        SharedData *data = shared_mem_.Data();
+        uint64_t lease = data->master_lease.load();
+        int64_t heartbeat = data->lease_heartbeat_ns.load();
+        int64_t now = monotonicNs();
+        int64_t duration = data->lease_duration_ns.load();
+        // Чужой heartbeat при нашей аренде - претендент уже перехватывает истёкшую
+        if (lease_ != 0 && lease == lease_ && heartbeat == lease_heartbeat_ && now - heartbeat < duration)
             return true;
-        }
+        lease_ = 0;
 
-        // Проверяем, жив ли мастер
-#if defined(_WIN32)
-        HANDLE process = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, master_pid);
-        if (process)
+        // Аренда действует - мастер есть. PID сам по себе не проверяем: он мог
+        // достаться другому процессу, а продлевать аренду умерший мастер уже не будет
+        if (leasePid(lease) != 0 && now - heartbeat < duration)
+            return false;
+
+        // Среди кандидатов, увидевших одно и то же истёкшее продление,
+        // дальше пройдёт только один: остальные увидят свежий heartbeat
+        if (!data->lease_heartbeat_ns.compare_exchange_strong(heartbeat, now))
+            return false;
+        return takeLease(lease);
+    }
+
+    bool SharedDataManager::takeLease(uint64_t expected)
+    {
+        SharedData *data = shared_mem_.Data();
+        int pid = currentProcessId();
+        uint64_t lease = makeLease(leaseEpoch(expected) + 1, pid);
+        // Свежий heartbeat до смены владельца: новая аренда не выглядит истёкшей ни мгновения
+        int64_t now = monotonicNs();
+        data->lease_heartbeat_ns.store(now);
+        if (!data->master_lease.compare_exchange_strong(expected, lease))
+            return false;
+
+        lease_ = lease;
+        lease_heartbeat_ = now;
+        notifyMasterChange();
+        return true;
+    }
+
+    void SharedDataManager::notifyMasterChange()
+    {
+        // Будит ждущих в waitStateChange
+        shared_mem_.SignalEvent();
+    }
+
+    bool SharedDataManager::renewLease()
+    {
+        if (!isValid() || lease_ == 0)
+            return false;
+
+        SharedData *data = shared_mem_.Data();
+        int64_t now = monotonicNs();
+        int64_t heartbeat = lease_heartbeat_;
+        // Истёкшую аренду не продлеваем: претендент мог уже сменить heartbeat и вот-вот
+        // сменит master_lease. CAS с нашего значения - кто-то писал heartbeat после нас
+        if (data->master_lease.load() != lease_ || now - heartbeat >= data->lease_duration_ns.load() ||
+            !data->lease_heartbeat_ns.compare_exchange_strong(heartbeat, now))
         {
-            DWORD exit_code;
-            GetExitCodeProcess(process, &exit_code);
-            CloseHandle(process);
-            if (exit_code == STILL_ACTIVE)
-            {
-                return false; // Мастер жив, мы не мастер
-            }
+            lease_ = 0;
+            return false;
         }
-        // Мастер умер, становимся мастером
-        Lock();
-        shared_mem_.Data()->master_pid = GetCurrentProcessId();
-        Unlock();
+        lease_heartbeat_ = now;
         return true;
-#else
-        if (kill(master_pid, 0) == 0)
+    }
+
+    void SharedDataManager::setLeaseDuration(std::chrono::milliseconds duration)
+    {
+        if (isValid())
+            shared_mem_.Data()->lease_duration_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+    std::chrono::milliseconds SharedDataManager::nextCheckDelay()
+    {
+        using std::chrono::milliseconds;
+        if (!isValid())
+            return milliseconds(DEFAULT_LEASE_MS);
+
+        SharedData *data = shared_mem_.Data();
+        int64_t duration = data->lease_duration_ns.load();
+        int64_t delay = duration / LEASE_RENEWALS_PER_TERM;
+        if (lease_ == 0)
         {
-            return false; // Мастер жив
+            // До истечения текущей аренды (мастера нет - проверяем сразу)
+            uint64_t lease = data->master_lease.load();
+            delay = leasePid(lease) == 0 ? 0 : data->lease_heartbeat_ns.load() + duration - monotonicNs();
         }
-        // Мастер умер, становимся мастером
-        Lock();
-        shared_mem_.Data()->master_pid = getpid();
-        Unlock();
-        return true;
-#endif
+        // Округляем вверх, чтобы не проснуться за мгновение до срока
+        return milliseconds(std::max<int64_t>(1, (delay + 999999) / 1000000));
     }
 
-    int SharedDataManager::getCounter()
+    int64_t SharedDataManager::getCounter()
     {
-        Lock();
-        int value = shared_mem_.Data()->counter;
-        Unlock();
+        SharedData *data = shared_mem_.Data();
+        int64_t value = data->counter_base.load();
+        for (int i = 0; i < COUNTER_SHARDS; ++i)
+            value += data->counter_shards[i].value.load(std::memory_order_relaxed);
         return value;
     }
 
-    void SharedDataManager::setCounter(int value)
+    void SharedDataManager::setCounter(int64_t value)
     {
+        // Инкременты, пришедшие во время подсчёта суммы, сохраняются поверх нового значения
+        SharedData *data = shared_mem_.Data();
         Lock();
-        shared_mem_.Data()->counter = value;
+        int64_t shards = 0;
+        for (int i = 0; i < COUNTER_SHARDS; ++i)
+            shards += data->counter_shards[i].value.load(std::memory_order_relaxed);
+        data->counter_base.store(value - shards);
         Unlock();
     }
 
     void SharedDataManager::incrementCounter()
     {
-        Lock();
-        shared_mem_.Data()->counter++;
-        Unlock();
+        if (counter_shard_ < 0)
+            return;
+        // Только свой слот: кэш-линия не гоняется между ядрами
+        shared_mem_.Data()->counter_shards[counter_shard_].value.fetch_add(1, std::memory_order_relaxed);
     }
 
     bool SharedDataManager::checkProcessAlive(int pid)
@@ -187,34 +460,4 @@ namespace cplib
 #endif
     }
 
-    int SharedDataManager::getChild1Pid()
-    {
-        shared_mem_.Lock();
-        int pid = shared_mem_.Data()->child1_pid;
-        shared_mem_.Unlock();
-        return pid;
-    }
-
-    void SharedDataManager::setChild1Pid(int pid)
-    {
-        shared_mem_.Lock();
-        shared_mem_.Data()->child1_pid = pid;
-        shared_mem_.Unlock();
-    }
-
-    int SharedDataManager::getChild2Pid()
-    {
-        shared_mem_.Lock();
-        int pid = shared_mem_.Data()->child2_pid;
-        shared_mem_.Unlock();
-        return pid;
-    }
-
-    void SharedDataManager::setChild2Pid(int pid)
-    {
-        shared_mem_.Lock();
-        shared_mem_.Data()->child2_pid = pid;
-        shared_mem_.Unlock();
-    }
-
-}
\ No newline at end of file
+}
@@ -3,50 +3,161 @@
 #include "../shared_memory.hpp"
 #include <string>
 #include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 namespace cplib
 {
 
+    const int COUNTER_SHARDS = 64;
+    const int CACHE_LINE_SIZE = 64;
+    const int DEFAULT_LEASE_MS = 1000;
+    const int MEMBER_SLOTS = 4096;
+    const int MEMBER_TIMEOUT_MS = 5000; // Участник без heartbeat дольше - считается умершим
+
+    // Слот счётчика одного процесса: своя кэш-линия, инкремент не задевает соседей
+    struct alignas(CACHE_LINE_SIZE) CounterShard
+    {
+        CounterShard() : value(0), owner_pid(0) {}
+        std::atomic<int64_t> value;
+        std::atomic<int> owner_pid; // 0 - слот свободен (значение при этом сохраняется)
+    };
+
+    // Участник группы. claim: поколение (старшие 32 бита) и PID (младшие), PID 0 - слот
+    // свободен. Поколение меняется при каждом захвате, поэтому освободить слот
+    // (сам владелец или сборщик мёртвых) удаётся ровно одному
+    struct alignas(CACHE_LINE_SIZE) MemberSlot
+    {
+        MemberSlot() : claim(0), heartbeat_ns(0), joined_ms(0), next_free(0) {}
+        std::atomic<uint64_t> claim;
+        std::atomic<int64_t> heartbeat_ns; // steady_clock
+        std::atomic<int64_t> joined_ms;    // Время подключения
+        std::atomic<uint32_t> next_free;   // Номер следующего свободного + 1
+    };
+
+    // Таблица участников: свободные слоты - lock-free стек (Трайбер) с тегом против ABA
+    struct MemberTable
+    {
+        MemberTable() : free_head(0), alive(0)
+        {
+            for (int i = 0; i < MEMBER_SLOTS; ++i)
+                slots[i].next_free.store(i + 1 < MEMBER_SLOTS ? i + 2 : 0);
+            free_head.store(1); // Тег 0, вершина - слот 0
+        }
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> free_head; // Тег (32) | номер вершины + 1 (32)
+        alignas(CACHE_LINE_SIZE) std::atomic<int> alive;          // Занятые слоты, читается за O(1)
+        MemberSlot slots[MEMBER_SLOTS];
+    };
+
+    enum class MemberState
+    {
+        Alive, // heartbeat свежий
+        Stale  // heartbeat просрочен, слот ещё не собран
+    };
+
+    struct MemberInfo
+    {
+        int pid;
+        long long joined_ms;
+        long long heartbeat_age_ms;
+        MemberState state;
+    };
+
     struct SharedData
     {
-        SharedData() : counter(0), master_pid(0), child1_pid(0), child2_pid(0), master_timestamp(0), connection_count(0) {}
-        int counter;
-        int master_pid;                      // PID процесса-мастера
-        int child1_pid;                      // PID первой копии
-        int child2_pid;                      // PID второй копии
-        long long master_timestamp;          // Время когда процесс стал мастером
-        long long connection_timestamps[10]; // Времена подключения процессов
-
-        int connection_count;
+        SharedData()
+            : counter_base(0), master_lease(0), lease_heartbeat_ns(0),
+              lease_duration_ns(DEFAULT_LEASE_MS * 1000000LL) {}
+        // Сегмент продолжен из файла прошлого сеанса (SharedMem с backing_file):
+        // сбрасываем всё, что относится к процессам того сеанса. Счётчик сохраняется
+        void OnReattach();
+        // Значение счётчика = counter_base + сумма по слотам
+        alignas(CACHE_LINE_SIZE) std::atomic<int64_t> counter_base;
+        CounterShard counter_shards[COUNTER_SHARDS];
+
+        // Аренда мастера: эпоха (старшие 32 бита) и PID (младшие) одним словом.
+        // Мастер продлевает heartbeat, по истечении срока место занимают CAS'ом
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> master_lease;
+        std::atomic<int64_t> lease_heartbeat_ns; // steady_clock последнего продления
+        std::atomic<int64_t> lease_duration_ns;
+
+        MemberTable members;
     };
 
     class SharedDataManager
     {
     public:
-        SharedDataManager(const std::string &name);
-        ~SharedDataManager() = default;
+        // persist_file - хранить состояние в файле: оно переживает выход всех процессов
+        SharedDataManager(const std::string &name, const std::string &persist_file = "");
+        ~SharedDataManager();
 
         bool isValid() { return shared_mem_.IsValid(); }
+        // Держим неистёкшую аренду - true; иначе пробуем занять истёкшую
         bool isMaster();
+        // Аренда мастера не истекла
         bool checkMasterAlive();
         bool checkProcessAlive(int pid);
+        // Занять место мастера, не дожидаясь истечения аренды
         void becomeMaster();
-        int getCounter();
-        void setCounter(int value);
+        // Продление аренды мастером; false - аренду перехватили или она уже истекла
+        bool renewLease();
+        // Срок аренды общий для всех процессов: за это время без продления мастер считается мёртвым
+        void setLeaseDuration(std::chrono::milliseconds duration);
+        // Когда мастеру продлевать аренду, а остальным - проверять её истечение
+        std::chrono::milliseconds nextCheckDelay();
+        int masterPid();        // 0 - мастера нет или аренда истекла
+        uint32_t masterEpoch(); // Растёт при каждой смене мастера
+        int64_t getCounter();
+        void setCounter(int64_t value);
         void incrementCounter();
-        void registerConnection();
 
-        int getChild1Pid();
-        void setChild1Pid(int pid);
-        int getChild2Pid();
-        void setChild2Pid(int pid);
+        // Участие в группе: занять слот, продлевать heartbeat, освободить при выходе
+        // (деструктор делает это сам). Мёртвые участники собираются reapMembers()
+        bool registerConnection();
+        void unregisterConnection();
+        void heartbeat(); // Если слот успели собрать - регистрируется заново
+        int memberCount();  // Занятые слоты, O(1). Умершие в них - пока их не соберёт reapMembers()
+        int reapMembers();  // Освободить слоты с просроченным heartbeat; сколько освобождено
+        std::vector<MemberInfo> members();
+
+        // Режим файла: контрольная точка на диск (см. SharedMem::Checkpoint)
+        bool checkpoint();
+        bool isPersistent() { return persistent_; }
+        bool resumed() { return shared_mem_.Reattached(); }
+
+        // Ожидание изменения состояния без опроса: запомнить stateVersion(),
+        // проверить, что нужно, и заснуть до следующей записи или таймаута
+        uint32_t stateVersion();
+        bool waitStateChange(uint32_t seen, std::chrono::milliseconds timeout);
+        // Мастер уходит: освобождает место, ждущие просыпаются сразу
+        void resignMaster();
 
         void Lock();
         void Unlock();
 
     private:
         long long getCurrentTimestamp();
+        bool takeLease(uint64_t expected);
+        void notifyMasterChange();
+
+        void claimCounterShard();
+        void releaseCounterShard();
+
+        int popFreeMember();
+        void pushFreeMember(int slot);
+        // Освободить слот, если в нём всё ещё claim; false - его освободил кто-то другой
+        bool releaseMember(int slot, uint64_t claim);
+
+        static SharedMemOptions memOptions(const std::string &persist_file);
+
+        bool persistent_;
         SharedMem<SharedData> shared_mem_;
+        int counter_shard_ = -1; // Слот этого процесса в counter_shards
+        uint64_t lease_ = 0;     // Наша аренда, 0 - мы не мастер
+        int64_t lease_heartbeat_ = 0; // Heartbeat аренды, записанный нами последним
+        int member_slot_ = -1;
+        uint64_t member_claim_ = 0;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+#if defined(__linux__)
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Ожидание изменения 32-битного слова в общей памяти.
+// Linux - futex без FUTEX_PRIVATE_FLAG, поэтому работает между процессами.
+// В остальных системах межпроцессного аналога нет (WaitOnAddress - только внутри
+// процесса), там слово опрашивается с короткими паузами
+
+namespace cplib
+{
+	const int FUTEX_FALLBACK_POLL_MS = 1;
+
+	// Ждать, пока *word != expected. false - вышел таймаут (timeout_ms < 0 - без таймаута)
+	inline bool FutexWait(std::atomic<uint32_t> *word, uint32_t expected, int timeout_ms)
+	{
+		static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32-bit value");
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		while (word->load(std::memory_order_acquire) == expected)
+		{
+			auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+			if (timeout_ms >= 0 && left.count() <= 0)
+				return false;
+#if defined(__linux__)
+			struct timespec ts;
+			ts.tv_sec = left.count() / 1000000000;
+			ts.tv_nsec = left.count() % 1000000000;
+			// EAGAIN - значение уже сменилось, EINTR - сигнал: перепроверим в цикле
+			if (syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected,
+						timeout_ms >= 0 ? &ts : NULL, NULL, 0) != 0 &&
+				errno == ETIMEDOUT)
+				return word->load(std::memory_order_acquire) != expected;
+#else
+			std::this_thread::sleep_for(std::chrono::milliseconds(FUTEX_FALLBACK_POLL_MS));
+#endif
+		}
+		return true;
+	}
+
+	// Разбудить всех ждущих на слове
+	inline void FutexWakeAll(std::atomic<uint32_t> *word)
+	{
+#if defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+		(void)word;
+#endif
+	}
+}
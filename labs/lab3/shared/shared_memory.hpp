@@ -1,35 +1,85 @@
-
 #pragma once
 
 #include <string.h> // strlen()
 #include <stdlib.h> // malloc()
+#include <new>		// placement new
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include "shared_futex.hpp"
 #if defined(WIN32)
 #include <windows.h>
 #define MAP_NAME_PREFIX "Local\\"
 #define INV_HANDLE (NULL)
-#define CSEM HANDLE
 #else
 #include <sys/mman.h>
-#include <sys/stat.h>  /* Константы режимов */
-#include <fcntl.h>	   /* Константы O_* */
-#include <unistd.h>	   /* ftruncate() */
-#include <semaphore.h> /* семафоры */
+#include <sys/stat.h> /* Константы режимов */
+#include <fcntl.h>	  /* Константы O_* */
+#include <unistd.h>	  /* ftruncate() */
+#include <pthread.h>  /* robust mutex */
+#include <errno.h>
+#include <signal.h>   /* kill() */
+#if defined(__linux__)
+#include <sys/vfs.h>	  /* statfs() */
+#include <linux/magic.h> /* HUGETLBFS_MAGIC */
+#endif
 #define HANDLE int
 #define INV_HANDLE (-1)
 #define MAP_NAME_PREFIX "/"
-#define CSEM sem_t *
+#define HUGETLBFS_DIR "/dev/hugepages"
 #endif
 
 #define SEM_NAME_POSTFIX "_sem"
 
 namespace cplib
 {
+	enum class SharedMemPages
+	{
+		Normal,
+		Transparent, // Прозрачные большие страницы (MADV_HUGEPAGE), если ядро их даёт для shmem
+		Huge		 // Явные: файл на hugetlbfs (Windows - SEC_LARGE_PAGES), иначе как Transparent
+	};
+
+	struct SharedMemOptions
+	{
+		// Хвост сегмента - область переменного размера сразу за T
+		size_t tail_size = 0;	  // Начальный размер хвоста
+		size_t max_tail_size = 0; // До какого размера хвост может вырасти (Resize), 0 - не растёт
+		// Обычный файл вместо объекта shm: состояние переживает выход всех процессов,
+		// рядом лежит <файл>.ckpt с двумя копиями T на случай сбоя (см. Checkpoint)
+		const char *backing_file = NULL;
+
+		// Отображение в этом процессе
+		bool populate = false;	 // Отобразить все страницы сразу, без page fault при первом обращении
+		bool lock_pages = false; // Не выгружать страницы в swap (mlock), см. PagesLocked
+		bool read_only = false;	 // T и хвост только для чтения: запись - SIGSEGV. Lock работает
+		// Размер страниц задаёт создатель. Явные большие страницы - только для сегмента
+		// без backing_file и без роста хвоста (hugetlbfs не дробит страницы)
+		SharedMemPages pages = SharedMemPages::Normal;
+	};
+
+	// FNV-1a
+	inline uint64_t HashBytes(const void *data, size_t length)
+	{
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < length; i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		return hash;
+	}
+
 	template <class T>
 	class SharedMem
 	{
 	public:
-		SharedMem(const char *name, bool create_if_not_exists = true) : _fd(INV_HANDLE), _mem(NULL), _sem(NULL)
+		SharedMem(const char *name, bool create_if_not_exists = true, const SharedMemOptions &options = SharedMemOptions())
+			: _mem(NULL), _fd(INV_HANDLE), _backing(NULL), _options(options), _mapped_tail(0), _generation(0)
 		{
+			if (_options.max_tail_size < _options.tail_size)
+				_options.max_tail_size = _options.tail_size;
+			if (_options.backing_file != NULL)
+				_backing = strdup(_options.backing_file);
+
 			// Получим системное имя для объекта памяти
 			_fname = (char *)malloc(strlen(name) + strlen(MAP_NAME_PREFIX) + 1);
 			memcpy(_fname, MAP_NAME_PREFIX, strlen(MAP_NAME_PREFIX));
@@ -37,30 +87,50 @@ namespace cplib
 			_semname = (char *)malloc(strlen(_fname) + strlen(SEM_NAME_POSTFIX) + 1);
 			memcpy(_semname, _fname, strlen(_fname));
 			memcpy(_semname + strlen(_fname), SEM_NAME_POSTFIX, strlen(SEM_NAME_POSTFIX) + 1);
+#if !defined(WIN32)
+			_hugename = (char *)malloc(strlen(HUGETLBFS_DIR) + strlen(_fname) + 1);
+			memcpy(_hugename, HUGETLBFS_DIR, strlen(HUGETLBFS_DIR));
+			memcpy(_hugename + strlen(HUGETLBFS_DIR), _fname, strlen(_fname) + 1);
+#endif
 
 			// Попытаемся открыть или создать область памяти
 			bool is_new = false;
 			bool ret = OpenMem(_fname, _semname);
 			if (!ret && create_if_not_exists)
 			{
-				if (ret = CreateMem(_fname, _semname))
+				ret = CreateMem(_fname, _semname);
+				if (ret)
 					is_new = true;
 			}
+			// Huge без hugetlbfs (или растущий сегмент) - хотя бы прозрачные большие страницы
+			_thp = _options.pages == SharedMemPages::Transparent || (_options.pages == SharedMemPages::Huge && !_huge);
 			// Попытаемся подключить область памяти
 			if (ret)
 				ret = MapMem();
-			// Если подключили новую память - ее необходимо инициализировать
+			// Режим файла: готовит сегмент только первый процесс сеанса. Файл прошлого
+			// сеанса продолжаем, если его заголовок от того же T
+			if (ret && _backing != NULL)
+				is_new = _first && (_file_created || _mem->magic != FILE_MAGIC || _mem->layout_size != sizeof(shmem_contents) || _mem->data_size != sizeof(T));
+			if (ret && _backing != NULL)
+				ret = OpenCheckpoints();
+			// Если подключили новую память - ее необходимо инициализировать,
+			// если файл прошлого сеанса - подготовить к работе,
+			// иначе дождёмся, пока это сделает создатель
 			if (ret && is_new)
-			{
-				_mem->cnt = 0;
-				_mem->str = T();
-			}
+				ret = InitMem();
+			else if (ret && _backing != NULL && _first)
+				ret = ReattachMem();
+			else if (ret)
+				ret = WaitReady();
+			if (ret)
+				ret = MapTail();
 			if (ret)
 			{
 				// Зарегистрируемся
-				LockSema();
+				Lock();
 				_mem->cnt++;
-				UnlockSema();
+				Unlock();
+				UnlockFileByte(FILE_INIT_LOCK_BYTE);
 			}
 			else
 			{
@@ -76,80 +146,585 @@ namespace cplib
 			if (IsValid())
 			{
 				int cnt = 0;
-				LockSema();
+				// Пока уходим, новый процесс файла не подключит
+				LockFileByte(FILE_INIT_LOCK_BYTE, true, true);
+				Lock();
 				_mem->cnt--;
 				cnt = _mem->cnt;
-				UnlockSema();
+				Unlock();
+				if (cnt <= 0 && _backing != NULL)
+				{
+					// Последний: сохраняем состояние и помечаем, что сеанс завершён штатно
+					Checkpoint();
+					_mem->clean_shutdown = 1;
+					FlushMem();
+				}
 				if (cnt <= 0)
 					DestroyMem();
 				else
 					CloseMem();
 			}
+			CloseCheckpoints();
 			// Освободим память, занятую строками с именами
 			free(_fname);
 			free(_semname);
+			free(_backing);
+#if !defined(WIN32)
+			free(_hugename);
+#endif
+		}
+		bool IsValid()
+		{
+#if defined(WIN32)
+			return _fd != INV_HANDLE && _mutex != NULL && _mem != NULL;
+#else
+			return _fd != INV_HANDLE && _mem != NULL;
+#endif
 		}
-		bool IsValid() { return _fd != INV_HANDLE && _sem != NULL && _mem != NULL; }
-		void Lock() { LockSema(); }
+		// true - блокировка захвачена, в том числе после смерти прежнего владельца
+		// (тогда данные могут быть несогласованы, см. Recoveries). false - ошибка,
+		// блокировка не захвачена и Unlock вызывать нельзя
+		bool Lock() { return LockMutex(); }
 		T *Data()
 		{
 			if (!IsValid())
 				return NULL;
 			return &_mem->str;
 		}
-		void Unlock() { UnlockSema(); }
+		void Unlock() { UnlockMutex(); }
+		// Сколько раз блокировку пришлось восстанавливать после смерти владельца
+		int Recoveries() { return IsValid() ? _mem->recoveries.load() : 0; }
+		// Сегмент на явных больших страницах (pages = Huge удалось)
+		bool HugePages() { return _huge; }
+		// lock_pages: все отображённые страницы закреплены (не упёрлись в RLIMIT_MEMLOCK)
+		bool PagesLocked() { return _options.lock_pages && _locked; }
+
+		// Режим backing_file: T продолжен из файла прошлого сеанса (а не создан заново)
+		bool Reattached() { return _reattached; }
+		// ...причём восстановлен из контрольной точки: прошлый сеанс оборвался вместе с системой
+		bool RestoredFromCheckpoint() { return _restored; }
+		// Режим backing_file: снимок T в более старую из двух копий в <файл>.ckpt и
+		// сброс на диск. Копия записывается под блокировкой сегмента; поля, которые
+		// меняются без неё (атомики), попадают в снимок на момент копирования
+		bool Checkpoint()
+		{
+			if (!IsValid() || _ckpt == NULL)
+				return false;
+			Lock();
+			CheckpointSlot *newest = NewestCheckpoint();
+			uint64_t seq = newest ? newest->seq + 1 : 1;
+			CheckpointSlot &slot = _ckpt->slots[seq % 2];
+			// Пока копия не дописана, её номер недействителен
+			slot.seq = 0;
+			slot.size = sizeof(T);
+			memcpy(slot.data, static_cast<void *>(&_mem->str), sizeof(T));
+			slot.checksum = CheckpointChecksum(slot, seq);
+			slot.seq = seq;
+			Unlock();
+			return FlushMem() && FlushCheckpoints();
+		}
+
+		// Событие сегмента: номер растёт при каждом SignalEvent.
+		// Ждущий запоминает EventSeq(), проверяет своё условие и засыпает в WaitEvent
+		uint32_t EventSeq() { return IsValid() ? _mem->event_seq.load(std::memory_order_seq_cst) : 0; }
+		// false - за timeout_ms событий после seen не было
+		bool WaitEvent(uint32_t seen, int timeout_ms)
+		{
+			if (!IsValid())
+				return false;
+			// Счётчик ждущих до проверки номера: SignalEvent либо увидит нас,
+			// либо мы увидим новый номер
+			_mem->event_waiters.fetch_add(1, std::memory_order_seq_cst);
+			bool changed = FutexWait(&_mem->event_seq, seen, timeout_ms);
+			_mem->event_waiters.fetch_sub(1, std::memory_order_relaxed);
+			return changed;
+		}
+		void SignalEvent()
+		{
+			if (!IsValid())
+				return;
+			_mem->event_seq.fetch_add(1, std::memory_order_seq_cst);
+			// Системный вызов - только если кто-то спит
+			if (_mem->event_waiters.load(std::memory_order_seq_cst) > 0)
+				FutexWakeAll(&_mem->event_seq);
+		}
+
+		// Хвост сегмента. Адрес не меняется при росте, поэтому указатели в него
+		// остаются действительными; новый размер подхватывается при обращении
+		void *Tail()
+		{
+			if (!IsValid() || !Refresh())
+				return NULL;
+			return reinterpret_cast<char *>(_mem) + sizeof(shmem_contents);
+		}
+		size_t TailSize()
+		{
+			Refresh();
+			return _mapped_tail;
+		}
+		size_t MaxTailSize() { return IsValid() ? _mem->max_tail_size : 0; }
+		// Увеличить хвост для всех процессов. Остальные отобразят новый размер
+		// при следующем Tail()/Refresh(), без остановки. Уменьшение не поддерживается
+		bool Resize(size_t tail_size)
+		{
+			if (!IsValid() || tail_size > _mem->max_tail_size || _options.read_only)
+				return false;
+			Lock();
+			bool ok = true;
+			if (tail_size > _mem->tail_size.load(std::memory_order_relaxed))
+			{
+#if defined(WIN32)
+				ok = _backing != NULL || VirtualAlloc(_mem, sizeof(shmem_contents) + tail_size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+				ok = ftruncate(_fd, sizeof(shmem_contents) + tail_size) == 0;
+#endif
+				if (ok)
+				{
+					_mem->tail_size.store(tail_size, std::memory_order_relaxed);
+					_mem->generation.fetch_add(1, std::memory_order_release);
+				}
+			}
+			Unlock();
+			return ok && Refresh();
+		}
+		// Догнать размер, установленный другим процессом
+		bool Refresh()
+		{
+			if (!IsValid())
+				return false;
+			uint32_t generation = _mem->generation.load(std::memory_order_acquire);
+			// Быстрый путь - одно атомарное чтение
+			if (generation == _generation.load(std::memory_order_acquire))
+				return true;
+			std::lock_guard<std::mutex> guard(_remap_mutex);
+			if (generation == _generation.load(std::memory_order_relaxed))
+				return true;
+			if (!MapTailPages(_mem->tail_size.load(std::memory_order_relaxed)))
+				return false;
+			_generation.store(generation, std::memory_order_release);
+			return true;
+		}
 
 	private:
 		bool OpenMem(const char *mem_name, const char *sem_name)
 		{
 #if defined(WIN32)
+			// Режим файла: открытое отображение с этим именем значит, что сеанс идёт
 			_fd = OpenFileMapping(FILE_MAP_WRITE, true, mem_name);
 			if (_fd != INV_HANDLE)
-				_sem = OpenSemaphore(SEMAPHORE_ALL_ACCESS, false, sem_name);
+				_mutex = OpenMutex(SYNCHRONIZE | MUTEX_MODIFY_STATE, false, sem_name);
+			// Сам файл - для сброса на диск в Checkpoint
+			if (_fd != INV_HANDLE && _backing != NULL)
+				_file = CreateFileA(_backing, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			return (_fd != INV_HANDLE && _mutex != NULL);
 #else
+			(void)sem_name;
+			if (_backing != NULL)
+				return OpenFileMem(false);
 			_fd = shm_open(mem_name, O_RDWR, 0644);
-			if (_fd != INV_HANDLE)
+#if defined(__linux__)
+			// Создатель мог положить сегмент на hugetlbfs
+			if (_fd == INV_HANDLE)
 			{
-				_sem = sem_open(sem_name, 0);
-				if (_sem == SEM_FAILED)
-					_sem = NULL;
+				_fd = open(_hugename, O_RDWR | O_CLOEXEC);
+				_huge = _fd != INV_HANDLE;
 			}
 #endif
-			return (_fd != INV_HANDLE && _sem != NULL);
+			return (_fd != INV_HANDLE);
+#endif
 		}
 		bool CreateMem(const char *mem_name, const char *sem_name)
 		{
 #if defined(WIN32)
-			_fd = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(shmem_contents), mem_name);
+			uint64_t size = sizeof(shmem_contents) + _options.max_tail_size;
+			if (_backing != NULL)
+			{
+				// Отображение файла: хвост сразу на максимальный размер, SEC_RESERVE здесь нельзя
+				_file = CreateFileA(_backing, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+				if (_file == INVALID_HANDLE_VALUE)
+					return false;
+				LARGE_INTEGER file_size;
+				_file_created = !GetFileSizeEx(_file, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(shmem_contents);
+				if (!_file_created && (uint64_t)file_size.QuadPart > size)
+					size = file_size.QuadPart;
+				_fd = CreateFileMapping(_file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, mem_name);
+				_first = _fd != INV_HANDLE && GetLastError() != ERROR_ALREADY_EXISTS;
+			}
+			else if (_options.pages == SharedMemPages::Huge && _options.max_tail_size == _options.tail_size && GetLargePageMinimum() > 0)
+			{
+				// Большие страницы коммитятся сразу и требуют SeLockMemoryPrivilege
+				uint64_t large_size = RoundUp(size, GetLargePageMinimum());
+				_fd = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_COMMIT | SEC_LARGE_PAGES,
+										(DWORD)(large_size >> 32), (DWORD)large_size, mem_name);
+				_huge = _fd != INV_HANDLE;
+			}
+			if (_backing == NULL && _fd == INV_HANDLE)
+			{
+				// Секция резервируется под максимальный размер, страницы хвоста коммитятся по мере роста
+				_fd = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_RESERVE, (DWORD)(size >> 32), (DWORD)size, mem_name);
+			}
 			if (_fd != INV_HANDLE)
-				_sem = CreateSemaphore(NULL, 0, 1, sem_name);
+				_mutex = CreateMutex(NULL, FALSE, sem_name);
+			return (_fd != INV_HANDLE && _mutex != NULL);
 #else
+			(void)sem_name;
+			if (_backing != NULL)
+				return OpenFileMem(true);
+			if (_options.pages == SharedMemPages::Huge && _options.max_tail_size == _options.tail_size && CreateHugeMem())
+				return true;
 			_fd = shm_open(mem_name, O_CREAT | O_EXCL | O_RDWR, 0644);
-			if (_fd != INV_HANDLE)
+			if (_fd != INV_HANDLE && ftruncate(_fd, sizeof(shmem_contents) + _options.tail_size) != 0)
+			{
+				close(_fd);
+				shm_unlink(mem_name);
+				_fd = INV_HANDLE;
+			}
+			return (_fd != INV_HANDLE);
+#endif
+		}
+#if !defined(WIN32)
+		// Сегмент - файл на hugetlbfs: MAP_HUGETLB годится только для анонимной памяти,
+		// а сегмент нужен по имени. Страницы выделяются из пула vm.nr_hugepages при
+		// отображении, поэтому пробуем отобразить сразу и при нехватке откатываемся на shm
+		bool CreateHugeMem()
+		{
+#if defined(__linux__)
+			struct statfs fs;
+			if (statfs(HUGETLBFS_DIR, &fs) != 0 || fs.f_type != HUGETLBFS_MAGIC)
+				return false;
+			size_t size = RoundUp(sizeof(shmem_contents) + _options.tail_size, fs.f_bsize);
+			int fd = open(_hugename, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+			if (fd < 0)
+				return false;
+			void *probe = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0) : MAP_FAILED;
+			if (probe == MAP_FAILED)
 			{
-				ftruncate(_fd, sizeof(shmem_contents));
-				_sem = sem_open(sem_name, O_CREAT | O_EXCL, 0644, 1);
-				if (_sem == SEM_FAILED)
-					_sem = NULL;
+				close(fd);
+				unlink(_hugename);
+				return false;
 			}
+			munmap(probe, size);
+			_fd = fd;
+			_huge = true;
+			return true;
+#else
+			return false;
+#endif
+		}
+		int MapFlags()
+		{
+			int flags = MAP_SHARED;
+#if defined(MAP_POPULATE)
+			// С прозрачными большими страницами заполняем после madvise (PrepareRange),
+			// иначе страницы успеют выделиться обычными
+			if (_options.populate && !_thp)
+				flags |= MAP_POPULATE;
 #endif
-			return (_fd != INV_HANDLE && _sem != NULL);
+			return flags;
 		}
+#endif
 		bool MapMem()
 		{
 			if (_fd == INV_HANDLE)
-				return NULL;
+				return false;
 #if defined(WIN32)
-			_mem = reinterpret_cast<shmem_contents *>(MapViewOfFile(_fd, FILE_MAP_WRITE, 0, 0, sizeof(struct shmem_contents)));
+			_mem = reinterpret_cast<shmem_contents *>(MapViewOfFile(_fd, FILE_MAP_WRITE | (_huge ? FILE_MAP_LARGE_PAGES : 0), 0, 0, 0));
+			if (_mem != NULL && _backing == NULL && VirtualAlloc(_mem, sizeof(shmem_contents) + _options.tail_size, MEM_COMMIT, PAGE_READWRITE) == NULL)
+				UnMapMem();
 #else
-			void *res = mmap(NULL, sizeof(struct shmem_contents), PROT_WRITE | PROT_READ, MAP_SHARED, _fd, 0);
+			// Создатель мог ещё не успеть сделать ftruncate: обращение за концом файла - SIGBUS
+			struct stat st;
+			for (int i = 0; i < READY_WAIT_STEPS; i++)
+			{
+				if (fstat(_fd, &st) != 0)
+					return false;
+				if (st.st_size >= (off_t)sizeof(shmem_contents))
+					break;
+				usleep(READY_WAIT_US);
+			}
+			// Создатель умер до ftruncate: доводим размер сами, сегмент с нулевым
+			// creator_pid затем подготовит заново WaitReady
+			if (st.st_size < (off_t)sizeof(shmem_contents) &&
+				(_backing != NULL || _huge || ftruncate(_fd, sizeof(shmem_contents)) != 0))
+				return false;
+			// Файл hugetlbfs отображается целиком: хвост в нём не растёт
+			size_t size = _huge ? st.st_size : sizeof(struct shmem_contents);
+			void *res = mmap(NULL, size, PROT_WRITE | PROT_READ, MapFlags(), _fd, 0);
 			if (res == MAP_FAILED)
 				_mem = NULL;
 			else
+			{
 				_mem = reinterpret_cast<shmem_contents *>(res);
+				_mapped_size = RoundToPage(size);
+			}
 #endif
 			return (_mem != NULL);
 		}
+		bool InitMutex()
+		{
+#if !defined(WIN32)
+			// Блокировка живёт в самом сегменте: без системного вызова при отсутствии
+			// конкуренции и с восстановлением, если владелец умер (EOWNERDEAD)
+			pthread_mutexattr_t attr;
+			pthread_mutexattr_init(&attr);
+			pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+			pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+			int err = pthread_mutex_init(&_mem->mutex, &attr);
+			pthread_mutexattr_destroy(&attr);
+			if (err != 0)
+				return false;
+#endif
+			return true;
+		}
+		bool InitMem()
+		{
+			_mem->creator_pid.store(CurrentPid());
+			if (!InitMutex())
+				return false;
+			_mem->magic = FILE_MAGIC;
+			_mem->layout_size = sizeof(shmem_contents);
+			_mem->data_size = sizeof(T);
+			_mem->clean_shutdown = 0;
+			CurrentBootId(_mem->boot_id);
+			_mem->cnt = 0;
+			_mem->max_tail_size = _options.max_tail_size;
+			new (&_mem->tail_size) std::atomic<uint64_t>(_options.tail_size);
+			new (&_mem->generation) std::atomic<uint32_t>(0);
+			new (&_mem->recoveries) std::atomic<int>(0);
+			new (&_mem->event_seq) std::atomic<uint32_t>(0);
+			new (&_mem->event_waiters) std::atomic<int>(0);
+			new (&_mem->str) T();
+			new (&_mem->ready) std::atomic<int>(0);
+			_mem->ready.store(1, std::memory_order_release);
+			return true;
+		}
+		// Первый процесс нового сеанса над файлом прошлого: блокировки и счётчики
+		// прошлого сеанса недействительны, а данные - только если система не падала
+		bool ReattachMem()
+		{
+			char boot_id[BOOT_ID_SIZE];
+			CurrentBootId(boot_id);
+			// Процессы падали, а система нет - всё записанное ими лежит в кэше страниц
+			bool trusted = _mem->clean_shutdown || (boot_id[0] != 0 && memcmp(boot_id, _mem->boot_id, BOOT_ID_SIZE) == 0);
+			if (!trusted)
+			{
+				CheckpointSlot *newest = NewestCheckpoint();
+				if (newest != NULL)
+				{
+					memcpy(static_cast<void *>(&_mem->str), newest->data, sizeof(T));
+					_restored = true;
+				}
+			}
+			if (!InitMutex())
+				return false;
+			_mem->cnt = 0;
+			_mem->event_waiters.store(0);
+			_mem->clean_shutdown = 0;
+			memcpy(_mem->boot_id, boot_id, BOOT_ID_SIZE);
+			CallReattach(&_mem->str, 0);
+			_reattached = true;
+			return true;
+		}
+		// T может сбросить свои поля, имеющие смысл только внутри сеанса (PID и т.п.)
+		template <class U>
+		static auto CallReattach(U *data, int) -> decltype(data->OnReattach(), void()) { data->OnReattach(); }
+		template <class U>
+		static void CallReattach(U *, long) {}
+		static void CurrentBootId(char *boot_id)
+		{
+			memset(boot_id, 0, BOOT_ID_SIZE);
+#if !defined(WIN32)
+			int fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+			if (fd >= 0)
+			{
+				if (read(fd, boot_id, BOOT_ID_SIZE - 1) < 0)
+					boot_id[0] = 0;
+				close(fd);
+			}
+#endif
+		}
+		bool WaitReady()
+		{
+			while (true)
+			{
+				for (int i = 0; i < READY_WAIT_STEPS; i++)
+				{
+					if (_mem->ready.load(std::memory_order_acquire) == 1)
+						return true;
+					int creator = _mem->creator_pid.load();
+					if (creator != 0 && !ProcessAlive(creator))
+						break;
+#if defined(WIN32)
+					Sleep(READY_WAIT_US / 1000);
+#else
+					usleep(READY_WAIT_US);
+#endif
+				}
+				if (_mem->ready.load(std::memory_order_acquire) == 1)
+					return true;
+				// Создатель умер, не закончив (или даже не начав) инициализацию, иначе
+				// сегмент так и остался бы неоткрываемым. Готовит заново тот, кто первым
+				// заменит PID создателя своим; остальные ждут уже его
+				int creator = _mem->creator_pid.load();
+				if (_backing != NULL || (creator != 0 && ProcessAlive(creator)))
+					return false;
+				if (_mem->creator_pid.compare_exchange_strong(creator, CurrentPid()))
+					return ReinitMem();
+			}
+		}
+		bool ReinitMem()
+		{
+#if !defined(WIN32)
+			struct stat st;
+			off_t size = sizeof(shmem_contents) + _options.tail_size;
+			if (!_huge && (fstat(_fd, &st) != 0 || (st.st_size < size && ftruncate(_fd, size) != 0)))
+				return false;
+#endif
+			return InitMem();
+		}
+		static int CurrentPid()
+		{
+#if defined(WIN32)
+			return static_cast<int>(GetCurrentProcessId());
+#else
+			return static_cast<int>(getpid());
+#endif
+		}
+		static bool ProcessAlive(int pid)
+		{
+#if defined(WIN32)
+			HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+			if (process == NULL)
+				return GetLastError() == ERROR_ACCESS_DENIED;
+			bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+			CloseHandle(process);
+			return alive;
+#else
+			return kill(pid, 0) == 0 || errno == EPERM;
+#endif
+		}
+		// Хвост: на POSIX резервируем адресное пространство под максимальный размер
+		// и переносим туда заголовок, чтобы рост не сдвигал уже выданные указатели.
+		// На Windows представление уже покрывает всю секцию
+		bool MapTail()
+		{
+			_options.max_tail_size = _mem->max_tail_size;
+#if !defined(WIN32)
+			if (_options.max_tail_size > 0 && !_huge)
+			{
+				size_t header = RoundToPage(sizeof(shmem_contents));
+				size_t reserved_size = header + _options.max_tail_size;
+				// Большая страница отображается целиком, только если адрес выровнен так же, как смещение в файле
+				size_t slack = _thp ? HUGE_PAGE_ALIGN : 0;
+				void *res = mmap(NULL, reserved_size + slack, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+				if (res == MAP_FAILED)
+					return false;
+				char *reserved = reinterpret_cast<char *>(RoundUp(reinterpret_cast<uintptr_t>(res), slack ? slack : 1));
+				if (reserved != res)
+					munmap(res, reserved - reinterpret_cast<char *>(res));
+				if (reinterpret_cast<char *>(res) + slack != reserved)
+					munmap(reserved + reserved_size, reinterpret_cast<char *>(res) + slack - reserved);
+				if (mmap(reserved, header, PROT_READ | PROT_WRITE, MapFlags() | MAP_FIXED, _fd, 0) == MAP_FAILED)
+				{
+					munmap(reserved, reserved_size);
+					return false;
+				}
+				munmap(_mem, _mapped_size);
+				_mem = reinterpret_cast<shmem_contents *>(reserved);
+				_reserved_size = reserved_size;
+				_mapped_size = header;
+			}
+			PrepareRange(reinterpret_cast<char *>(_mem), _mapped_size);
+#endif
+			// Принудительно отобразим текущий размер
+			_generation.store(_mem->generation.load(std::memory_order_acquire) - 1);
+			return Refresh();
+		}
+		bool MapTailPages(size_t tail_size)
+		{
+#if defined(WIN32)
+			if (_backing == NULL && VirtualAlloc(_mem, sizeof(shmem_contents) + tail_size, MEM_COMMIT, PAGE_READWRITE) == NULL)
+				return false;
+			// Уже готовые страницы повторно не портятся: блокировка и защита идемпотентны
+			PrepareRange(reinterpret_cast<char *>(_mem), sizeof(shmem_contents) + tail_size);
+#else
+			// Уже отображённые страницы не трогаем: их могут читать другие потоки
+			size_t end = RoundToPage(sizeof(shmem_contents) + tail_size);
+			if (end > _mapped_size)
+			{
+				if (mmap(reinterpret_cast<char *>(_mem) + _mapped_size, end - _mapped_size, PROT_READ | PROT_WRITE,
+						 MapFlags() | MAP_FIXED, _fd, _mapped_size) == MAP_FAILED)
+					return false;
+				PrepareRange(reinterpret_cast<char *>(_mem) + _mapped_size, end - _mapped_size);
+				_mapped_size = end;
+			}
+#endif
+			_mapped_tail = tail_size;
+			return true;
+		}
+		// Параметры отображения для только что отображённых страниц [begin, begin + length)
+		void PrepareRange(char *begin, size_t length)
+		{
+			if (length == 0)
+				return;
+#if defined(WIN32)
+			if (_options.populate)
+				TouchPages(begin, length);
+			if (_options.lock_pages && !VirtualLock(begin, length))
+				_locked = false;
+#else
+#if defined(MADV_HUGEPAGE)
+			if (_thp)
+				madvise(begin, length, MADV_HUGEPAGE);
+#endif
+#if defined(MAP_POPULATE)
+			bool populated = !_thp;
+#else
+			bool populated = false;
+#endif
+#if defined(MADV_POPULATE_WRITE)
+			if (_options.populate && !populated)
+				populated = madvise(begin, length, MADV_POPULATE_WRITE) == 0;
+#endif
+			if (_options.populate && !populated)
+				TouchPages(begin, length);
+			if (_options.lock_pages && mlock(begin, length) != 0)
+				_locked = false;
+#endif
+			// Управляющая часть заголовка остаётся доступной для записи (мьютекс, счётчики),
+			// защищаются страницы начиная с T
+			char *data = reinterpret_cast<char *>(_mem) + RoundToPage(reinterpret_cast<char *>(&_mem->str) - reinterpret_cast<char *>(_mem));
+			char *end = begin + length;
+			if (_options.read_only && end > data)
+			{
+				char *from = begin > data ? begin : data;
+#if defined(WIN32)
+				DWORD old;
+				VirtualProtect(from, end - from, PAGE_READONLY, &old);
+#else
+				mprotect(from, end - from, PROT_READ);
+#endif
+			}
+		}
+		// Чтение по байту на страницу: запись могла бы затереть чужое изменение
+		static void TouchPages(const char *begin, size_t length)
+		{
+			size_t page = PageSize();
+			for (size_t i = 0; i < length; i += page)
+				(void)*reinterpret_cast<const volatile char *>(begin + i);
+		}
+		static size_t PageSize()
+		{
+#if defined(WIN32)
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return info.dwPageSize;
+#else
+			return sysconf(_SC_PAGESIZE);
+#endif
+		}
+		static size_t RoundUp(size_t n, size_t unit) { return (n + unit - 1) / unit * unit; }
+		static size_t RoundToPage(size_t n) { return RoundUp(n, PageSize()); }
 		bool UnMapMem()
 		{
 			if (_mem == NULL)
@@ -157,7 +732,8 @@ namespace cplib
 #if defined(WIN32)
 			UnmapViewOfFile(_mem);
 #else
-			munmap(_mem, sizeof(struct shmem_contents));
+			munmap(_mem, _reserved_size ? _reserved_size : _mapped_size);
+			_reserved_size = _mapped_size = 0;
 #endif
 			_mem = NULL;
 			return true;
@@ -175,49 +751,313 @@ namespace cplib
 #endif
 				_fd = INV_HANDLE;
 			}
-			if (_sem != NULL)
+#if defined(WIN32)
+			if (_mutex != NULL)
+			{
+				CloseHandle(_mutex);
+				_mutex = NULL;
+			}
+			if (_file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(_file);
+				_file = INVALID_HANDLE_VALUE;
+			}
+#endif
+		}
+
+		// Режим backing_file на POSIX. Блокировки OFD (на открытый файл, не на процесс)
+		// на двух байтах файла: 0 - подключение и отключение по одному,
+		// 1 - читающая блокировка каждого подключённого. Ядро снимает их и при падении,
+		// поэтому захват записи на байт 1 означает, что процессов прошлого сеанса нет
+		bool OpenFileMem(bool create)
+		{
+#if defined(WIN32)
+			(void)create;
+			return false;
+#else
+			_fd = open(_backing, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+			if (_fd == INV_HANDLE)
+				return false;
+			if (!LockFileByte(FILE_INIT_LOCK_BYTE, true, true))
+			{
+				CloseMem();
+				return false;
+			}
+			_first = LockFileByte(FILE_PRESENCE_LOCK_BYTE, true, false);
+			// Для OFD-блокировок смена типа атомарна
+			if (!LockFileByte(FILE_PRESENCE_LOCK_BYTE, false, true))
+			{
+				CloseMem();
+				return false;
+			}
+			if (_first)
 			{
+				struct stat st;
+				if (fstat(_fd, &st) != 0)
+				{
+					CloseMem();
+					return false;
+				}
+				_file_created = st.st_size < (off_t)sizeof(shmem_contents);
+				off_t size = sizeof(shmem_contents) + _options.tail_size;
+				if (st.st_size < size && ftruncate(_fd, size) != 0)
+				{
+					CloseMem();
+					return false;
+				}
+			}
+			return true;
+#endif
+		}
+		bool LockFileByte(off_t byte, bool exclusive, bool wait)
+		{
 #if defined(WIN32)
-				CloseHandle(_sem);
+			(void)byte, (void)exclusive, (void)wait;
+			return true;
+#else
+			if (_backing == NULL || _fd == INV_HANDLE)
+				return true;
+			struct flock lock;
+			memset(&lock, 0, sizeof(lock));
+			lock.l_type = exclusive ? F_WRLCK : F_RDLCK;
+			lock.l_whence = SEEK_SET;
+			lock.l_start = byte;
+			lock.l_len = 1;
+#if defined(F_OFD_SETLK)
+			return fcntl(_fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock) == 0;
+#else
+			return fcntl(_fd, wait ? F_SETLKW : F_SETLK, &lock) == 0;
+#endif
+#endif
+		}
+		void UnlockFileByte(off_t byte)
+		{
+#if !defined(WIN32)
+			if (_backing == NULL || _fd == INV_HANDLE)
+				return;
+			struct flock lock;
+			memset(&lock, 0, sizeof(lock));
+			lock.l_type = F_UNLCK;
+			lock.l_whence = SEEK_SET;
+			lock.l_start = byte;
+			lock.l_len = 1;
+#if defined(F_OFD_SETLK)
+			fcntl(_fd, F_OFD_SETLK, &lock);
 #else
-				sem_close(_sem);
+			fcntl(_fd, F_SETLK, &lock);
 #endif
-				_sem = NULL;
+#else
+			(void)byte;
+#endif
+		}
+
+		// Две копии T в <файл>.ckpt: пишется более старая, поэтому при сбое посреди
+		// записи остаётся целая предыдущая. Копия годна, если сошлась контрольная сумма
+		struct CheckpointSlot
+		{
+			uint64_t seq; // 0 - копии нет
+			uint64_t checksum;
+			uint64_t size;
+			unsigned char data[sizeof(T)];
+		};
+		struct CheckpointFile
+		{
+			CheckpointSlot slots[2];
+		};
+		static uint64_t CheckpointChecksum(const CheckpointSlot &slot, uint64_t seq)
+		{
+			return HashBytes(slot.data, sizeof(T)) ^ (seq * 0x9E3779B97F4A7C15ULL) ^ slot.size;
+		}
+		CheckpointSlot *NewestCheckpoint()
+		{
+			if (_ckpt == NULL)
+				return NULL;
+			CheckpointSlot *newest = NULL;
+			for (int i = 0; i < 2; i++)
+			{
+				CheckpointSlot &slot = _ckpt->slots[i];
+				if (slot.seq != 0 && slot.size == sizeof(T) && slot.checksum == CheckpointChecksum(slot, slot.seq) &&
+					(newest == NULL || slot.seq > newest->seq))
+					newest = &slot;
 			}
+			return newest;
+		}
+		bool OpenCheckpoints()
+		{
+			size_t length = strlen(_backing);
+			char *path = (char *)malloc(length + strlen(CHECKPOINT_SUFFIX) + 1);
+			memcpy(path, _backing, length);
+			memcpy(path + length, CHECKPOINT_SUFFIX, strlen(CHECKPOINT_SUFFIX) + 1);
+#if defined(WIN32)
+			_ckpt_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			free(path);
+			if (_ckpt_file == INVALID_HANDLE_VALUE)
+				return false;
+			_ckpt_map = CreateFileMapping(_ckpt_file, NULL, PAGE_READWRITE, 0, sizeof(CheckpointFile), NULL);
+			if (_ckpt_map != NULL)
+				_ckpt = reinterpret_cast<CheckpointFile *>(MapViewOfFile(_ckpt_map, FILE_MAP_WRITE, 0, 0, 0));
+#else
+			_ckpt_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+			free(path);
+			struct stat st;
+			if (_ckpt_fd < 0 || fstat(_ckpt_fd, &st) != 0)
+				return false;
+			if (st.st_size < (off_t)sizeof(CheckpointFile) && ftruncate(_ckpt_fd, sizeof(CheckpointFile)) != 0)
+				return false;
+			void *res = mmap(NULL, sizeof(CheckpointFile), PROT_READ | PROT_WRITE, MAP_SHARED, _ckpt_fd, 0);
+			_ckpt = res == MAP_FAILED ? NULL : reinterpret_cast<CheckpointFile *>(res);
+#endif
+			return _ckpt != NULL;
+		}
+		void CloseCheckpoints()
+		{
+#if defined(WIN32)
+			if (_ckpt != NULL)
+				UnmapViewOfFile(_ckpt);
+			if (_ckpt_map != NULL)
+				CloseHandle(_ckpt_map);
+			if (_ckpt_file != INVALID_HANDLE_VALUE)
+				CloseHandle(_ckpt_file);
+			_ckpt_map = NULL;
+			_ckpt_file = INVALID_HANDLE_VALUE;
+#else
+			if (_ckpt != NULL)
+				munmap(_ckpt, sizeof(CheckpointFile));
+			if (_ckpt_fd >= 0)
+				close(_ckpt_fd);
+			_ckpt_fd = -1;
+#endif
+			_ckpt = NULL;
+		}
+		bool FlushCheckpoints()
+		{
+#if defined(WIN32)
+			return FlushViewOfFile(_ckpt, 0) && FlushFileBuffers(_ckpt_file);
+#else
+			return msync(_ckpt, sizeof(CheckpointFile), MS_SYNC) == 0;
+#endif
+		}
+		// Отображение сегмента на диск (только режим backing_file)
+		bool FlushMem()
+		{
+			if (_backing == NULL || _mem == NULL)
+				return false;
+#if defined(WIN32)
+			return FlushViewOfFile(_mem, 0) && FlushFileBuffers(_file);
+#else
+			return msync(_mem, _mapped_size, MS_SYNC) == 0;
+#endif
 		}
 		void DestroyMem()
 		{
 			CloseMem();
-			// В Windows и семафоры и память удалятся автоматически, когда никто не будет их использовать
+			// В Windows и мьютекс и память удалятся автоматически, когда никто не будет их использовать.
+			// Файл режима backing_file остаётся
 #if !defined(WIN32)
-			shm_unlink(_fname);
-			sem_unlink(_semname);
+			if (_huge)
+				unlink(_hugename);
+			else if (_backing == NULL)
+				shm_unlink(_fname);
 #endif
 		}
-		void LockSema()
+		bool LockMutex()
 		{
 #if defined(WIN32)
-			ReleaseSemaphore(_sem, 1, NULL);
+			DWORD res = WaitForSingleObject(_mutex, INFINITE);
+			if (res == WAIT_ABANDONED)
+			{
+				_mem->recoveries++;
+				return true;
+			}
+			return res == WAIT_OBJECT_0;
 #else
-			sem_post(_sem);
+			int err = pthread_mutex_lock(&_mem->mutex);
+			if (err == EOWNERDEAD)
+			{
+				// Владелец умер внутри критической секции - помечаем мьютекс согласованным
+				pthread_mutex_consistent(&_mem->mutex);
+				_mem->recoveries++;
+				return true;
+			}
+			return err == 0;
 #endif
 		}
-		void UnlockSema()
+		void UnlockMutex()
 		{
 #if defined(WIN32)
-			WaitForSingleObject(_sem, 0);
+			ReleaseMutex(_mutex);
 #else
-			sem_wait(_sem);
+			pthread_mutex_unlock(&_mem->mutex);
 #endif
 		}
+
+		static const int READY_WAIT_STEPS = 1000;
+		static const int READY_WAIT_US = 1000;
+		static const uint64_t FILE_MAGIC = 0x324D454D44524853ULL;
+		static const int BOOT_ID_SIZE = 40;
+		static const int FILE_INIT_LOCK_BYTE = 0;
+		static const int FILE_PRESENCE_LOCK_BYTE = 1;
+		static constexpr const char *CHECKPOINT_SUFFIX = ".ckpt";
+		static const size_t DATA_PAGE_ALIGN = 4096;
+		static const size_t HUGE_PAGE_ALIGN = 2 * 1024 * 1024;
+
+		// Сначала управляющая часть, затем T с границы страницы: read_only защищает T
+		// и хвост целыми страницами. Размер кратен странице - хвост тоже с её границы
 		struct shmem_contents
 		{
-			T str;
 			int cnt;
+			std::atomic<int> recoveries;
+			std::atomic<int> ready;			   // Создатель закончил инициализацию
+			std::atomic<int> creator_pid;	   // Кто инициализирует сегмент, 0 - ещё не начал
+			std::atomic<uint32_t> generation;  // Меняется при каждом Resize
+			std::atomic<uint64_t> tail_size;
+			uint64_t max_tail_size;
+			std::atomic<uint32_t> event_seq;   // Слово futex для WaitEvent/SignalEvent
+			std::atomic<int> event_waiters;	   // Умерший во сне процесс даст лишь лишний FUTEX_WAKE
+			// Для режима backing_file: опознать файл и понять, можно ли верить данным
+			uint64_t magic;
+			uint64_t layout_size;
+			uint64_t data_size; // T с границы страницы: layout_size одинаков для всех T меньше неё
+			int clean_shutdown; // Последний процесс сеанса вышел штатно
+			char boot_id[BOOT_ID_SIZE];
+#if !defined(WIN32)
+			pthread_mutex_t mutex;
+#endif
+			alignas(alignof(T) > DATA_PAGE_ALIGN ? alignof(T) : DATA_PAGE_ALIGN) T str;
 		} *_mem;
-		CSEM _sem;
+#if defined(WIN32)
+		HANDLE _mutex = NULL;
+#endif
 		HANDLE _fd;
 		char *_fname;
 		char *_semname;
+		char *_backing;
+#if !defined(WIN32)
+		char *_hugename;
+#endif
+		SharedMemOptions _options;
+		bool _huge = false;	  // Явные большие страницы
+		bool _thp = false;	  // Прозрачные большие страницы
+		bool _locked = true;  // lock_pages: ни один mlock не отказал
+		bool _first = false;		// Режим файла: первый процесс сеанса
+		bool _file_created = false; // Режим файла: файл пуст или короче заголовка
+		bool _reattached = false;
+		bool _restored = false;
+		CheckpointFile *_ckpt = NULL;
+#if defined(WIN32)
+		HANDLE _file = INVALID_HANDLE_VALUE;
+		HANDLE _ckpt_file = INVALID_HANDLE_VALUE;
+		HANDLE _ckpt_map = NULL;
+#else
+		int _ckpt_fd = -1;
+#endif
+		// Что отображено в этом процессе
+		size_t _mapped_tail;
+		std::atomic<uint32_t> _generation;
+		std::mutex _remap_mutex;
+#if !defined(WIN32)
+		size_t _reserved_size = 0; // 0 - хвост не растёт, отображено только _mapped_size
+		size_t _mapped_size = 0;
+#endif
 	};
-}
\ No newline at end of file
+}
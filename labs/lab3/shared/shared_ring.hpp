@@ -0,0 +1,194 @@
+#pragma once
+
+#include "shared_memory.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace cplib
+{
+	enum class RingMode
+	{
+		SPSC, // Один писатель, один читатель: только загрузки/записи индексов
+		MPMC  // Любое число писателей и читателей: ячейки с номерами поколений
+	};
+
+	const size_t RING_CACHE_LINE = 64;
+
+	// Хранилище SPSC: голова и хвост на разных кэш-линиях
+	template <class T, size_t N>
+	struct SpscRingStorage
+	{
+		SpscRingStorage() : head(0), tail(0) {}
+		alignas(RING_CACHE_LINE) std::atomic<uint64_t> head; // Следующий для чтения
+		alignas(RING_CACHE_LINE) std::atomic<uint64_t> tail; // Следующий для записи
+		alignas(RING_CACHE_LINE) T items[N];
+	};
+
+	// Хранилище MPMC (очередь Вьюкова): seq ячейки говорит, чья она сейчас
+	template <class T, size_t N>
+	struct MpmcRingStorage
+	{
+		struct Cell
+		{
+			std::atomic<uint64_t> seq; // == pos - свободна для записи, == pos + 1 - заполнена
+			T value;
+		};
+
+		MpmcRingStorage() : enqueue_pos(0), dequeue_pos(0)
+		{
+			for (size_t i = 0; i < N; i++)
+				cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+		alignas(RING_CACHE_LINE) std::atomic<uint64_t> enqueue_pos;
+		alignas(RING_CACHE_LINE) std::atomic<uint64_t> dequeue_pos;
+		alignas(RING_CACHE_LINE) Cell cells[N];
+	};
+
+	/// Lock-free кольцевой буфер поверх SharedMem для передачи записей между процессами.
+	/// T копируется побайтно, N - степень двойки
+	template <class T, size_t N, RingMode Mode = RingMode::SPSC>
+	class SharedRing
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "SharedRing element must be trivially copyable");
+		static_assert(N > 0 && (N & (N - 1)) == 0, "SharedRing capacity must be a power of two");
+		static_assert(std::atomic<uint64_t>::is_always_lock_free, "SharedRing requires lock-free 64-bit atomics");
+
+		using Storage = typename std::conditional<Mode == RingMode::SPSC, SpscRingStorage<T, N>, MpmcRingStorage<T, N>>::type;
+
+	public:
+		SharedRing(const char *name, bool create_if_not_exists = true) : _mem(name, create_if_not_exists) {}
+
+		bool IsValid() { return _mem.IsValid(); }
+		static constexpr size_t Capacity() { return N; }
+
+		bool Push(const T &item) { return PushBatch(&item, 1) == 1; }
+		bool Pop(T &item) { return PopBatch(&item, 1) == 1; }
+
+		// Сколько записей удалось положить/забрать (не больше count)
+		size_t PushBatch(const T *items, size_t count) { return PushImpl(items, count, std::integral_constant<RingMode, Mode>()); }
+		size_t PopBatch(T *items, size_t count) { return PopImpl(items, count, std::integral_constant<RingMode, Mode>()); }
+
+		// Приблизительно: значение может устареть сразу после чтения
+		size_t Size() { return SizeImpl(std::integral_constant<RingMode, Mode>()); }
+		bool Empty() { return Size() == 0; }
+
+	private:
+		using SpscTag = std::integral_constant<RingMode, RingMode::SPSC>;
+		using MpmcTag = std::integral_constant<RingMode, RingMode::MPMC>;
+
+		size_t SizeImpl(SpscTag)
+		{
+			Storage *s = _mem.Data();
+			return s->tail.load(std::memory_order_acquire) - s->head.load(std::memory_order_acquire);
+		}
+
+		size_t SizeImpl(MpmcTag)
+		{
+			Storage *s = _mem.Data();
+			uint64_t enqueued = s->enqueue_pos.load(std::memory_order_relaxed);
+			uint64_t dequeued = s->dequeue_pos.load(std::memory_order_relaxed);
+			return enqueued > dequeued ? enqueued - dequeued : 0;
+		}
+
+		size_t PushImpl(const T *items, size_t count, SpscTag)
+		{
+			Storage *s = _mem.Data();
+			uint64_t tail = s->tail.load(std::memory_order_relaxed);
+			// Чужой индекс перечитываем только когда кэшированного не хватает
+			// (или он от другого подключения к кольцу)
+			if (tail - _cached_head > N || N - (tail - _cached_head) < count)
+				_cached_head = s->head.load(std::memory_order_acquire);
+			size_t n = N - (tail - _cached_head);
+			if (n > count)
+				n = count;
+			for (size_t i = 0; i < n; i++)
+				s->items[(tail + i) & (N - 1)] = items[i];
+			s->tail.store(tail + n, std::memory_order_release);
+			return n;
+		}
+
+		size_t PopImpl(T *items, size_t count, SpscTag)
+		{
+			Storage *s = _mem.Data();
+			uint64_t head = s->head.load(std::memory_order_relaxed);
+			if (_cached_tail < head || _cached_tail - head < count)
+				_cached_tail = s->tail.load(std::memory_order_acquire);
+			size_t n = _cached_tail - head;
+			if (n > count)
+				n = count;
+			for (size_t i = 0; i < n; i++)
+				items[i] = s->items[(head + i) & (N - 1)];
+			s->head.store(head + n, std::memory_order_release);
+			return n;
+		}
+
+		size_t PushImpl(const T *items, size_t count, MpmcTag)
+		{
+			Storage *s = _mem.Data();
+			uint64_t pos = s->enqueue_pos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				// Сколько подряд свободных ячеек начиная с pos
+				size_t n = 0;
+				while (n < count && n < N && s->cells[(pos + n) & (N - 1)].seq.load(std::memory_order_acquire) == pos + n)
+					n++;
+				if (n == 0)
+				{
+					uint64_t seq = s->cells[pos & (N - 1)].seq.load(std::memory_order_acquire);
+					if ((int64_t)(seq - pos) < 0)
+						return 0; // Заполнено
+					pos = s->enqueue_pos.load(std::memory_order_relaxed);
+					continue;
+				}
+				// Диапазон [pos, pos + n) становится нашим целиком
+				if (s->enqueue_pos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+				{
+					for (size_t i = 0; i < n; i++)
+					{
+						auto &cell = s->cells[(pos + i) & (N - 1)];
+						cell.value = items[i];
+						cell.seq.store(pos + i + 1, std::memory_order_release);
+					}
+					return n;
+				}
+			}
+		}
+
+		size_t PopImpl(T *items, size_t count, MpmcTag)
+		{
+			Storage *s = _mem.Data();
+			uint64_t pos = s->dequeue_pos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				size_t n = 0;
+				while (n < count && n < N && s->cells[(pos + n) & (N - 1)].seq.load(std::memory_order_acquire) == pos + n + 1)
+					n++;
+				if (n == 0)
+				{
+					uint64_t seq = s->cells[pos & (N - 1)].seq.load(std::memory_order_acquire);
+					if ((int64_t)(seq - (pos + 1)) < 0)
+						return 0; // Пусто
+					pos = s->dequeue_pos.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (s->dequeue_pos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+				{
+					for (size_t i = 0; i < n; i++)
+					{
+						auto &cell = s->cells[(pos + i) & (N - 1)];
+						items[i] = cell.value;
+						cell.seq.store(pos + i + N, std::memory_order_release);
+					}
+					return n;
+				}
+			}
+		}
+
+		SharedMem<Storage> _mem;
+		// Локальные для процесса копии чужих индексов (SPSC): меньше промахов кэша
+		uint64_t _cached_head = 0;
+		uint64_t _cached_tail = 0;
+	};
+}
@@ -1,62 +1,66 @@
 #include "application.hpp"
 #include "logger.hpp"
 #include "shared_data.hpp"
+#if !defined(_WIN32)
+#include "zygote.h"
+#endif
 #include <iostream>
 #include <thread>
 #include <chrono>
 
 using namespace std::chrono_literals;
 
-// Функция для выполнения задачи копии 1
-void runChild1()
+// Значение "<option> <значение>" начиная с позиции first, иначе пусто
+std::string optionValue(const std::vector<std::string> &args, const std::string &option, size_t first)
 {
-    cplib::Logger logger("process.log");
-    cplib::SharedDataManager shared_data("global_counter");
-
-    logger.log("CHILD1 started");
-    int current_value = shared_data.getCounter();
-    shared_data.setCounter(current_value + 10);
-    logger.log("CHILD1 finished");
+    for (size_t i = first; i + 1 < args.size(); ++i)
+    {
+        if (args[i] == option)
+        {
+            return args[i + 1];
+        }
+    }
+    return "";
 }
 
-// Функция для выполнения задачи копии 2
-void runChild2()
+// Точка входа воркера: argv вида {"./LAB", "--worker", "<слот>" [, "--persist", "<файл>"]}
+int runWorker(const std::vector<std::string> &args)
 {
-    cplib::Logger logger("process.log");
-    cplib::SharedDataManager shared_data("global_counter");
-
-    logger.log("CHILD2 started");
-    int current_value = shared_data.getCounter();
-    shared_data.setCounter(current_value * 2);
-
-    std::this_thread::sleep_for(2000ms);
-
-    current_value = shared_data.getCounter();
-    shared_data.setCounter(current_value / 2);
-    logger.log("CHILD2 finished");
+    if (args.size() < 3)
+    {
+        return 1;
+    }
+    int slot = std::atoi(args[2].c_str());
+    return cplib::Application::runWorker("global_counter", "process.log", slot, optionValue(args, "--persist", 3));
 }
 
 int main(int argc, char **argv)
 {
     // Проверяем аргументы командной строки
-    if (argc > 1 && std::string(argv[1]) == "--child")
+    if (argc > 1 && std::string(argv[1]) == "--worker")
     {
-        if (argc > 2)
-        {
-            int child_type = std::atoi(argv[2]);
-            if (child_type == 1)
-            {
-                runChild1();
-            }
-            else if (child_type == 2)
-            {
-                runChild2();
-            }
-        }
-        return 0;
+        return runWorker(std::vector<std::string>(argv, argv + argc));
+    }
+
+#if !defined(_WIN32)
+    // Шаблон для быстрого запуска копий; запускается до создания потоков
+    Zygote::start(runWorker);
+#endif
+
+    // LAB [--persist <файл>] [--workers <N>]: счётчик сохраняется между запусками,
+    // N воркеров в пуле (по умолчанию - по числу ядер)
+    std::vector<std::string> args(argv, argv + argc);
+    cplib::ApplicationConfig config;
+    config.persist_file = optionValue(args, "--persist", 1);
+    config.workers = std::atoi(optionValue(args, "--workers", 1).c_str());
+
+    {
+        cplib::Application app("global_counter", "process.log", config);
+        app.run();
     }
 
-    cplib::Application app("global_counter", "process.log");
-    app.run();
+#if !defined(_WIN32)
+    Zygote::stop();
+#endif
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,224 @@
+// Многопроцессная проверка SharedArena: рост сегмента, видимый из других процессов,
+// добавление строки к самой себе, смерть строящего корень и владельца блокировки.
+// Код возврата - число проваленных проверок
+#include "shared_arena.hpp"
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace cplib;
+
+namespace
+{
+    const size_t ARENA_SIZE = 4096;
+    const size_t ARENA_MAX = 8 * 1024 * 1024;
+    const int WRITERS = 4;
+    const uint64_t KEYS_PER_WRITER = 5000;
+
+    int failures = 0;
+
+    void check(bool ok, const char *what)
+    {
+        printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+        if (!ok)
+            failures++;
+    }
+
+    std::string segmentName(const char *test)
+    {
+        return std::string("test_arena_") + test + "_" + std::to_string(getpid());
+    }
+
+    // Дочерние выходят через _exit, не отключаясь, - сегмент за ними удаляем сами
+    void removeSegment(const std::string &name)
+    {
+        shm_unlink(("/" + name).c_str());
+    }
+
+    // Все дочерние завершились с кодом 0
+    bool waitChildren()
+    {
+        bool ok = true;
+        int status;
+        while (wait(&status) > 0)
+            ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        return ok;
+    }
+
+    struct Table
+    {
+        explicit Table(SharedArena &arena) : map(arena), values(arena) {}
+        SharedHashMap<uint64_t, uint64_t> map;
+        SharedVector<uint64_t> values;
+    };
+
+    // Несколько процессов растят арену далеко за начальный размер; остальные должны
+    // видеть и выделять память в новой части, не отображённой ими при подключении
+    void testGrowth()
+    {
+        std::string name = segmentName("growth");
+        SharedArenaSegment segment(name.c_str(), ARENA_SIZE, ARENA_MAX);
+        Table *table = segment.Root<Table>();
+        check(table != NULL, "growth: root");
+        if (table == NULL)
+            return;
+
+        for (int writer = 0; writer < WRITERS; writer++)
+        {
+            if (fork() != 0)
+                continue;
+            SharedArenaSegment own(name.c_str(), ARENA_SIZE, ARENA_MAX);
+            Table *t = own.Root<Table>();
+            if (t == NULL)
+                _exit(1);
+            for (uint64_t i = 0; i < KEYS_PER_WRITER; i++)
+            {
+                own.Lock();
+                bool ok = t->map.Emplace(writer * KEYS_PER_WRITER + i, i) != NULL;
+                own.Unlock();
+                if (!ok)
+                    _exit(2);
+            }
+            _exit(0);
+        }
+        check(waitChildren(), "growth: writers finished");
+
+        segment.Lock();
+        size_t size = table->map.Size();
+        uint64_t sum = 0;
+        table->map.ForEach([&](const uint64_t &, uint64_t &value)
+                           { sum += value; });
+        // Родитель выделяет память уже в выросшей арене
+        bool pushed = true;
+        for (uint64_t i = 0; i < KEYS_PER_WRITER && pushed; i++)
+            pushed = table->values.PushBack(i);
+        segment.Unlock();
+
+        uint64_t expected = WRITERS * (KEYS_PER_WRITER * (KEYS_PER_WRITER - 1) / 2);
+        check(segment.Arena()->Capacity() > ARENA_SIZE, "growth: arena grew");
+        check(size == WRITERS * KEYS_PER_WRITER && sum == expected, "growth: every key visible in parent");
+        check(pushed && table->values.Size() == KEYS_PER_WRITER, "growth: parent allocates after growth");
+        removeSegment(name);
+    }
+
+    void testSelfAppend()
+    {
+        std::string name = segmentName("append");
+        SharedArenaSegment segment(name.c_str(), 64 * 1024);
+        SharedArena *arena = segment.Arena();
+        check(arena != NULL, "append: arena");
+        if (arena == NULL)
+            return;
+
+        SharedString *text = arena->New<SharedString>("abc");
+        std::string expected = "abc";
+        bool ok = text != NULL;
+        // Каждый шаг переносит строку в новый буфер, а источник - старый буфер
+        for (int i = 0; i < 8 && ok; i++)
+        {
+            ok = text->Append(text->CStr(), text->Size());
+            expected += expected;
+        }
+        check(ok && expected == text->CStr(), "append: string appended to itself");
+        arena->Delete(text);
+    }
+
+    // Конструктор корня, который в дочернем процессе не возвращается
+    bool block_root = false;
+    int root_pipe = -1;
+
+    struct SlowRoot
+    {
+        explicit SlowRoot(SharedArena &) : value(42)
+        {
+            if (!block_root)
+                return;
+            char c = 1;
+            if (write(root_pipe, &c, 1) != 1)
+                _exit(1);
+            pause();
+        }
+        int value;
+    };
+
+    void testRootBuilderDeath()
+    {
+        std::string name = segmentName("root");
+        SharedArenaSegment segment(name.c_str(), 64 * 1024);
+        int fds[2];
+        if (!segment.IsValid() || pipe(fds) != 0)
+        {
+            check(false, "root: setup");
+            return;
+        }
+
+        pid_t builder = fork();
+        if (builder == 0)
+        {
+            block_root = true;
+            root_pipe = fds[1];
+            SharedArenaSegment own(name.c_str(), 64 * 1024);
+            own.Root<SlowRoot>();
+            _exit(0);
+        }
+        char c;
+        bool started = read(fds[0], &c, 1) == 1;
+        kill(builder, SIGKILL);
+        waitpid(builder, NULL, 0);
+        close(fds[0]);
+        close(fds[1]);
+
+        SlowRoot *root = started ? segment.Root<SlowRoot>() : NULL;
+        check(root != NULL && root->value == 42, "root: rebuilt after builder was killed");
+        check(segment.Arena()->Recoveries() > 0, "root: recovery counted");
+        removeSegment(name);
+    }
+
+    void testLockOwnerDeath()
+    {
+        std::string name = segmentName("lock");
+        SharedArenaSegment segment(name.c_str(), 64 * 1024);
+        if (!segment.IsValid())
+        {
+            check(false, "lock: setup");
+            return;
+        }
+
+        pid_t owner = fork();
+        if (owner == 0)
+        {
+            SharedArenaSegment own(name.c_str(), 64 * 1024);
+            own.Lock();
+            _exit(0); // Не отпуская
+        }
+        waitpid(owner, NULL, 0);
+        bool clean = segment.Lock();
+        segment.Unlock();
+        check(!clean, "lock: taken over from dead owner");
+
+        // Арена после этого по-прежнему выделяет память
+        void *p = segment.Arena()->Allocate(128);
+        check(p != NULL, "lock: arena usable after takeover");
+        segment.Arena()->Deallocate(p);
+        removeSegment(name);
+    }
+}
+
+int main()
+{
+    // Вывод не дублируется в fork и виден до зависания; зависание - тоже провал
+    setvbuf(stdout, NULL, _IONBF, 0);
+    alarm(60);
+
+    testGrowth();
+    testSelfAppend();
+    testRootBuilderDeath();
+    testLockOwnerDeath();
+
+    if (failures != 0)
+        printf("%d check(s) failed\n", failures);
+    return failures;
+}
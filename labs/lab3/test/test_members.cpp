@@ -0,0 +1,151 @@
+// Проверка таблицы участников SharedDataManager: заполнение всех MEMBER_SLOTS слотов
+// из многих процессов, тысячи короткоживущих процессов, половина из которых не
+// освобождает слот, и сбор умерших по heartbeat.
+// Код возврата - число проваленных проверок
+#include "shared_data.hpp"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace cplib;
+
+namespace
+{
+    const int HOLDERS = 64;
+    const int SLOTS_PER_HOLDER = MEMBER_SLOTS / HOLDERS;
+    const int SHORT_LIVED = 3000;
+    const int BATCH = 100; // Одновременно живущих короткоживущих процессов
+    // Дольше этого без heartbeat участник собирается
+    const std::chrono::milliseconds REAP_WAIT = std::chrono::milliseconds(MEMBER_TIMEOUT_MS + 500);
+
+    int failures = 0;
+    std::string name;
+
+    void check(bool ok, const char *what)
+    {
+        printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+        if (!ok)
+            failures++;
+    }
+
+    // Процессы держат слоты, пока их не убьют; сколько заняли - в канал
+    bool fillTable(std::vector<pid_t> &holders, int &claimed)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+            return false;
+        for (int i = 0; i < HOLDERS; ++i)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(fds[0]);
+                std::vector<std::unique_ptr<SharedDataManager>> managers;
+                unsigned char count = 0;
+                for (int j = 0; j < SLOTS_PER_HOLDER; ++j)
+                {
+                    managers.emplace_back(new SharedDataManager(name));
+                    if (managers.back()->registerConnection())
+                        count++;
+                }
+                if (write(fds[1], &count, 1) != 1)
+                    _exit(1);
+                pause();
+                _exit(0);
+            }
+            holders.push_back(pid);
+        }
+        close(fds[1]);
+        claimed = 0;
+        unsigned char count;
+        for (int i = 0; i < HOLDERS && read(fds[0], &count, 1) == 1; ++i)
+            claimed += count;
+        close(fds[0]);
+        return true;
+    }
+
+    // Половина выходит штатно, половина - не освободив слот
+    bool churn()
+    {
+        bool ok = true;
+        for (int started = 0; started < SHORT_LIVED;)
+        {
+            int batch = 0;
+            for (; batch < BATCH && started < SHORT_LIVED; ++batch, ++started)
+            {
+                bool clean = started % 2 == 0;
+                if (fork() != 0)
+                    continue;
+                {
+                    SharedDataManager member(name);
+                    if (!member.registerConnection())
+                        _exit(1);
+                    if (!clean)
+                        _exit(0);
+                }
+                _exit(0);
+            }
+            int status;
+            for (; batch > 0; --batch)
+                ok = ok && wait(&status) > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        return ok;
+    }
+
+    // Наш слот свежий, остальные просрочены
+    int reapAfterTimeout(SharedDataManager &self)
+    {
+        std::this_thread::sleep_for(REAP_WAIT);
+        self.heartbeat();
+        return self.reapMembers();
+    }
+}
+
+int main()
+{
+    setvbuf(stdout, NULL, _IONBF, 0);
+    alarm(120);
+
+    name = "test_members_" + std::to_string(getpid());
+    {
+        SharedDataManager self(name);
+        check(self.isValid() && self.registerConnection() && self.memberCount() == 1, "register self");
+
+        std::vector<pid_t> holders;
+        int claimed = 0;
+        bool filled = fillTable(holders, claimed);
+        check(filled && claimed == MEMBER_SLOTS - 1, "table filled from many processes");
+        check(self.memberCount() == MEMBER_SLOTS, "count of a full table");
+        SharedDataManager extra(name);
+        check(!extra.registerConnection(), "full table refuses a claim");
+
+        // Падение без освобождения: до истечения heartbeat слоты заняты
+        for (pid_t pid : holders)
+            kill(pid, SIGKILL);
+        for (pid_t pid : holders)
+            waitpid(pid, NULL, 0);
+        check(self.reapMembers() == 0, "fresh heartbeats are not reaped");
+        int reaped = reapAfterTimeout(self);
+        check(reaped == MEMBER_SLOTS - 1 && self.memberCount() == 1, "killed holders reaped");
+
+        check(churn(), "short-lived processes ran");
+        check(self.memberCount() == 1 + SHORT_LIVED / 2, "clean exits released, crashes still counted");
+        reaped = reapAfterTimeout(self);
+        check(reaped == SHORT_LIVED / 2 && self.memberCount() == 1, "crashed processes reaped");
+        check(extra.registerConnection(), "reaped slots reusable");
+        check(self.members().size() == 2, "members() matches count");
+    }
+    // Дочерние выходили через _exit, не отключаясь
+    shm_unlink(("/" + name).c_str());
+
+    if (failures != 0)
+        printf("%d check(s) failed\n", failures);
+    return failures;
+}
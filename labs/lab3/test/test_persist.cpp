@@ -0,0 +1,223 @@
+// Проверка режима backing_file SharedMem: штатный перезапуск, падение процессов без
+// перезагрузки, перезагрузка (подменённый boot_id в заголовке файла), испорченная
+// последняя контрольная точка и файл от другой раскладки T.
+// Код возврата - число проваленных проверок
+#include "shared_memory.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace cplib;
+
+namespace
+{
+    // Значения, которые легко найти в файле контрольных точек
+    const uint64_t FIRST = 0x1111222233334444ULL;
+    const uint64_t SECOND = 0x5555666677778888ULL;
+    const uint64_t LIVE = 0x99990000AAAABBBBULL;
+
+    int failures = 0;
+
+    void check(bool ok, const char *what)
+    {
+        printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+        if (!ok)
+            failures++;
+    }
+
+    struct State
+    {
+        State() : value(0), session_pid(0) {}
+        void OnReattach() { session_pid = 0; }
+        uint64_t value;
+        int session_pid; // Имеет смысл только внутри сеанса
+    };
+
+    // Та же первая часть, другой размер
+    struct OtherState
+    {
+        OtherState() : value(0), extra() {}
+        uint64_t value;
+        uint64_t extra[16];
+    };
+
+    std::string name;
+    std::string file;
+
+    SharedMemOptions backing()
+    {
+        SharedMemOptions options;
+        options.backing_file = file.c_str();
+        return options;
+    }
+
+    void removeFiles()
+    {
+        unlink(file.c_str());
+        unlink((file + ".ckpt").c_str());
+    }
+
+    // Дочерний процесс подключается, f меняет состояние, затем процесс гибнет без отключения
+    template <class F>
+    bool crashAfter(F f)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            SharedMem<State> mem(name.c_str(), true, backing());
+            if (!mem.IsValid())
+                _exit(1);
+            f(mem);
+            _exit(0);
+        }
+        int status;
+        return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    std::vector<char> readFile(const std::string &path)
+    {
+        std::vector<char> bytes;
+        int fd = open(path.c_str(), O_RDONLY);
+        char buffer[4096];
+        ssize_t count;
+        while (fd >= 0 && (count = read(fd, buffer, sizeof(buffer))) > 0)
+            bytes.insert(bytes.end(), buffer, buffer + count);
+        if (fd >= 0)
+            close(fd);
+        return bytes;
+    }
+
+    // Изменить один байт первого вхождения pattern в файле
+    bool corrupt(const std::string &path, const void *pattern, size_t length)
+    {
+        std::vector<char> bytes = readFile(path);
+        for (size_t i = 0; i + length <= bytes.size(); i++)
+        {
+            if (memcmp(&bytes[i], pattern, length) != 0)
+                continue;
+            int fd = open(path.c_str(), O_WRONLY);
+            char flipped = bytes[i] ^ 0x5A;
+            bool ok = fd >= 0 && pwrite(fd, &flipped, 1, i) == 1;
+            if (fd >= 0)
+                close(fd);
+            return ok;
+        }
+        return false;
+    }
+
+    // Перезагрузка для SharedMem - другой boot_id в заголовке файла
+    bool simulateReboot()
+    {
+        std::vector<char> boot_id = readFile("/proc/sys/kernel/random/boot_id");
+        if (boot_id.size() < 36)
+            return false;
+        return corrupt(file, boot_id.data(), 36);
+    }
+
+    void testCleanRestart()
+    {
+        {
+            SharedMem<State> mem(name.c_str(), true, backing());
+            check(mem.IsValid() && !mem.Reattached(), "clean: new file");
+            mem.Data()->value = FIRST;
+            mem.Data()->session_pid = getpid();
+        }
+        SharedMem<State> mem(name.c_str(), true, backing());
+        check(mem.IsValid() && mem.Reattached() && !mem.RestoredFromCheckpoint(), "clean: live data resumed");
+        check(mem.Data()->value == FIRST, "clean: value kept");
+        check(mem.Data()->session_pid == 0, "clean: OnReattach called");
+    }
+
+    void testCrashSameBoot()
+    {
+        bool crashed = crashAfter([](SharedMem<State> &mem)
+                                  {
+            mem.Data()->value = FIRST;
+            mem.Checkpoint();
+            mem.Data()->value = LIVE; });
+        check(crashed, "crash: writer ran");
+        SharedMem<State> mem(name.c_str(), true, backing());
+        check(mem.IsValid() && mem.Reattached() && !mem.RestoredFromCheckpoint(), "crash: page cache trusted");
+        check(mem.Data()->value == LIVE, "crash: write after checkpoint kept");
+    }
+
+    void testReboot()
+    {
+        bool crashed = crashAfter([](SharedMem<State> &mem)
+                                  {
+            mem.Data()->value = FIRST;
+            mem.Checkpoint();
+            mem.Data()->value = LIVE; });
+        if (!simulateReboot())
+        {
+            printf("skip: reboot - no boot_id\n");
+            return;
+        }
+        SharedMem<State> mem(name.c_str(), true, backing());
+        check(crashed && mem.IsValid() && mem.RestoredFromCheckpoint(), "reboot: restored from checkpoint");
+        check(mem.Data()->value == FIRST, "reboot: checkpointed value");
+    }
+
+    void testTornCheckpoint()
+    {
+        bool crashed = crashAfter([](SharedMem<State> &mem)
+                                  {
+            mem.Data()->value = FIRST;
+            mem.Checkpoint();
+            mem.Data()->value = SECOND;
+            mem.Checkpoint();
+            mem.Data()->value = LIVE; });
+        // Последняя копия дописана не до конца - сумма не сойдётся
+        bool torn = corrupt(file + ".ckpt", &SECOND, sizeof(SECOND));
+        if (!simulateReboot())
+        {
+            printf("skip: torn - no boot_id\n");
+            return;
+        }
+        SharedMem<State> mem(name.c_str(), true, backing());
+        check(crashed && torn && mem.IsValid() && mem.RestoredFromCheckpoint(), "torn: restored from checkpoint");
+        check(mem.Data()->value == FIRST, "torn: older copy used");
+    }
+
+    void testLayoutMismatch()
+    {
+        {
+            SharedMem<State> mem(name.c_str(), true, backing());
+            mem.Data()->value = FIRST;
+        }
+        {
+            SharedMem<OtherState> other(name.c_str(), true, backing());
+            check(other.IsValid() && !other.Reattached(), "layout: other T starts fresh");
+            check(other.Data()->value == 0, "layout: old data not reinterpreted");
+            other.Data()->value = SECOND;
+        }
+        SharedMem<OtherState> other(name.c_str(), true, backing());
+        check(other.IsValid() && other.Reattached() && other.Data()->value == SECOND, "layout: new layout resumed");
+    }
+}
+
+int main()
+{
+    setvbuf(stdout, NULL, _IONBF, 0);
+    alarm(60);
+
+    name = "test_persist_" + std::to_string(getpid());
+    file = "/tmp/" + name + ".bin";
+
+    // Каждая проверка - с чистого файла
+    void (*tests[])() = {testCleanRestart, testCrashSameBoot, testReboot, testTornCheckpoint, testLayoutMismatch};
+    for (auto test : tests)
+    {
+        removeFiles();
+        test();
+    }
+    removeFiles();
+
+    if (failures != 0)
+        printf("%d check(s) failed\n", failures);
+    return failures;
+}
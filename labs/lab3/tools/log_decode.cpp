@@ -0,0 +1,33 @@
+#include "logger.hpp"
+#include <fstream>
+#include <iostream>
+
+// Двоичный журнал (LoggerOptions::binary) в текст.
+// Запуск: LAB_LOG_DECODE <двоичный журнал> [текстовый файл, иначе stdout]
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <binary log> [text log]" << std::endl;
+        return 2;
+    }
+
+    std::ofstream file;
+    if (argc > 2)
+    {
+        file.open(argv[2], std::ios::app);
+        if (!file)
+        {
+            std::cerr << "Cannot open " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+
+    if (!cplib::Logger::decode(argv[1], argc > 2 ? file : std::cout))
+    {
+        std::cerr << "Failed to decode " << argv[1] << ": missing or truncated" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace cplib
+{
+
+    namespace
+    {
+        const int IDLE_WAIT_MS = 500; // Без задач воркер всё равно время от времени проверяет мастера
+        const size_t COLLECT_BATCH = 64;
+
+        int currentProcessId()
+        {
+#if defined(_WIN32)
+            return GetCurrentProcessId();
+#else
+            return getpid();
+#endif
+        }
+
+        int64_t nowMs()
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    WorkerPool::WorkerPool(const std::string &name)
+        : state_((name + "_pool").c_str()), tasks_((name + "_tasks").c_str()), results_((name + "_results").c_str()),
+          inflight_((name + "_inflight").c_str(), INFLIGHT_ARENA_SIZE, INFLIGHT_ARENA_MAX), inflight_table_(inflight_.Root<InFlightTable>())
+    {
+    }
+
+    bool WorkerPool::isValid()
+    {
+        return state_.IsValid() && tasks_.IsValid() && results_.IsValid() && inflight_table_ != NULL;
+    }
+
+    void WorkerPool::setTarget(int count)
+    {
+        WorkerPoolState *state = state_.Data();
+        state->target.store(std::max(0, std::min(count, MAX_WORKERS)));
+        state->shutdown.store(0);
+        state_.SignalEvent();
+    }
+
+    int WorkerPool::target()
+    {
+        return state_.Data()->target.load();
+    }
+
+    int WorkerPool::workerPid(int slot)
+    {
+        return state_.Data()->pids[slot].load();
+    }
+
+    void WorkerPool::setWorkerPid(int slot, int pid)
+    {
+        WorkerPoolState *state = state_.Data();
+        // Только что запущенный ещё не успел отметиться сам
+        if (pid != 0)
+            state->heartbeats[slot].store(nowMs());
+        state->pids[slot].store(pid);
+    }
+
+    bool WorkerPool::workerAlive(int slot)
+    {
+        WorkerPoolState *state = state_.Data();
+        return state->pids[slot].load() != 0 && nowMs() - state->heartbeats[slot].load() < WORKER_TIMEOUT_MS;
+    }
+
+    uint64_t WorkerPool::submit(uint32_t kind, int64_t arg0, int64_t arg1, int64_t arg2)
+    {
+        WorkerTask task;
+        task.id = state_.Data()->next_task_id.fetch_add(1);
+        task.kind = kind;
+        task.args[0] = arg0;
+        task.args[1] = arg1;
+        task.args[2] = arg2;
+
+        // Запись - до отправки: воркер может взять задачу сразу
+        InFlightTask entry;
+        entry.kind = kind;
+        entry.submitter = currentProcessId();
+        entry.worker = 0;
+        entry.submitted_ms = nowMs();
+        inflight_.Lock();
+        bool recorded = inflight_table_->tasks.Emplace(task.id, entry) != NULL;
+        inflight_.Unlock();
+        if (!recorded)
+            return 0;
+
+        if (!tasks_.Push(task))
+        {
+            inflight_.Lock();
+            inflight_table_->tasks.Erase(task.id);
+            inflight_.Unlock();
+            return 0;
+        }
+        state_.SignalEvent();
+        return task.id;
+    }
+
+    size_t WorkerPool::collect(std::vector<WorkerResult> &results)
+    {
+        WorkerResult batch[COLLECT_BATCH];
+        size_t total = 0;
+        size_t count;
+        while ((count = results_.PopBatch(batch, COLLECT_BATCH)) > 0)
+        {
+            inflight_.Lock();
+            for (size_t i = 0; i < count; i++)
+            {
+                if (!inflight_table_->tasks.Erase(batch[i].id))
+                    continue;
+                results.push_back(batch[i]);
+                total++;
+            }
+            inflight_.Unlock();
+        }
+        return total;
+    }
+
+    template <class Pred>
+    size_t WorkerPool::dropIf(Pred pred, std::vector<uint64_t> &ids)
+    {
+        size_t first = ids.size();
+        inflight_.Lock();
+        inflight_table_->tasks.ForEach([&](const uint64_t &id, InFlightTask &task)
+                                       {
+            if (pred(task))
+                ids.push_back(id); });
+        for (size_t i = first; i < ids.size(); i++)
+            inflight_table_->tasks.Erase(ids[i]);
+        inflight_.Unlock();
+        return ids.size() - first;
+    }
+
+    size_t WorkerPool::dropWorkerTasks(int pid, std::vector<uint64_t> &ids)
+    {
+        return dropIf([pid](const InFlightTask &task)
+                      { return task.worker == pid; },
+                      ids);
+    }
+
+    size_t WorkerPool::dropExpired(int64_t max_age_ms, std::vector<uint64_t> &ids)
+    {
+        int64_t deadline = nowMs() - max_age_ms;
+        return dropIf([deadline](const InFlightTask &task)
+                      { return task.submitted_ms < deadline; },
+                      ids);
+    }
+
+    bool WorkerPool::claim(uint64_t id, int pid)
+    {
+        inflight_.Lock();
+        InFlightTask *task = inflight_table_->tasks.Find(id);
+        if (task != NULL)
+            task->worker = pid;
+        inflight_.Unlock();
+        return task != NULL;
+    }
+
+    size_t WorkerPool::queued()
+    {
+        return tasks_.Size();
+    }
+
+    void WorkerPool::shutdown()
+    {
+        state_.Data()->shutdown.store(1);
+        state_.SignalEvent();
+    }
+
+    void WorkerPool::serve(int slot, const Handler &handler, const Check &master_alive)
+    {
+        if (!isValid() || slot < 0 || slot >= MAX_WORKERS)
+            return;
+        WorkerPoolState *state = state_.Data();
+        int pid = currentProcessId();
+
+        // Мастер записывает PID после запуска, воркер может успеть раньше. Чужой PID -
+        // в слоте уже есть воркер
+        int owner = 0;
+        if (!state->pids[slot].compare_exchange_strong(owner, pid) && owner != pid)
+            return;
+
+        std::mutex heartbeat_mutex;
+        std::condition_variable heartbeat_stop;
+        bool serving = true;
+        std::thread heartbeat([&]
+                              {
+            std::unique_lock<std::mutex> lock(heartbeat_mutex);
+            while (serving)
+            {
+                state->heartbeats[slot].store(nowMs());
+                heartbeat_stop.wait_for(lock, std::chrono::milliseconds(WORKER_HEARTBEAT_MS));
+            } });
+
+        while (true)
+        {
+            // Номер события - до проверок, иначе можно проспать задачу
+            uint32_t seen = state_.EventSeq();
+            if (state->shutdown.load() != 0 || slot >= state->target.load() || state->pids[slot].load() != pid)
+                break;
+
+            WorkerTask task;
+            if (tasks_.Pop(task))
+            {
+                if (!claim(task.id, pid))
+                    continue;
+                WorkerResult result;
+                result.id = task.id;
+                result.kind = task.kind;
+                result.pid = pid;
+                result.value = handler(task);
+                // Результаты некому забрать - ждём, пока мастер жив
+                while (!results_.Push(result) && master_alive())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            if (!master_alive())
+                break;
+            state_.WaitEvent(seen, IDLE_WAIT_MS);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(heartbeat_mutex);
+            serving = false;
+        }
+        heartbeat_stop.notify_one();
+        heartbeat.join();
+
+        // Слот освобождается, только если он всё ещё наш
+        owner = pid;
+        state->pids[slot].compare_exchange_strong(owner, 0);
+    }
+
+}
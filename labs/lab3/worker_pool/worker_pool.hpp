@@ -0,0 +1,121 @@
+#pragma once
+
+#include "shared_arena.hpp"
+#include "shared_memory.hpp"
+#include "shared_ring.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace cplib
+{
+
+    const int MAX_WORKERS = 64;
+    const size_t WORKER_QUEUE_SIZE = 1024;
+    const size_t INFLIGHT_ARENA_SIZE = 64 * 1024;
+    const size_t INFLIGHT_ARENA_MAX = 16 * 1024 * 1024;
+    const int WORKER_HEARTBEAT_MS = 1000;
+    const int WORKER_TIMEOUT_MS = 5000; // Воркер без heartbeat слота дольше - считается умершим
+
+    // Задача и результат копируются через общую память побайтно. Что означают
+    // kind и аргументы, решает приложение
+    struct WorkerTask
+    {
+        uint64_t id;
+        uint32_t kind;
+        int64_t args[3];
+    };
+
+    struct WorkerResult
+    {
+        uint64_t id;
+        uint32_t kind;
+        int32_t pid; // Воркер, выполнивший задачу
+        int64_t value;
+    };
+
+    // Общее состояние пула. Событие сегмента - пришли задачи или изменился состав
+    struct WorkerPoolState
+    {
+        WorkerPoolState() : target(0), shutdown(0), next_task_id(1)
+        {
+            for (auto &pid : pids)
+                pid.store(0);
+            for (auto &heartbeat : heartbeats)
+                heartbeat.store(0);
+        }
+        std::atomic<int> target;   // Сколько воркеров держит мастер; слоты дальше - выходят
+        std::atomic<int> shutdown; // Группа завершается - выходят все
+        std::atomic<uint64_t> next_task_id;
+        std::atomic<int> pids[MAX_WORKERS]; // 0 - слот пуст
+        // steady_clock, мс. Обновляет воркер слота, пока работает; по нему о воркере судит
+        // мастер, который его не запускал, - PID мог достаться другому процессу
+        std::atomic<int64_t> heartbeats[MAX_WORKERS];
+    };
+
+    // Задача, отправленная и ещё не забранная через collect
+    struct InFlightTask
+    {
+        uint32_t kind;
+        int32_t submitter; // Кто отправил
+        int32_t worker;    // Кто выполняет; 0 - ещё в очереди
+        int64_t submitted_ms;
+    };
+
+    // Таблица отправленных задач - в арене сегмента <name>_inflight
+    struct InFlightTable
+    {
+        explicit InFlightTable(SharedArena &arena) : tasks(arena) {}
+        SharedHashMap<uint64_t, InFlightTask> tasks;
+    };
+
+    // Пул процессов-воркеров: задачи и результаты - MPMC кольца в общей памяти.
+    // Запускает и перезапускает воркеров мастер группы, пул только хранит их слоты
+    class WorkerPool
+    {
+    public:
+        using Handler = std::function<int64_t(const WorkerTask &)>;
+        using Check = std::function<bool()>;
+
+        explicit WorkerPool(const std::string &name);
+
+        bool isValid();
+
+        // Мастер
+        void setTarget(int count); // Заодно снимает shutdown
+        int target();
+        int workerPid(int slot);
+        void setWorkerPid(int slot, int pid); // Запуск считается heartbeat'ом слота
+        bool workerAlive(int slot);           // Слот занят и heartbeat не старше WORKER_TIMEOUT_MS
+        // Номер задачи; 0 - очередь или таблица отправленных задач полна
+        uint64_t submit(uint32_t kind, int64_t arg0 = 0, int64_t arg1 = 0, int64_t arg2 = 0);
+        // Результаты снятых задач (dropWorkerTasks, dropExpired) не возвращаются
+        size_t collect(std::vector<WorkerResult> &results);
+        // Снять задачи, взятые воркером pid (он завершился), и отправленные раньше
+        // max_age_ms назад. Номера снятых добавляются в ids; задачи из очереди воркеры пропустят
+        size_t dropWorkerTasks(int pid, std::vector<uint64_t> &ids);
+        size_t dropExpired(int64_t max_age_ms, std::vector<uint64_t> &ids);
+        size_t queued(); // Приблизительно
+        void shutdown();
+
+        // Воркер: выполнять задачи, пока слот за этим процессом, пул работает и
+        // master_alive() - true. Без задач спит на событии сегмента. Heartbeat слота
+        // обновляет свой поток: долгая задача не выглядит смертью воркера
+        void serve(int slot, const Handler &handler, const Check &master_alive);
+
+    private:
+        // Взять задачу в работу; false - её сняли, пока она стояла в очереди
+        bool claim(uint64_t id, int pid);
+        template <class Pred>
+        size_t dropIf(Pred pred, std::vector<uint64_t> &ids);
+
+        SharedMem<WorkerPoolState> state_;
+        SharedRing<WorkerTask, WORKER_QUEUE_SIZE, RingMode::MPMC> tasks_;
+        SharedRing<WorkerResult, WORKER_QUEUE_SIZE, RingMode::MPMC> results_;
+        SharedArenaSegment inflight_;
+        InFlightTable *inflight_table_;
+    };
+
+}